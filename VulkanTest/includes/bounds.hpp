@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "glmd.hpp"
+
+// Bounding volumes of positions. Like mesh.cpp nothing in here touches Vulkan.
+
+// Axis aligned box, and a sphere around its center. The sphere of a mesh or a submesh holds every
+// vertex as tightly as a sphere with that center can; when only the box is known it goes through
+// its corners.
+struct MeshBounds {
+	Vec3 min;
+	Vec3 max;
+	Vec3 center;
+	float radius = 0.0f;
+};
+
+// Box and sphere of count positions laid out stride bytes apart, like the pos of a vertex array.
+// The scans run on independent lanes so the compiler vectorizes them. Empty input gives a point
+// at the origin.
+MeshBounds computeBounds(const Vec3 *positions, size_t count, size_t stride = sizeof(Vec3));
+
+// Same over the positions the indices reference, for a submesh of a shared vertex array
+MeshBounds computeBounds(const Vec3 *positions, size_t stride, const uint32_t *indices,
+						 size_t count);
+
+// Sets the sphere to the one through the corners of the box
+void sphereAroundBox(MeshBounds &bounds);
+
+// Moves the box and the sphere by -offset
+void translateBounds(MeshBounds &bounds, const Vec3 &offset);
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "mesh.hpp"
+
+// Bounding volume hierarchy over the triangles of a mesh, to find what a ray hits without testing
+// every triangle, for picking on the CPU. Like mesh.cpp nothing in here touches Vulkan.
+
+// Most triangles a leaf holds, unless they all share one centroid
+const uint32_t BVH_MAX_LEAF_TRIANGLES = 8;
+
+// 32 bytes, two to a cache line. An inner node has count 0 and its children at first and
+// first + 1; a leaf holds the count triangles of Bvh::triangles from first.
+struct BvhNode {
+	Vec3 min;
+	uint32_t first;
+	Vec3 max;
+	uint32_t count;
+};
+
+// The root is nodes[0], each subtree follows its root. triangles holds triangle numbers, the
+// triangle t being mesh.indices[t * 3 .. t * 3 + 2], leaf after leaf.
+struct Bvh {
+	std::vector<BvhNode> nodes;
+	std::vector<uint32_t> triangles;
+};
+
+// Nearest triangle along a ray, at origin + distance * direction, and the weights of its second
+// and third corners at that point
+struct RayHit {
+	uint32_t triangle = UINT32_MAX;
+	float distance = std::numeric_limits<float>::infinity();
+	float u = 0.0f;
+	float v = 0.0f;
+};
+
+// Builds the hierarchy over the triangles of the full mesh, the levels of detail left out. Every
+// node is split at the best of 16 planes per axis between the centroids of its triangles by the
+// surface area heuristic, or becomes a leaf when that is cheaper. The top levels bin their
+// triangles on every thread, and the subtrees below are built side by side, `threads` at once (0
+// uses every core).
+Bvh buildBvh(const Mesh &mesh, unsigned threads = 0);
+
+// Closest triangle the ray hits from either side, with a distance in [0, hit.distance) on entry.
+// Returns false and leaves hit alone when there is none.
+bool intersectBvh(const Bvh &bvh, const Mesh &mesh, const Vec3 &origin, const Vec3 &direction,
+				  RayHit &hit);
+
+// The same by testing every triangle of the full mesh, to check and time the hierarchy against
+bool intersectTriangles(const Mesh &mesh, const Vec3 &origin, const Vec3 &direction, RayHit &hit);
+
+// Submesh of the full mesh a triangle belongs to, SIZE_MAX when none does
+size_t submeshOfTriangle(const Mesh &mesh, uint32_t triangle);
+
+// Expected cost of a ray through the hierarchy, in triangle tests, for comparing builds
+float bvhCost(const Bvh &bvh);
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Hash table from keys to uint32_t ids, for welding: keys are only ever inserted and looked up.
+// Every slot holds a key next to its id in one flat array probed linearly, so a lookup usually
+// touches a single cache line and an insertion never allocates. The table is sized up front from
+// the expected key count and stays at most half full, it doubles when the estimate was too low.
+// Hash must mix its low bits well, they pick the first slot.
+template <typename Key, typename Hash> class FlatIdMap {
+public:
+	static constexpr uint32_t none = UINT32_MAX;
+
+	explicit FlatIdMap(size_t expected = 0) { reserve(expected); }
+
+	void reserve(size_t expected) {
+		size_t capacity = 16;
+		while (capacity < expected * 2)
+			capacity *= 2;
+		if (capacity > slots.size())
+			rebuild(capacity);
+	}
+
+	// Id of key. When key is not in the table yet it gets `id` and isNew is set.
+	uint32_t insert(const Key &key, uint32_t id, bool &isNew) {
+		if ((count + 1) * 2 > slots.size())
+			rebuild(slots.size() * 2);
+		size_t mask = slots.size() - 1;
+		for (size_t i = Hash()(key) & mask;; i = (i + 1) & mask) {
+			Slot &slot = slots[i];
+			if (slot.id == none) {
+				slot.key = key;
+				slot.id = id;
+				count++;
+				isNew = true;
+				return id;
+			}
+			if (slot.key == key) {
+				isNew = false;
+				return slot.id;
+			}
+		}
+	}
+
+	// Id of key, none when it was never inserted
+	uint32_t find(const Key &key) const {
+		size_t mask = slots.size() - 1;
+		for (size_t i = Hash()(key) & mask;; i = (i + 1) & mask) {
+			const Slot &slot = slots[i];
+			if (slot.id == none || slot.key == key)
+				return slot.id;
+		}
+	}
+
+	size_t size() const { return count; }
+	size_t capacity() const { return slots.size(); }
+	double loadFactor() const { return static_cast<double>(count) / slots.size(); }
+
+	// Mean number of slots a lookup of a present key reads, 1 when nothing ever collided
+	double averageProbeLength() const {
+		if (count == 0)
+			return 0.0;
+		size_t mask = slots.size() - 1;
+		size_t total = 0;
+		for (size_t i = 0; i < slots.size(); i++) {
+			if (slots[i].id != none)
+				total += ((i - (Hash()(slots[i].key) & mask)) & mask) + 1;
+		}
+		return static_cast<double>(total) / count;
+	}
+
+private:
+	struct Slot {
+		Key key;
+		uint32_t id;
+	};
+
+	std::vector<Slot> slots;
+	size_t count = 0;
+
+	void rebuild(size_t capacity) {
+		std::vector<Slot> old(capacity, Slot{Key(), none});
+		old.swap(slots);
+		size_t mask = capacity - 1;
+		for (const Slot &slot : old) {
+			if (slot.id == none)
+				continue;
+			size_t i = Hash()(slot.key) & mask;
+			while (slots[i].id != none)
+				i = (i + 1) & mask;
+			slots[i] = slot;
+		}
+	}
+};
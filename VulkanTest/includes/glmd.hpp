@@ -114,6 +114,7 @@ public:
 	Mat4& operator=(const Mat4& other);
 	Mat4 operator*(const Mat4& other) const;
 	Mat4 transpose() const;
+	Mat4 inverse() const;
 
 	static Mat4 translate(const Mat4& mat, const Vec3& v);
 	static Mat4 rotate(const Mat4& mat, float angle, const Vec3& axis);
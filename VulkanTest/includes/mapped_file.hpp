@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Read-only mmap of a whole file. The bytes stay valid as long as the object is alive.
+class MappedFile {
+public:
+	MappedFile(const char *filepath) { open(filepath); }
+	~MappedFile() { close(); }
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	bool isOpen() const { return fd != -1; }
+	const char *data() const { return bytes; }
+	size_t size() const { return length; }
+
+private:
+	int fd = -1;
+	const char *bytes = nullptr;
+	size_t length = 0;
+
+	void open(const char *filepath) {
+		fd = ::open(filepath, O_RDONLY);
+		if (fd == -1)
+			return;
+
+		struct stat st;
+		if (fstat(fd, &st) == -1) {
+			close();
+			return;
+		}
+		length = static_cast<size_t>(st.st_size);
+		// mmap refuses zero-length mappings, an empty file is simply an empty view
+		if (length == 0)
+			return;
+
+		void *ptr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (ptr == MAP_FAILED) {
+			close();
+			return;
+		}
+		madvise(ptr, length, MADV_SEQUENTIAL);
+		bytes = static_cast<const char *>(ptr);
+	}
+
+	void close() {
+		if (bytes != nullptr)
+			munmap(const_cast<char *>(bytes), length);
+		if (fd != -1)
+			::close(fd);
+		fd = -1;
+		bytes = nullptr;
+		length = 0;
+	}
+};
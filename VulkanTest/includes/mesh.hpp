@@ -0,0 +1,175 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "glmd.hpp"
+#include "objloader.hpp"
+
+// Everything between the parsed OBJ and the arrays uploaded to the GPU. Nothing in here touches
+// Vulkan, so the loading pipeline can be run and timed without a window or a device.
+
+// The color of a vertex comes from the material of its submesh, see GpuMaterial. The normal is the
+// "vn" of the OBJ, or zero until generateNormals runs when the file has none.
+struct Vertex {
+	Vec3 pos;
+	Vec2 texCoord;
+	Vec3 normal;
+
+	bool operator==(const Vertex &other) const {
+		return pos == other.pos && texCoord == other.texCoord && normal == other.normal;
+	}
+};
+
+// Mixes the bits of the position, texture coordinates and normal, every one of them reaches the
+// low bits FlatIdMap probes with. Adding 0.0f turns -0.0f into 0.0f, which compares equal to it.
+struct VertexHash {
+	size_t operator()(const Vertex &vertex) const {
+		const float values[8] = {vertex.pos.x,		vertex.pos.y,	   vertex.pos.z,
+								 vertex.texCoord.s, vertex.texCoord.t, vertex.normal.x,
+								 vertex.normal.y,	vertex.normal.z};
+		uint64_t h = 0;
+		for (float value : values) {
+			uint32_t bits;
+			value += 0.0f;
+			memcpy(&bits, &value, sizeof(bits));
+			h = (h + bits) * 0x9E3779B97F4A7C15ull;
+		}
+		h ^= h >> 32;
+		h *= 0xD6E8FEB86659FD93ull;
+		return static_cast<size_t>(h ^ (h >> 32));
+	}
+};
+
+// Optional 12 byte layout of a Vertex on the GPU: the position and the texture coordinates as
+// 16-bit UNORM fractions of the ranges the mesh spans, and the normal in octahedral encoding as
+// two 8-bit SNORM. R16G16B16_UNORM is rarely supported for vertex input, so the position is read
+// as four components, the normal being the fourth.
+struct CompactVertex {
+	uint16_t pos[3];
+	int8_t normal[2];
+	uint16_t texCoord[2];
+};
+
+// What the vertex shader applies to the attributes to get model space positions and texture
+// coordinates back, offset + attribute * scale, and whether the normal is octahedral (1 in the x
+// of normalDecode). The defaults leave float vertices as they are.
+struct VertexDecode {
+	float positionOffset[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+	float positionScale[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+	float texCoordOffset[2] = {0.0f, 0.0f};
+	float texCoordScale[2] = {1.0f, 1.0f};
+	float normalDecode[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+};
+
+// Whole triangles of one submesh, contiguous in the index buffer and using at most 64 distinct
+// vertices (optimizeVertexFetch may split one into equal copies), with a sphere around them and
+// the cone their normals lie in. The cone half angle has cosine coneCos and sine coneSin; a cone
+// of 90 degrees or more (0 and 1) always has a triangle facing the camera. See meshlet.hpp.
+struct Meshlet {
+	uint32_t indexOffset;
+	uint32_t indexCount;
+	Vec3 center;
+	float radius;
+	Vec3 coneAxis;
+	float coneCos;
+	float coneSin;
+};
+
+// A coarser copy of the submeshes over the same vertices, whose indices follow the ones of the
+// full mesh in the index buffer: submesh i is [firstIndex[i], firstIndex[i + 1]). error is about
+// how far its surface is from the full one, in model space. See simplify.hpp.
+struct MeshLod {
+	float error;
+	std::vector<uint32_t> firstIndex;
+};
+
+// What Scop uploads and draws for a model: one shared vertex / index buffer cut into submeshes,
+// and the submeshes into meshlets. The meshlets of submesh i are [firstMeshlet[i],
+// firstMeshlet[i + 1]); both are empty until buildMeshlets runs. lods holds the levels of detail
+// from finest to coarsest, the full mesh not included.
+struct Mesh {
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	std::vector<Submesh> submeshes;
+	std::vector<std::string> materials;
+	std::vector<std::string> materialLibraries;
+	MeshBounds bounds;
+	std::vector<Meshlet> meshlets;
+	std::vector<uint32_t> firstMeshlet;
+	std::vector<MeshLod> lods;
+};
+
+const uint32_t MATERIAL_TEXTURED = 1;
+
+// One entry of the material storage buffer, in the std430 layout of the shaders
+struct GpuMaterial {
+	float diffuse[4];  // Kd and d
+	float specular[4]; // Ks and Ns
+	uint32_t flags;
+	uint32_t padding[3];
+};
+
+// Slot of a submesh in the material table, submeshes without a material use the last one
+inline uint32_t materialSlot(const Mesh &mesh, const Submesh &submesh) {
+	return submesh.material == NO_MATERIAL ? static_cast<uint32_t>(mesh.materials.size())
+										   : submesh.material;
+}
+
+// Indices of the full mesh, the ones of the levels of detail follow them
+inline size_t fullIndexCount(const Mesh &mesh) {
+	return mesh.lods.empty() ? mesh.indices.size() : mesh.lods.front().firstIndex.front();
+}
+
+// Reads the "mtllib" files of the model, looked up next to it, and fills one GpuMaterial per
+// material name plus a default one. Names no library defines get the default: white, textured.
+// Returns how many names were found, what the libraries had wrong goes to log.
+size_t buildMaterialTable(const Mesh &mesh, const std::string &modelPath,
+						  std::vector<GpuMaterial> &table, std::ostream &log = std::cout);
+
+// One draw worth of the index buffer, whose indices are vertex - vertexOffset
+struct IndexRange {
+	uint32_t indexOffset;
+	uint32_t indexCount;
+	uint32_t vertexOffset;
+};
+
+// How the index buffer of a mesh is uploaded and drawn. The ranges of submesh i at level of detail
+// l (0 being the full mesh) are [firstRange[s], firstRange[s + 1]), in index buffer order, with s
+// = l * submeshCount + i.
+struct IndexLayout {
+	bool narrow = false; // uint16_t indices
+	std::vector<IndexRange> ranges;
+	std::vector<uint32_t> firstRange;
+};
+
+// uint32_t indices, one range per submesh and level of detail
+IndexLayout wideIndexLayout(const Mesh &mesh);
+
+// Narrows the indices to 16 bits. Every submesh of every level is cut into runs of whole triangles
+// spanning at most 65536 vertices, each with its own vertex offset, so a mesh with no more
+// vertices than that gets one range per submesh and level. Falls back to the wide layout, leaving
+// narrow empty, when a single triangle spans more, which optimizeVertexFetch rules out.
+IndexLayout narrowIndices(const Mesh &mesh, std::vector<uint16_t> &narrow);
+
+// Packs vertices into the compact layout and returns how to decode them
+VertexDecode quantizeVertices(const std::vector<Vertex> &vertices,
+							  std::vector<CompactVertex> &compact);
+
+// Spherical projection around the origin, for models without texture coordinates
+void computeUVs(Vertex &vertex);
+
+// Turns a parsed OBJ into the mesh Scop draws: it is centered on its bounding box, vertices get
+// their texture coordinates and the normals of the file, and the ones that end up equal by value
+// are merged. The mesh and
+// every submesh get their exact bounds. objMesh.positions is centered in place, the projected
+// texture coordinates are stored in objMesh.texCoords when it has none, its names are moved out.
+void buildMesh(ObjMesh &objMesh, Mesh &mesh);
+
+MeshBounds computeBounds(const std::vector<Vertex> &vertices);
+
+// True when the box is entirely outside one plane of the view frustum of clip (proj * view *
+// model, Vulkan depth range)
+bool isOutsideFrustum(const MeshBounds &bounds, const Mat4 &clip);
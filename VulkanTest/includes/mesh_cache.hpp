@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "mesh.hpp"
+
+// Bump whenever the layout of the file or the processing that produces the cached arrays changes
+const uint32_t MESH_CACHE_VERSION = 17;
+
+// A .scopmesh file holds the final vertex and index arrays of a model, ready to be uploaded, its
+// submesh, meshlet and level of detail tables and material names, together with a stamp of the
+// OBJ it was built from. The stamp is the source size, its mtime and a hash of a few evenly spaced
+// blocks, so validating it never reads the whole source.
+
+// Fills mesh from cachePath. Returns false when the cache is missing, corrupt, written by another
+// version, older than sourcePath, or built with other settings: whatever options of the
+// processing change the cached arrays, packed by the caller. The arrays are copied out of the
+// mapping, since Scop keeps the mesh on the host for culling, levels of detail and picking.
+bool readMeshCache(const std::string &cachePath, const char *sourcePath, Mesh &mesh,
+				   uint64_t settings = 0);
+
+// Writes the cache through a temporary file renamed into place, so a crash never leaves a
+// truncated cache behind. Returns false if the file could not be written.
+bool writeMeshCache(const std::string &cachePath, const char *sourcePath, const Mesh &mesh,
+					uint64_t settings = 0);
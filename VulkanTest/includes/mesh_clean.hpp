@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include "mesh.hpp"
+
+// Cleanup of the built mesh before anything is computed from its triangles. Like mesh.cpp
+// nothing in here touches Vulkan.
+
+// Weld distance Scop and scop_bench use unless told otherwise, as a fraction of the diagonal of
+// the bounding box: a little more than the rounding of an exporter writing 6 decimals on a model
+// about one unit wide
+const float DEFAULT_WELD_EPSILON = 1e-5f;
+
+// What cleanMesh removed
+struct MeshCleanStats {
+	size_t weldedVertices;		// merged into a vertex within epsilon
+	size_t unusedVertices;		// only used by the triangles removed
+	size_t degenerateTriangles; // two corners on one vertex, or all three on a line
+	size_t duplicateTriangles;	// the same vertices in the same winding as an earlier one
+};
+
+// Merges every vertex into the first one within epsilon (times the diagonal of mesh.bounds) of
+// it, then drops the degenerate and duplicate triangles and the vertices no triangle uses
+// anymore. Thin triangles are kept as long as their area is not zero. With compareTexCoords the
+// texture coordinates must be within epsilon too, so seams survive; leave it off when they were
+// projected from the positions, they follow the welds. With compareNormals so must the normals,
+// so the hard edges of the file survive; leave it off when they are generated afterwards. The
+// vertices that stay keep their order and their values. Vertices are found through a uniform
+// hash grid of cells twice epsilon wide, so every lookup reads 8 cells and the whole pass runs in
+// linear time. The submesh ranges and the bounds follow, submeshes left without triangles are
+// removed. An epsilon of 0 only removes the triangles. Run it on the built mesh, before the
+// normals and the optimization passes.
+MeshCleanStats cleanMesh(Mesh &mesh, float epsilon, bool compareTexCoords, bool compareNormals);
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "mesh.hpp"
+#include "mesh_clean.hpp"
+#include "normals.hpp"
+
+// Passes over a built Mesh that only change the order of its data, never what is drawn, and
+// processMesh, which chains them with the other passes in the order Scop runs them. Like mesh.cpp
+// nothing in here touches Vulkan.
+
+// ACMR growth optimizeOverdraw may trade for less overdraw, unless told otherwise
+const float DEFAULT_OVERDRAW_THRESHOLD = 1.05f;
+
+// How well an index buffer uses the post-transform vertex cache of the GPU, simulated as a FIFO of
+// cacheSize vertices. ACMR is the vertex shader runs per triangle (0.5 at best on a regular grid,
+// 3 at worst), ATVR the runs per referenced vertex (1 at best).
+struct VertexCacheStats {
+	double acmr = 0.0;
+	double atvr = 0.0;
+};
+
+VertexCacheStats analyzeVertexCache(const std::vector<uint32_t> &indices, size_t vertexCount,
+									unsigned cacheSize = 16);
+
+// How much of the vertex buffer is read to draw the mesh once: bytes fetched in 64 byte lines
+// through a 16 KiB cache, over the size of the buffer. 1 means every vertex was read exactly once.
+double analyzeVertexFetch(const std::vector<uint32_t> &indices, size_t vertexCount,
+						  size_t vertexSize);
+
+// How many times the pixels a mesh covers get shaded, from viewCount orthographic views spread
+// evenly over the sphere around the origin, each size x size pixels and framing the farthest
+// vertex. The full mesh is drawn in index order by a software rasterizer with the depth test and
+// culling of the graphics pipeline: VK_COMPARE_OP_LESS, back faces culled, counter-clockwise front
+// faces. overdraw is the fragments that passed the depth test over the covered pixels, 1 when
+// every pixel was shaded once.
+struct OverdrawStats {
+	size_t shaded = 0;
+	size_t covered = 0;
+	double overdraw = 0.0;
+};
+
+OverdrawStats analyzeOverdraw(const Mesh &mesh, int viewCount = 16, int size = 512);
+
+// Reorders the triangles of every submesh so that consecutive triangles share vertices, with Tom
+// Forsyth's linear-speed vertex cache optimization. Triangles stay in their submesh and keep their
+// winding, so the submesh table and bounds still hold. Once buildMeshlets ran, the triangles of
+// every meshlet are reordered instead and stay in their meshlet. A submesh or meshlet whose order
+// already misses no more through FIFO caches of 8, 16 and 32 entries together is left as it was.
+void optimizeVertexCache(Mesh &mesh);
+
+// The same for the triangleCount triangles at indices alone. localIds has an entry per vertex of
+// the mesh, all UINT32_MAX, and is left that way so it can serve the next run.
+void optimizeVertexCache(uint32_t *indices, size_t triangleCount,
+						 std::vector<uint32_t> &localIds);
+
+// Cuts the triangles of every submesh into clusters and draws first the clusters that face away
+// from the center of the mesh, the outer surfaces most likely to hide the rest from any viewpoint
+// (Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced
+// Overdraw"). Clusters end where the vertex cache order restarts, and wherever the ACMR of the
+// cluster so far is within threshold times the ACMR of the whole run: 1.05 lets the ACMR grow by
+// about 5%, higher values give smaller clusters and less overdraw. Run it after
+// optimizeVertexCache, before buildMeshlets.
+void optimizeOverdraw(Mesh &mesh, float threshold = DEFAULT_OVERDRAW_THRESHOLD);
+
+// Renumbers the vertices in order of first use by the index buffer and rewrites the indices, so
+// drawing reads the vertex buffer almost sequentially. Run it after anything that reorders indices.
+// The numbering goes in blocks of 65536 vertices, so that narrowIndices can always use 16-bit
+// ranges: the triangles of a block only use vertices of that block, and the few an earlier block
+// used too are duplicated. The levels of detail are numbered last: each of their triangles goes in a
+// block that has all of its vertices where there is one, and the triangles of a level are grouped
+// by block. Vertices no index uses are kept at the end.
+void optimizeVertexFetch(Mesh &mesh);
+
+// The options of processMesh, and what the OBJ the mesh was built from had
+struct MeshSettings {
+	float weldEpsilon = DEFAULT_WELD_EPSILON;
+	float creaseAngle = DEFAULT_CREASE_ANGLE; // degrees
+	float overdrawThreshold = DEFAULT_OVERDRAW_THRESHOLD;
+	bool hasTexCoords = false; // "vt", the weld keeps their seams
+	bool hasNormals = false;   // "vn", kept instead of generated and the weld keeps their edges
+	unsigned threads = 0;	   // of generateNormals and buildLods, 0 uses every core
+};
+
+// What processMesh removed and added
+struct MeshProcessStats {
+	MeshCleanStats cleaned = {};
+	bool generatedNormals = false;
+	size_t creaseVertices = 0; // copies generateNormals added at the creases
+};
+
+// Runs one pass of processMesh, by calling run once: lets the caller time every pass, or look at
+// the mesh and at the stats so far before and after it. The passes are "clean", "normals",
+// "vcache", "overdraw", "meshlets", "lods" and "vfetch", in that order; "normals" is skipped when
+// the file has them. A caller that only needs the first passes may leave run uncalled for the
+// rest, each pass only relies on the ones before it.
+using MeshPassRunner = std::function<void(const char *pass, const std::function<void()> &run,
+										  const MeshProcessStats &stats)>;
+
+// Everything between buildMesh and the arrays Scop uploads and caches: cleanMesh,
+// generateNormals, optimizeVertexCache, optimizeOverdraw, buildMeshlets with the vertex cache
+// order of every meshlet, buildLods and optimizeVertexFetch. Scop, scop_bench and scop_meshstat
+// all go through it, so the tools measure what Scop draws.
+MeshProcessStats processMesh(Mesh &mesh, const MeshSettings &settings,
+							 const MeshPassRunner &runner = nullptr);
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "mesh.hpp"
+
+// Meshlets: short runs of the index buffer with the bounds the CPU needs to skip them every frame,
+// so culling works on any driver, without mesh shaders. Like mesh.cpp nothing in here touches
+// Vulkan.
+
+const uint32_t MESHLET_MAX_VERTICES = 64;
+const uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+// Reorders the triangles of every submesh into meshlets and fills mesh.meshlets. A meshlet starts
+// at the first triangle left in the current order and grows over the triangles sharing a position
+// with it, fewest new vertices first, then the ones whose normal is closest to the meshlet's:
+// the tighter the normal cone, the more often the whole meshlet faces away. Triangles stay in
+// their submesh and keep their winding. Run it after optimizeOverdraw, before
+// optimizeVertexFetch.
+void buildMeshlets(Mesh &mesh);
+
+// Culls meshlets in model space against the clip transform of a frame (proj * view * model,
+// Vulkan depth range): outside the view frustum, or every triangle facing away from the eye.
+class MeshletCuller {
+public:
+	explicit MeshletCuller(const Mat4 &clip);
+
+	bool isVisible(const Meshlet &meshlet) const;
+	// Only against the frustum, with the sphere of the bounds
+	bool isVisible(const MeshBounds &bounds) const;
+
+private:
+	// Normalized a * x + b * y + c * z + d >= 0 inside
+	float planes[6][4];
+	Vec3 eye;
+	// Orthographic projections have no eye point, their meshlets are only frustum culled
+	bool hasEye = false;
+};
+
+// Appends what to draw of submesh i at a level of detail: the meshlets culler keeps, cut along the
+// index ranges of layout so every piece has a single vertex offset. Without a culler or meshlets,
+// and at the coarser levels which have none, the ranges of the submesh as they are.
+void appendVisibleRanges(const Mesh &mesh, const IndexLayout &layout, size_t submesh,
+						 uint32_t level, const MeshletCuller *culler,
+						 std::vector<IndexRange> &ranges);
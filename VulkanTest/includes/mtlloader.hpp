@@ -0,0 +1,23 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "glmd.hpp"
+
+// One "newmtl" block of an MTL file, with the defaults of the format for anything it omits
+struct MtlMaterial {
+	std::string name;
+	Vec3 diffuse = Vec3(0.8f, 0.8f, 0.8f); // Kd
+	Vec3 specular = Vec3(0.0f, 0.0f, 0.0f); // Ks
+	float shininess = 0.0f;					// Ns
+	float dissolve = 1.0f;					// d, or 1 - Tr
+	std::string diffuseMap;					// map_Kd file name, empty without one
+};
+
+// Appends the materials of an MTL file. Only Kd, Ks, Ns, d / Tr and map_Kd are read, every other
+// statement is skipped, and so are the lines of those whose values cannot be read, with a message.
+// Returns false when the file cannot be opened. The messages go to log. The dissolve goes in the alpha of the material
+// color, but the pipeline draws without blending, so it has no visible effect yet.
+bool loadMtl(const char *filepath, std::vector<MtlMaterial> &materials,
+			 std::ostream &log = std::cout);
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "mesh.hpp"
+
+// Vertex normals from the triangles of an indexed mesh. Like mesh.cpp nothing in here touches
+// Vulkan.
+
+// Crease angle in degrees Scop and scop_bench use unless told otherwise
+const float DEFAULT_CREASE_ANGLE = 45.0f;
+
+// Sets the normal of every vertex to the sum of the normals of the triangles around it, each
+// weighted by its area and by the angle of its corner at the vertex. A triangle only takes in the
+// ones within creaseAngle (radians) of its own normal, so the edges where the surface folds more
+// than that stay sharp: a vertex whose triangles get different sums is split into a copy per sum,
+// appended to the vertex buffer, and the indices of the triangles moved to a copy are rewritten.
+// Degenerate triangles add nothing; a vertex with nothing else keeps a zero normal, which the
+// shaders replace by the face normal. Run it on the built mesh, before the optimization passes.
+// Around a vertex of more than 64 corners, a pole say, the crease test compares directions rounded
+// to about 4 degrees, at most 1024 of them, instead of every pair of corners. The work is spread
+// over `threads` threads (0 uses every core): every pass splits the corners or the vertices into
+// disjoint ranges and each thread only writes the entries of its own, so there are no atomics or
+// locks.
+void generateNormals(Mesh &mesh, float creaseAngle, unsigned threads = 0);
@@ -1,62 +1,103 @@
 #pragma once
 
-#include <cstring>
-#include <fstream>
+#include <cstdint>
+#include <functional>
 #include <iostream>
+#include <string>
 #include <vector>
+#include "bounds.hpp"
 #include "glmd.hpp"
 
-bool loadObj(const char *filepath, std::vector<Vec3> &out_vertices) {
-	std::vector<unsigned int> vertex_indices;
-	std::vector<Vec3> temp_vertices;
+// Position / texture coordinate / normal indices of one face corner, `none` for a missing stream
+struct ObjCorner {
+	static constexpr uint32_t none = UINT32_MAX;
 
-	FILE *file = fopen(filepath, "r");
+	uint32_t v;
+	uint32_t vt;
+	uint32_t vn;
 
-	if (file == nullptr) {
-		std::cout << "Cannot open obj file\n";
-		return false;
+	bool operator==(const ObjCorner &other) const {
+		return v == other.v && vt == other.vt && vn == other.vn;
 	}
+};
 
-	while (1) {
-		char lineHeader[128];
-		int res = fscanf(file, "%s", lineHeader);
-		if (res == EOF)
-			break;
-		if (strcmp(lineHeader, "v") == 0) {
-			Vec3 vertex;
-			if (fscanf(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z) != 3) {
-				std::cout << "Error while reading vertices data\n";
-				return false;
-			}
-			temp_vertices.push_back(vertex);
-		} else if (strcmp(lineHeader, "f") == 0) {
-			std::vector<unsigned int> polygonIndices;
-			unsigned int index;
-			char lineEndCheck;
-			int scannedItems;
-
-			do {
-				scannedItems = fscanf(file, "%u", &index);
-				if (scannedItems != 1) {
-					std::cout << "Error while reading face indices\n";
-					fclose(file);
-					return false;
-				}
-				polygonIndices.push_back(index - 1);
-			} while (scannedItems =
-						 fscanf(file, "%c", &lineEndCheck) != EOF && lineEndCheck != '\n');
-
-			for (unsigned int i = 1; i < polygonIndices.size() - 1; i++) {
-				vertex_indices.push_back(polygonIndices[0]);
-				vertex_indices.push_back(polygonIndices[i]);
-				vertex_indices.push_back(polygonIndices[i + 1]);
-			}
-		}
+struct ObjCornerHash {
+	size_t operator()(const ObjCorner &corner) const {
+		uint64_t h = corner.v;
+		h = h * 0x9E3779B97F4A7C15ull + corner.vt;
+		h = h * 0x9E3779B97F4A7C15ull + corner.vn;
+		h ^= h >> 32;
+		h *= 0xD6E8FEB86659FD93ull;
+		return static_cast<size_t>(h ^ (h >> 32));
 	}
+};
 
-	for (unsigned int i = 0; i < vertex_indices.size(); i++) {
-		out_vertices.push_back(temp_vertices[vertex_indices[i]]);
-	}
-	fclose(file);
-	return true;
-}
+const uint32_t NO_MATERIAL = UINT32_MAX;
+
+// Range of the index buffer drawn in one call: the triangles of one "o" / "g" part that use the
+// same "usemtl" material, in file order
+struct Submesh {
+	std::string name;
+	uint32_t material; // index into the material names, NO_MATERIAL before any usemtl
+	uint32_t indexOffset;
+	uint32_t indexCount;
+	MeshBounds bounds;
+};
+
+// Indexed mesh read from an OBJ file. Every vertex is one unique (v, vt, vn) triple of the face
+// records, in order of first use. texCoords and normals run parallel to positions and are only
+// filled when the faces reference "vt" / "vn" data; corners without one get zeros.
+struct ObjMesh {
+	std::vector<Vec3> positions;
+	std::vector<Vec2> texCoords;
+	std::vector<Vec3> normals;
+	std::vector<uint32_t> indices;
+	std::vector<Submesh> submeshes;
+	std::vector<std::string> materials;		   // "usemtl" names, in order of first use
+	std::vector<std::string> materialLibraries; // "mtllib" file names
+};
+
+// How loadObj welds the corners into vertices. Both give the same mesh: Hash walks the corners
+// once through a hash table on one thread, Sort buckets and sorts them on every thread, which
+// pays off on meshes of millions of corners. Auto picks Sort for those when there is more than
+// one thread.
+enum class ObjWeld { Auto, Hash, Sort };
+
+// Parses the "v", "vt", "vn" and "f" records of an OBJ file. Polygons are fan-triangulated and
+// their corners welded into mesh vertices; "o", "g" and "usemtl" records cut the triangles into
+// submeshes. Big files are parsed in parallel on up to `threads`
+// threads (0 uses every core); the output does not depend on the thread count. Errors are written
+// to log.
+bool loadObj(const char *filepath, ObjMesh &mesh, unsigned threads = 0,
+			 ObjWeld weld = ObjWeld::Auto, std::ostream &log = std::cout);
+
+// Sizes the streaming loader works with, in bytes of OBJ text and in elements per batch
+struct ObjStreamLimits {
+	size_t windowSize;
+	size_t batchVertices;
+	size_t batchIndices;
+};
+
+// What the streaming loader knows once the whole file has been read a first time
+struct ObjStreamInfo {
+	size_t vertexCount;
+	size_t indexCount;
+	bool hasTexCoords;
+	bool hasNormals;
+	MeshBounds bounds; // of the triangle corners, the sphere is exact
+	std::vector<Submesh> submeshes;
+	std::vector<std::string> materials;
+	std::vector<std::string> materialLibraries;
+};
+
+// Same vertices and indices as loadObj, without ever holding the file or the mesh in memory. The
+// file is read twice through a window of whole lines: the first pass keeps the "v" / "vt" / "vn"
+// attributes and welds the corners, then `begin` gets the final counts and the second pass hands
+// the mesh to `emit` in order, as ObjMesh batches of at most batchVertices new vertices and
+// batchIndices indices. Faces may only reference attributes read before them, which is what
+// every exporter writes. Only the window and the batches are bounded by limits: the "v" / "vt" /
+// "vn" attributes, the weld table and a flag per position are kept for the whole file, so their
+// memory still grows with it.
+bool streamObj(const char *filepath, const ObjStreamLimits &limits,
+			   const std::function<void(const ObjStreamInfo &)> &begin,
+			   const std::function<void(const ObjMesh &)> &emit);
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <algorithm>
+#include <exception>
+#include <thread>
+#include <vector>
+
+inline unsigned workerCount() {
+	unsigned count = std::thread::hardware_concurrency();
+	return count == 0 ? 1 : count;
+}
+
+// Runs fn(i) for every i in [0, count), spreading the calls over at most maxThreads threads
+// (0 means one per core). The first exception thrown by a worker is rethrown to the caller.
+template <typename Fn> void parallelFor(size_t count, Fn &&fn, unsigned maxThreads = 0) {
+	size_t threadCount = std::min<size_t>(count, maxThreads ? maxThreads : workerCount());
+	if (threadCount <= 1) {
+		for (size_t i = 0; i < count; i++)
+			fn(i);
+		return;
+	}
+
+	std::vector<std::thread> threads;
+	std::vector<std::exception_ptr> errors(threadCount);
+	threads.reserve(threadCount);
+	for (size_t t = 0; t < threadCount; t++) {
+		threads.emplace_back([&, t]() {
+			try {
+				for (size_t i = t; i < count; i += threadCount)
+					fn(i);
+			} catch (...) {
+				errors[t] = std::current_exception();
+			}
+		});
+	}
+	for (auto &thread : threads)
+		thread.join();
+	for (auto &error : errors) {
+		if (error)
+			std::rethrow_exception(error);
+	}
+}
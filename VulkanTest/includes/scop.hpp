@@ -2,7 +2,17 @@
 #define SCOP_HPP
 #define GLFW_INCLUDE_VULKAN
 
+#include "bvh.hpp"
+#include "mesh_cache.hpp"
+#include "mesh_clean.hpp"
+#include "mesh_optimize.hpp"
+#include "meshlet.hpp"
+#include "normals.hpp"
+#include "simplify.hpp"
 #include "utils.hpp"
+#include <cstring>
+#include <future>
+#include <sstream>
 
 #ifdef NDEBUG
 const bool enableValidationLayers = false;
@@ -10,11 +20,64 @@ const bool enableValidationLayers = false;
 const bool enableValidationLayers = true;
 #endif
 
+struct ScopOptions {
+	bool useMeshCache = true;
+	// Host memory budget of the streaming loader in bytes, for its text window, batches and
+	// staging buffer; the OBJ attributes and the weld table come on top. 0 loads the whole model
+	// at once.
+	size_t streamBudget = 0;
+	// How the OBJ corners are welded, the streaming loader always uses the hash table
+	ObjWeld weld = ObjWeld::Auto;
+	// Distance, as a fraction of the diagonal, within which cleanMesh merges vertices
+	float weldEpsilon = DEFAULT_WELD_EPSILON;
+	// ACMR growth optimizeOverdraw may trade for less overdraw
+	float overdrawThreshold = DEFAULT_OVERDRAW_THRESHOLD;
+	// Degrees two triangles may turn from each other and still share smooth normals
+	float creaseAngle = DEFAULT_CREASE_ANGLE;
+	// Generate the normals even when the OBJ has its own "vn"
+	bool generateNormals = false;
+	// Upload CompactVertex instead of Vertex, not available to the streaming loader
+	bool compactVertices = false;
+	// Screen space error in pixels a level of detail may have to be drawn, 0 always draws the full
+	// mesh. Picked per frame, so the cache does not depend on it.
+	float lodError = 1.0f;
+
+	// The options that change the cached mesh, a cache built with other ones is rebuilt. Their
+	// bits are hashed with FNV-1a.
+	uint64_t meshCacheSettings() const {
+		const float values[4] = {overdrawThreshold, creaseAngle, weldEpsilon,
+								 generateNormals ? 1.0f : 0.0f};
+		unsigned char bytes[sizeof(values)];
+		memcpy(bytes, values, sizeof(values));
+		uint64_t hash = 0xCBF29CE484222325ull;
+		for (unsigned char byte : bytes) {
+			hash ^= byte;
+			hash *= 0x100000001B3ull;
+		}
+		return hash;
+	}
+};
+
+// What the loading threads hand over to the render loop
+struct LoadedModel {
+	Mesh mesh;
+	std::vector<GpuMaterial> materials;
+	Bvh bvh;
+};
+
+struct TextureData {
+	std::vector<uint8_t> pixels; // RGBA
+	uint32_t width;
+	uint32_t height;
+};
+
 class Scop {
 public:
-	Scop(const char *modelPath, const char *texturePath)
-		: MODEL_PATH(modelPath), TEXTURE_PATH(texturePath){};
+	Scop(const char *modelPath, const char *texturePath, const ScopOptions &options = {})
+		: MODEL_PATH(modelPath), TEXTURE_PATH(texturePath), options(options){};
 	void run() {
+		startTime = std::chrono::steady_clock::now();
+		startAssetLoading();
 		initWindow();
 		initVulkan();
 		mainLoop();
@@ -25,6 +88,7 @@ public:
 private:
 	const char *MODEL_PATH;
 	const char *TEXTURE_PATH;
+	ScopOptions options;
 	GLFWwindow *window;
 
 	VkInstance instance;
@@ -66,12 +130,42 @@ private:
 	// more cache friendly, because it's closer together in memory. This is especially important
 	// for integrated graphics cards that use shared memory.
 
-	std::vector<Vertex> vertices;
-	std::vector<uint32_t> indices;
+	Mesh model;
+	// Over the triangles of model, for picking with the mouse. Empty for streamed models, whose
+	// vertices are not kept.
+	Bvh modelBvh;
 	VkBuffer vertexBuffer;
 	VkDeviceMemory vertexBufferMemory;
+	VertexDecode vertexDecode;
 	VkBuffer indexBuffer;
 	VkDeviceMemory indexBufferMemory;
+	uint32_t indexCount = 0;
+	// 16-bit whenever the mesh allows it, the ranges are what recordCommandBuffer draws
+	IndexLayout indexLayout;
+
+	// The index ranges of the visible meshlets, rewritten every frame as
+	// VkDrawIndexedIndirectCommand into the buffer of the frame being recorded. Each buffer holds a
+	// command per meshlet and per index range, the most the culling can produce.
+	std::vector<VkBuffer> indirectBuffers;
+	std::vector<VkDeviceMemory> indirectBuffersMemory;
+	std::vector<void *> indirectBuffersMapped;
+	std::vector<IndexRange> visibleRanges;
+	std::vector<VkDrawIndexedIndirectCommand> drawCommands;
+	// Commands one vkCmdDrawIndexedIndirect may take, 1 without the multiDrawIndirect feature
+	uint32_t maxIndirectDraws = 1;
+	// C turns it off to compare, the whole submeshes are drawn then
+	bool meshletCulling = true;
+	// L turns it off to compare, the full mesh is drawn at any distance then
+	bool levelOfDetail = true;
+
+	// GpuMaterial table of the model, read by the fragment shaders at the slot pushed per draw
+	VkBuffer materialBuffer;
+	VkDeviceMemory materialBufferMemory;
+
+	// Submesh drawn alone, -1 draws them all. Hidden and off-screen submeshes are skipped when
+	// the command buffer is recorded, with the transform of the frame being drawn.
+	int isolatedSubmesh = -1;
+	Mat4 clipTransform;
 
 	std::vector<VkBuffer> uniformBuffers;
 	std::vector<VkDeviceMemory> uniformBuffersMemory;
@@ -89,6 +183,22 @@ private:
 
 	bool framebufferResized = false;
 
+	// The model and the texture are read on worker threads from the start of run(), while the
+	// window and the device are created, and swapped in by the render loop once ready. Until then
+	// a placeholder cube and a white texture are drawn.
+	std::future<LoadedModel> pendingModel;
+	std::future<TextureData> pendingTexture;
+	// What each worker has to say, printed by the render loop when it swaps its result in, so the
+	// workers never write to std::cout while the render thread does
+	std::ostringstream modelLog;
+	std::ostringstream textureLog;
+
+	// Startup timings, the first presented frame and the first one with the real assets are
+	// reported once
+	std::chrono::steady_clock::time_point startTime;
+	bool firstFramePresented = false;
+	bool fullModelPresented = false;
+
 	Vec3 cameraPos = Vec3(0.0f, 0.0f, 3.0f);
 	Vec3 cameraFront = Vec3(0.0f, 0.0f, -1.0f);
 	Vec3 cameraUp = Vec3(0.0f, 1.0f, 0.0f);
@@ -97,8 +207,12 @@ private:
 	//glm::vec3 cameraFront2 = glm::vec3(0.0f, 0.0f, -1.0f);
 	//glm::vec3 cameraUp2 = glm::vec3(0.0f, 1.0f, 0.0f);
 
+	// The camera orbits the origin at the distance where the bounding sphere of the model fills
+	// the view at the starting scale, W / S scale the model from there
+	const float fieldOfView = radians(45.0f);
+	const float startScale = 0.01f;
 	const float scaleFactor = 0.01f;
-	float modelScale = 0.01f;
+	float modelScale = startScale;
 	float deltaTime = 0.0f;
 	float lastFrame = 0.0f;
 	float rollAngle = 0.0f;
@@ -157,21 +271,37 @@ private:
 	void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
 	void createVertexBuffer();
 	void createIndexBuffer();
+	void createIndirectBuffers();
+	void createMaterialBuffer(const std::vector<GpuMaterial> &materials);
+	void cleanupModelBuffers();
 
 	void createDescriptorSetLayout();
 	void createUniformBuffers();
 	void updateUniformBuffer(uint32_t currentImage);
+	float framingDistance() const;
+	void pickAtCursor();
 	void createDescriptorPool();
 	void createDescriptorSets();
+	void writeDescriptorSets();
 
-	void createTextureImage();
+	TextureData loadTexture(std::ostream &log);
+	void createTextureImage(const TextureData &texture);
+	void cleanupTexture();
 	void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout,
 							   VkImageLayout newLayout);
 	void createTextureImageView();
 	void createTextureSampler();
 
-	void loadModel();
-	void computeUVs(Vertex &vertex);
+	void startAssetLoading();
+	void createPlaceholderAssets();
+	void swapInLoadedAssets();
+
+	void loadModel(Mesh &mesh, std::ostream &log);
+	void loadObjModel(Mesh &mesh, std::ostream &log);
+	void loadStreamedModel();
+	void loadMaterials(const Mesh &mesh, std::vector<GpuMaterial> &materials, std::ostream &log);
+	void printSubmeshes(const Mesh &mesh, std::ostream &log);
+	void printLods(const Mesh &mesh, std::ostream &log);
 
 	VkFormat findSupportedFormat(const std::vector<VkFormat> &candidates, VkImageTiling tiling,
 								 VkFormatFeatureFlags features);
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "mesh.hpp"
+
+// Levels of detail: coarser index buffers over the vertices of the full mesh, made by collapsing
+// edges in order of quadric error (Garland and Heckbert, "Surface Simplification Using Quadric
+// Error Metrics"). Like mesh.cpp nothing in here touches Vulkan.
+
+// Coarser levels buildLods makes at most, each with about half the triangles of the one before
+const uint32_t LOD_MAX_LEVELS = 5;
+
+// Appends the levels of detail to mesh.lods and their indices to mesh.indices. A collapse moves a
+// vertex onto one of its neighbours, so no vertex is added. Every vertex keeps the planes of the
+// triangles and border edges of the full mesh it stands for, and the error of a level is the
+// largest distance, in model space, from a vertex that took a collapse to those planes: how far
+// the level moved its vertices off the full surface, across it. Sliding along the surface is not
+// counted. Vertices at a UV seam or shared by two submeshes never move, so the levels of the
+// submeshes fit together whatever level each one is drawn at, and border vertices only slide
+// along the border. Run it after the vertex cache and meshlet passes and before
+// optimizeVertexFetch, which keeps the triangles of every level in blocks of 65536 vertices too.
+// The search for collapses runs on `threads` threads (0 uses every core), the collapses
+// themselves on one: about 350 ms for 200k triangles on one core, so a cold cache of a model of
+// millions of triangles spends seconds here.
+void buildLods(Mesh &mesh, unsigned threads = 0);
+
+// Level to draw submesh i at: the coarsest one whose error, at the point of the submesh bounds
+// closest to the eye, covers at most pixelError pixels of the viewport. clip is proj * view *
+// model; 0 is the full mesh.
+uint32_t selectLod(const Mesh &mesh, size_t submesh, const Mat4 &clip, float viewportWidth,
+				   float viewportHeight, float pixelError);
@@ -1,3 +1,5 @@
+#pragma once
+
 #define GLFW_INCLUDE_VULKAN
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEFAULT_ALIGNED_GENTYPES
@@ -10,6 +12,7 @@
 //#include <glm/gtx/hash.hpp>
 
 #include "glmd.hpp"
+#include "mesh.hpp"
 #include <GLFW/glfw3.h>
 #include <algorithm>
 #include <array>
@@ -46,58 +49,54 @@ struct SwapChainSupportDetails {
 	std::vector<VkPresentModeKHR> presentModes;
 };
 
-struct Vertex {
-	Vec3 pos;
-	Vec3 color;
-	Vec2 texCoord;
-
-	static VkVertexInputBindingDescription getBindingDescription() {
+// How a Vertex, or a CompactVertex when compact is set, is laid out for the vertex input stage of
+// the pipelines. The shader reads floats either way, UNORM attributes arrive in [0, 1].
+struct VertexInput {
+	static VkVertexInputBindingDescription getBindingDescription(bool compact) {
 		VkVertexInputBindingDescription bindingDescription{};
 		bindingDescription.binding = 0;
-		bindingDescription.stride = sizeof(Vertex);
+		bindingDescription.stride = compact ? sizeof(CompactVertex) : sizeof(Vertex);
 		bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
 		return bindingDescription;
 	}
 
-	static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions() {
+	static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions(bool compact) {
 		std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions{};
 		attributeDescriptions[0].binding = 0;
 		attributeDescriptions[0].location = 0;
-		attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-		attributeDescriptions[0].offset = offsetof(Vertex, pos);
+		attributeDescriptions[0].format =
+			compact ? VK_FORMAT_R16G16B16A16_UNORM : VK_FORMAT_R32G32B32_SFLOAT;
+		attributeDescriptions[0].offset =
+			compact ? offsetof(CompactVertex, pos) : offsetof(Vertex, pos);
 
 		attributeDescriptions[1].binding = 0;
 		attributeDescriptions[1].location = 1;
-		attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-		attributeDescriptions[1].offset = offsetof(Vertex, color);
+		attributeDescriptions[1].format = compact ? VK_FORMAT_R16G16_UNORM : VK_FORMAT_R32G32_SFLOAT;
+		attributeDescriptions[1].offset =
+			compact ? offsetof(CompactVertex, texCoord) : offsetof(Vertex, texCoord);
 
 		attributeDescriptions[2].binding = 0;
 		attributeDescriptions[2].location = 2;
-		attributeDescriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
-		attributeDescriptions[2].offset = offsetof(Vertex, texCoord);
+		attributeDescriptions[2].format = compact ? VK_FORMAT_R8G8_SNORM : VK_FORMAT_R32G32B32_SFLOAT;
+		attributeDescriptions[2].offset =
+			compact ? offsetof(CompactVertex, normal) : offsetof(Vertex, normal);
 
 		return attributeDescriptions;
 	}
-
-	bool operator==(const Vertex &other) const {
-		return pos == other.pos && color == other.color && texCoord == other.texCoord;
-	}
 };
 
-namespace std {
-template <> struct hash<Vertex> {
-	size_t operator()(Vertex const &vertex) const {
-		return ((hash<Vec3>()(vertex.pos) ^ (hash<Vec3>()(vertex.color) << 1)) >> 1) ^
-			   (hash<Vec2>()(vertex.texCoord) << 1);
-	}
-};
-} // namespace std
-
 struct UniformBufferObject {
 	alignas(16) Mat4 model;
 	alignas(16) Mat4 view;
 	alignas(16) Mat4 proj;
+	// Four vec4 in the shader, the texture coordinate offset and scale share the third one
+	alignas(16) VertexDecode decode;
+};
+
+// Pushed before every draw, picks the entry of the material storage buffer
+struct DrawConstants {
+	uint32_t material;
 };
 
 //struct UniformBufferObject2 {
@@ -141,6 +140,11 @@ inline void DestroyDebugUtilsMessengerEXT(VkInstance instance,
 		func(instance, debugMessenger, pAllocator);
 }
 
+inline double millisecondsSince(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+		.count();
+}
+
 inline float clamp(float value, float min, float max) {
 	if (value < min)
 		return min;
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include "glmd.hpp"
+
+// Passes over every position of a mesh, in SSE4.1 and AVX2 with a scalar fallback. The instruction
+// set is picked at run time, so the binary needs no -mavx2 and runs on any x86-64 or other CPU.
+// Like mesh.cpp nothing in here touches Vulkan.
+
+enum class KernelIsa { Scalar, Sse41, Avx2 };
+
+// The widest instruction set the CPU supports, detected once
+KernelIsa bestKernelIsa();
+const char *kernelIsaName(KernelIsa isa);
+
+// positions[i] -= offset, on the floats of the array as a flat stream
+void translatePositions(Vec3 *positions, size_t count, const Vec3 &offset,
+						KernelIsa isa = bestKernelIsa());
+
+// Spherical projection around the origin: s = atan2(z, x) / 2pi + 0.5, t = acos(y / |p|) / pi.
+// Blocks of positions are transposed into x / y / z lanes, and atan2 and acos are polynomial
+// approximations within 1e-5 and 7e-5 radians, the same operations in every instruction set so
+// the results do not depend on it. The origin maps to the equator, at s = 0.5.
+void sphericalUVs(const Vec3 *positions, size_t count, Vec2 *texCoords,
+				  KernelIsa isa = bestKernelIsa());
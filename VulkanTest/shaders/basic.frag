@@ -0,0 +1,16 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "material.glsl"
+
+layout(binding = 1) uniform sampler2D texSampler;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+	Material material = materials[draw.material];
+	vec3 albedo = material.diffuse.rgb;
+	if ((material.flags & MATERIAL_TEXTURED) != 0)
+		albedo *= texture(texSampler, fragTexCoord).rgb;
+	outColor = vec4(shade(material, albedo), material.diffuse.a);
+}
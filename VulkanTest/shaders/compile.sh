@@ -1,6 +1,10 @@
-/usr/local/bin/glslc shader.vert -o vert3.spv
-/usr/local/bin/glslc shader.frag -o frag3.spv
+# Same as `make shaders`, glslc resolves the #include of material.glsl
+GLSLC=${GLSLC:-glslc}
+$GLSLC shader.vert -o vert.spv
+$GLSLC basic.frag -o basic.spv
+$GLSLC grey.frag -o grey.spv
+$GLSLC funky.frag -o funky.spv
 
 # spirv-dis vert.spv -o vert.spvasm (disassembler)
-# spirv-dis frag.spv -o frag.spvasm (disassembler)
+# spirv-dis basic.spv -o basic.spvasm (disassembler)
 # vulkan includes libshaderc libraries to compile GLSL code to SPIR-V from within an application
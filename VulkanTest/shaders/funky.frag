@@ -0,0 +1,13 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "material.glsl"
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+	Material material = materials[draw.material];
+	float pulsate = 0.5 + 0.5 * sin(gl_FragCoord.x * 0.824 + gl_FragCoord.y * 0.098 + 2.0 * sin(0.5 * gl_FragCoord.x + 0.5 * gl_FragCoord.y));
+	vec3 color = vec3(pulsate, abs(sin(fragTexCoord.x * 1.5570)), abs(cos(fragTexCoord.y * 0.005)));
+	outColor = vec4(color * material.diffuse.rgb * (0.2 + 0.8 * facing()), material.diffuse.a);
+}
@@ -0,0 +1,19 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "material.glsl"
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+	Material material = materials[draw.material];
+	float grayValue = dot(fragTexCoord, vec2(0.299, 0.587));
+
+	float edgeThreshold = 0.5;
+	float modulatedGray = mod(grayValue * 100.0, 1.0); // Increase frequency to create more bands
+	if (modulatedGray > edgeThreshold)
+		grayValue = modulatedGray;
+	// Stays grey, the material and the light only set how bright
+	grayValue *= dot(material.diffuse.rgb, vec3(0.299, 0.587, 0.114)) * (0.2 + 0.8 * facing());
+	outColor = vec4(vec3(grayValue), material.diffuse.a);
+}
@@ -0,0 +1,37 @@
+// Inputs shared by the fragment shaders: the material table built from the MTL files of the
+// model (GpuMaterial on the C++ side) and the slot of the submesh being drawn
+
+struct Material {
+	vec4 diffuse;  // Kd and d
+	vec4 specular; // Ks and Ns
+	uint flags;
+};
+
+const uint MATERIAL_TEXTURED = 1;
+
+layout(std430, binding = 2) readonly buffer MaterialBuffer {
+	Material materials[];
+};
+
+layout(push_constant) uniform DrawConstants {
+	uint material;
+} draw;
+
+layout(location = 0) in vec2 fragTexCoord;
+layout(location = 1) in vec3 fragViewPos;
+layout(location = 2) in vec3 fragViewNormal;
+
+// Cosine between the normal and the direction to a light at the camera, either side of the
+// surface. Vertices without a normal (streamed models whose OBJ has no vn) get the face normal
+// from the screen-space derivatives of the position, taken outside the branch so they are defined.
+float facing() {
+	vec3 faceNormal = cross(dFdx(fragViewPos), dFdy(fragViewPos));
+	vec3 normal = dot(fragViewNormal, fragViewNormal) > 0.0 ? fragViewNormal : faceNormal;
+	return abs(dot(normalize(normal), normalize(-fragViewPos)));
+}
+
+vec3 shade(Material material, vec3 albedo) {
+	float light = facing();
+	float highlight = material.specular.w > 0.0 ? pow(light, material.specular.w) : 0.0;
+	return albedo * (0.2 + 0.8 * light) + material.specular.rgb * highlight;
+}
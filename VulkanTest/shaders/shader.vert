@@ -4,17 +4,38 @@ layout(binding = 0) uniform UniformBufferObject {
 	mat4 model;
 	mat4 view;
 	mat4 proj;
+	// Dequantization of compact vertices, identity for float ones
+	vec4 positionOffset;
+	vec4 positionScale;
+	vec4 texCoordDecode; // offset in xy, scale in zw
+	vec4 normalDecode;   // x is 1 when inNormal holds the octahedral xy of a compact vertex
 } ubo;
 
 layout(location = 0) in vec3 inPosition;
-layout(location = 1) in vec3 inColor;
-layout(location = 2) in vec2 inTexCoord;
+layout(location = 1) in vec2 inTexCoord;
+layout(location = 2) in vec3 inNormal;
 
-layout(location = 0) out vec3 fragColor;
-layout(location = 1) out vec2 fragTexCoord;
+layout(location = 0) out vec2 fragTexCoord;
+layout(location = 1) out vec3 fragViewPos;
+layout(location = 2) out vec3 fragViewNormal;
+
+// Unfolds the lower half of the octahedron, the inverse of encodeOctahedral in mesh.cpp
+vec3 decodeOctahedral(vec2 encoded) {
+	vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+	float fold = max(-normal.z, 0.0);
+	normal.x += normal.x >= 0.0 ? -fold : fold;
+	normal.y += normal.y >= 0.0 ? -fold : fold;
+	return normal;
+}
 
 void main() {
-	gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
-	fragColor = inColor;
-	fragTexCoord = inTexCoord;
+	vec3 position = ubo.positionOffset.xyz + inPosition * ubo.positionScale.xyz;
+	vec4 viewPos = ubo.view * ubo.model * vec4(position, 1.0);
+	gl_Position = ubo.proj * viewPos;
+	fragTexCoord = ubo.texCoordDecode.xy + inTexCoord * ubo.texCoordDecode.zw;
+	fragViewPos = viewPos.xyz;
+	// The model matrix only rotates and scales evenly, so normals turn like positions. A zero
+	// normal stays zero, the fragment shaders fall back to the face normal.
+	vec3 normal = ubo.normalDecode.x != 0.0 ? decodeOctahedral(inNormal.xy) : inNormal;
+	fragViewNormal = mat3(ubo.view * ubo.model) * normal;
 }
@@ -0,0 +1,107 @@
+#include "scop.hpp"
+
+// The model and the texture are read on worker threads while the window, the device and the
+// pipelines are created. The first frames draw placeholders, and the render loop uploads the real
+// assets between two frames as soon as a worker is done.
+
+void Scop::startAssetLoading() {
+	// A streamed model is uploaded while it is read, so it has to wait for the device
+	if (!options.streamBudget) {
+		pendingModel = std::async(std::launch::async, [this]() {
+			LoadedModel loaded;
+			loadModel(loaded.mesh, modelLog);
+			loadMaterials(loaded.mesh, loaded.materials, modelLog);
+			auto start = std::chrono::steady_clock::now();
+			loaded.bvh = buildBvh(loaded.mesh);
+			modelLog << "BVH: " << loaded.bvh.nodes.size() << " nodes over "
+					 << loaded.bvh.triangles.size() << " triangles in " << millisecondsSince(start)
+					 << " ms" << std::endl;
+			return loaded;
+		});
+	}
+	pendingTexture = std::async(std::launch::async, [this]() { return loadTexture(textureLog); });
+}
+
+// A white texture, and a cube standing in for the model. A streamed model is loaded right here
+// instead, its batches go through the graphics queue before the first frame.
+void Scop::createPlaceholderAssets() {
+	TextureData white{{255, 255, 255, 255}, 1, 1};
+	createTextureImage(white);
+	createTextureImageView();
+
+	std::vector<GpuMaterial> materials;
+	if (options.streamBudget) {
+		modelBvh = Bvh();
+		loadStreamedModel();
+		createIndirectBuffers();
+		loadMaterials(model, materials, std::cout);
+		createMaterialBuffer(materials);
+		return;
+	}
+
+	// One unit wide at the default model scale, vertex i has bit 0 / 1 / 2 set for +x / +y / +z
+	const float size = 50.0f;
+	model = Mesh();
+	for (int i = 0; i < 8; i++) {
+		Vertex vertex{};
+		vertex.pos = Vec3(i & 1 ? size : -size, i & 2 ? size : -size, i & 4 ? size : -size);
+		computeUVs(vertex);
+		model.vertices.push_back(vertex);
+	}
+	model.indices = {0, 4, 6, 0, 6, 2, 1, 3, 7, 1, 7, 5, 0, 1, 5, 0, 5, 4,
+					 2, 6, 7, 2, 7, 3, 0, 2, 3, 0, 3, 1, 4, 5, 7, 4, 7, 6};
+	model.bounds = computeBounds(model.vertices);
+	model.submeshes.push_back(
+		{"placeholder", NO_MATERIAL, 0, static_cast<uint32_t>(model.indices.size()), model.bounds});
+	buildMeshlets(model);
+	modelBvh = buildBvh(model);
+
+	createVertexBuffer();
+	createIndexBuffer();
+	createIndirectBuffers();
+	loadMaterials(model, materials, std::cout);
+	createMaterialBuffer(materials);
+}
+
+void Scop::swapInLoadedAssets() {
+	auto isReady = [](const auto &pending) {
+		return pending.valid() &&
+			   pending.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+	};
+	bool modelReady = isReady(pendingModel);
+	bool textureReady = isReady(pendingTexture);
+	if (!modelReady && !textureReady)
+		return;
+
+	// A ready future is done with its log too. It is printed before get(), which rethrows whatever
+	// made the loading thread fail, so the messages that led there are not lost.
+	auto printLog = [](std::ostringstream &log) {
+		std::cout << log.str() << std::flush;
+		log.str("");
+	};
+	if (modelReady)
+		printLog(modelLog);
+	if (textureReady)
+		printLog(textureLog);
+
+	// The replaced buffers and image may still be read by the frames in flight
+	vkDeviceWaitIdle(device);
+	if (modelReady) {
+		LoadedModel loaded = pendingModel.get();
+		cleanupModelBuffers();
+		model = std::move(loaded.mesh);
+		modelBvh = std::move(loaded.bvh);
+		isolatedSubmesh = -1;
+		createVertexBuffer();
+		createIndexBuffer();
+		createIndirectBuffers();
+		createMaterialBuffer(loaded.materials);
+	}
+	if (textureReady) {
+		TextureData texture = pendingTexture.get();
+		cleanupTexture();
+		createTextureImage(texture);
+		createTextureImageView();
+	}
+	writeDescriptorSets();
+}
@@ -0,0 +1,100 @@
+#include "bounds.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Positions scanned side by side, one running min / max / distance per lane. Eight floats fill an
+// AVX register, and with no dependency from one position to the next the loops vectorize.
+static const size_t LANES = 8;
+
+// Box then sphere of the positions position(0..count)
+template <typename Position> static MeshBounds scanBounds(size_t count, Position position) {
+	MeshBounds bounds;
+	if (count == 0)
+		return bounds;
+
+	const float inf = std::numeric_limits<float>::infinity();
+	float low[3][LANES];
+	float high[3][LANES];
+	for (int axis = 0; axis < 3; axis++) {
+		std::fill(low[axis], low[axis] + LANES, inf);
+		std::fill(high[axis], high[axis] + LANES, -inf);
+	}
+	size_t blocks = count / LANES * LANES;
+	for (size_t i = 0; i < blocks; i += LANES) {
+		float lanes[3][LANES];
+		for (size_t lane = 0; lane < LANES; lane++) {
+			const Vec3 &p = position(i + lane);
+			lanes[0][lane] = p.x;
+			lanes[1][lane] = p.y;
+			lanes[2][lane] = p.z;
+		}
+		for (int axis = 0; axis < 3; axis++) {
+			for (size_t lane = 0; lane < LANES; lane++) {
+				low[axis][lane] = std::min(low[axis][lane], lanes[axis][lane]);
+				high[axis][lane] = std::max(high[axis][lane], lanes[axis][lane]);
+			}
+		}
+	}
+	for (size_t i = blocks; i < count; i++) {
+		for (int axis = 0; axis < 3; axis++) {
+			low[axis][0] = std::min(low[axis][0], position(i)[axis]);
+			high[axis][0] = std::max(high[axis][0], position(i)[axis]);
+		}
+	}
+	for (int axis = 0; axis < 3; axis++) {
+		bounds.min[axis] = *std::min_element(low[axis], low[axis] + LANES);
+		bounds.max[axis] = *std::max_element(high[axis], high[axis] + LANES);
+	}
+
+	bounds.center = (bounds.min + bounds.max) * 0.5f;
+	const Vec3 &c = bounds.center;
+	float farthest[LANES] = {};
+	for (size_t i = 0; i < blocks; i += LANES) {
+		float distances[LANES];
+		for (size_t lane = 0; lane < LANES; lane++) {
+			const Vec3 &p = position(i + lane);
+			float dx = p.x - c.x;
+			float dy = p.y - c.y;
+			float dz = p.z - c.z;
+			distances[lane] = dx * dx + dy * dy + dz * dz;
+		}
+		for (size_t lane = 0; lane < LANES; lane++)
+			farthest[lane] = std::max(farthest[lane], distances[lane]);
+	}
+	for (size_t i = blocks; i < count; i++) {
+		const Vec3 &p = position(i);
+		float dx = p.x - c.x;
+		float dy = p.y - c.y;
+		float dz = p.z - c.z;
+		farthest[0] = std::max(farthest[0], dx * dx + dy * dy + dz * dz);
+	}
+	bounds.radius = std::sqrt(*std::max_element(farthest, farthest + LANES));
+	return bounds;
+}
+
+MeshBounds computeBounds(const Vec3 *positions, size_t count, size_t stride) {
+	const char *base = reinterpret_cast<const char *>(positions);
+	return scanBounds(count, [&](size_t i) -> const Vec3 & {
+		return *reinterpret_cast<const Vec3 *>(base + i * stride);
+	});
+}
+
+MeshBounds computeBounds(const Vec3 *positions, size_t stride, const uint32_t *indices,
+						 size_t count) {
+	const char *base = reinterpret_cast<const char *>(positions);
+	return scanBounds(count, [&](size_t i) -> const Vec3 & {
+		return *reinterpret_cast<const Vec3 *>(base + indices[i] * stride);
+	});
+}
+
+void sphereAroundBox(MeshBounds &bounds) {
+	bounds.center = (bounds.min + bounds.max) * 0.5f;
+	bounds.radius = (bounds.max - bounds.min).length() * 0.5f;
+}
+
+void translateBounds(MeshBounds &bounds, const Vec3 &offset) {
+	bounds.min -= offset;
+	bounds.max -= offset;
+	bounds.center -= offset;
+}
@@ -41,7 +41,15 @@ void Scop::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
 }
 
 void Scop::createIndexBuffer() {
-	VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
+	std::vector<uint16_t> narrow;
+	indexLayout = narrowIndices(model, narrow);
+	const void *indices = model.indices.data();
+	VkDeviceSize bufferSize = sizeof(model.indices[0]) * model.indices.size();
+	if (indexLayout.narrow) {
+		indices = narrow.data();
+		bufferSize = sizeof(narrow[0]) * narrow.size();
+	}
+	indexCount = static_cast<uint32_t>(model.indices.size());
 	VkBuffer stagingBuffer;
 	VkDeviceMemory stagingBufferMemory;
 
@@ -51,7 +59,7 @@ void Scop::createIndexBuffer() {
 
 	void *data;
 	vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, indices.data(), (size_t)bufferSize);
+	memcpy(data, indices, (size_t)bufferSize);
 	vkUnmapMemory(device, stagingBufferMemory);
 
 	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
@@ -64,7 +72,15 @@ void Scop::createIndexBuffer() {
 }
 
 void Scop::createVertexBuffer() {
-	VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
+	std::vector<CompactVertex> compact;
+	const void *vertices = model.vertices.data();
+	VkDeviceSize bufferSize = sizeof(model.vertices[0]) * model.vertices.size();
+	vertexDecode = VertexDecode();
+	if (options.compactVertices) {
+		vertexDecode = quantizeVertices(model.vertices, compact);
+		vertices = compact.data();
+		bufferSize = sizeof(compact[0]) * compact.size();
+	}
 	VkBuffer stagingBuffer;
 	VkDeviceMemory stagingBufferMemory;
 
@@ -74,7 +90,7 @@ void Scop::createVertexBuffer() {
 
 	void *data;
 	vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, vertices.data(), (size_t)bufferSize);
+	memcpy(data, vertices, (size_t)bufferSize);
 	vkUnmapMemory(device, stagingBufferMemory);
 
 	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
@@ -85,6 +101,60 @@ void Scop::createVertexBuffer() {
 	vkFreeMemory(device, stagingBufferMemory, nullptr);
 }
 
+// The material table is uploaded once, every draw only pushes the slot it uses
+void Scop::createMaterialBuffer(const std::vector<GpuMaterial> &materials) {
+	VkDeviceSize bufferSize = sizeof(materials[0]) * materials.size();
+	VkBuffer stagingBuffer;
+	VkDeviceMemory stagingBufferMemory;
+
+	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				 stagingBuffer, stagingBufferMemory);
+
+	void *data;
+	vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
+	memcpy(data, materials.data(), (size_t)bufferSize);
+	vkUnmapMemory(device, stagingBufferMemory);
+
+	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, materialBuffer, materialBufferMemory);
+
+	copyBuffer(stagingBuffer, materialBuffer, bufferSize);
+	vkDestroyBuffer(device, stagingBuffer, nullptr);
+	vkFreeMemory(device, stagingBufferMemory, nullptr);
+}
+
+void Scop::createIndirectBuffers() {
+	size_t capacity = std::max<size_t>(model.meshlets.size() + indexLayout.ranges.size(), 1);
+	VkDeviceSize bufferSize = capacity * sizeof(VkDrawIndexedIndirectCommand);
+	drawCommands.reserve(capacity);
+
+	indirectBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+	indirectBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+	indirectBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		createBuffer(bufferSize, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+					 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+					 indirectBuffers[i], indirectBuffersMemory[i]);
+		vkMapMemory(device, indirectBuffersMemory[i], 0, bufferSize, 0,
+					&indirectBuffersMapped[i]);
+	}
+}
+
+void Scop::cleanupModelBuffers() {
+	for (size_t i = 0; i < indirectBuffers.size(); i++) {
+		vkDestroyBuffer(device, indirectBuffers[i], nullptr);
+		vkFreeMemory(device, indirectBuffersMemory[i], nullptr);
+	}
+	indirectBuffers.clear();
+	vkDestroyBuffer(device, vertexBuffer, nullptr);
+	vkFreeMemory(device, vertexBufferMemory, nullptr);
+	vkDestroyBuffer(device, indexBuffer, nullptr);
+	vkFreeMemory(device, indexBufferMemory, nullptr);
+	vkDestroyBuffer(device, materialBuffer, nullptr);
+	vkFreeMemory(device, materialBufferMemory, nullptr);
+}
+
 void Scop::createFramebuffers() {
 	swapChainFramebuffers.resize(swapChainImageViews.size());
 
@@ -0,0 +1,485 @@
+#include "bvh.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <cmath>
+
+static const int BIN_COUNT = 16;
+// Cost of visiting a node, against 1 for testing a triangle
+static const float TRAVERSAL_COST = 1.0f;
+// Nodes this deep become leaves whatever their size, so a traversal stack of 64 never overflows.
+// Only meshes made to defeat the binning get there.
+static const uint32_t MAX_DEPTH = 60;
+// Ranges of triangles are scanned in chunks of this many, one thread per chunk
+static const size_t CHUNK_SIZE = 16384;
+static const float INF = std::numeric_limits<float>::infinity();
+
+// Axis aligned box. Left uninitialized by default so arrays of them cost nothing to set up.
+struct Box {
+	float min[3];
+	float max[3];
+
+	static Box empty() { return {{INF, INF, INF}, {-INF, -INF, -INF}}; }
+
+	void grow(const Box &other) {
+		for (int axis = 0; axis < 3; axis++) {
+			min[axis] = std::min(min[axis], other.min[axis]);
+			max[axis] = std::max(max[axis], other.max[axis]);
+		}
+	}
+
+	void grow(const float *point) {
+		for (int axis = 0; axis < 3; axis++) {
+			min[axis] = std::min(min[axis], point[axis]);
+			max[axis] = std::max(max[axis], point[axis]);
+		}
+	}
+
+	// Half the surface, 0 when empty
+	float halfArea() const {
+		float x = max[0] - min[0];
+		float y = max[1] - min[1];
+		float z = max[2] - min[2];
+		return x < 0.0f ? 0.0f : x * y + y * z + z * x;
+	}
+};
+
+// A triangle as the build sees it: its box, whose center stands for it when binning, and its
+// number. The build moves these around instead of numbers, so every pass reads them in order.
+struct BuildTriangle {
+	Box box = Box::empty();
+	uint32_t triangle;
+
+	float centroid(int axis) const { return (box.min[axis] + box.max[axis]) * 0.5f; }
+};
+
+// Box of a range of triangles and of their centroids
+struct RangeBounds {
+	Box box = Box::empty();
+	Box centroids = Box::empty();
+};
+
+// Triangles of a range counted and boxed by the slice of the centroid box they fall in, on every
+// axis. Small ranges use fewer slices, no more than they have triangles: the bottom of the tree,
+// where most nodes are, costs as little as possible. Only those are cleared.
+struct Bins {
+	int count;
+	Box boxes[3][BIN_COUNT];
+	uint32_t counts[3][BIN_COUNT];
+
+	explicit Bins(int count = BIN_COUNT) : count(count) {
+		for (int axis = 0; axis < 3; axis++) {
+			std::fill(boxes[axis], boxes[axis] + count, Box::empty());
+			std::fill(counts[axis], counts[axis] + count, 0u);
+		}
+	}
+};
+
+// Node left to build over triangles [begin, end), at depth in the whole tree
+struct BuildTask {
+	uint32_t node;
+	uint32_t begin;
+	uint32_t end;
+	uint32_t depth;
+	RangeBounds bounds;
+};
+
+class BvhBuilder {
+public:
+	explicit BvhBuilder(std::vector<BuildTriangle> &triangles) : triangles(triangles) {}
+
+	// Bounds of the whole range of a root task
+	RangeBounds rangeBounds(uint32_t begin, uint32_t end, unsigned threads) const {
+		return reduce(
+			begin, end, threads, RangeBounds(),
+			[&](size_t first, size_t last, RangeBounds &bounds) {
+				for (size_t i = first; i < last; i++) {
+					const BuildTriangle &triangle = triangles[i];
+					const float centroid[3] = {triangle.centroid(0), triangle.centroid(1),
+											   triangle.centroid(2)};
+					bounds.box.grow(triangle.box);
+					bounds.centroids.grow(centroid);
+				}
+			},
+			[](RangeBounds &into, const RangeBounds &from) {
+				into.box.grow(from.box);
+				into.centroids.grow(from.centroids);
+			});
+	}
+
+	// Builds the subtree of task, whose node already exists, into nodes. With deferred, the
+	// subtrees of at most deferCount triangles are only given their node and left in it.
+	void build(const BuildTask &root, std::vector<BvhNode> &nodes, unsigned threads,
+			   std::vector<BuildTask> *deferred = nullptr, size_t deferCount = 0) const {
+		std::vector<BuildTask> stack{root};
+		while (!stack.empty()) {
+			BuildTask task = stack.back();
+			stack.pop_back();
+			if (deferred && task.end - task.begin <= deferCount) {
+				deferred->push_back(task);
+				continue;
+			}
+
+			const Box &box = task.bounds.box;
+			BvhNode &node = nodes[task.node];
+			node.min = Vec3(box.min[0], box.min[1], box.min[2]);
+			node.max = Vec3(box.max[0], box.max[1], box.max[2]);
+			BuildTask left;
+			BuildTask right;
+			if (!split(task, threads, left, right)) {
+				node.first = task.begin;
+				node.count = task.end - task.begin;
+				continue;
+			}
+			uint32_t child = static_cast<uint32_t>(nodes.size());
+			node.first = child;
+			node.count = 0;
+			nodes.resize(nodes.size() + 2);
+			left.node = child;
+			right.node = child + 1;
+			// The left subtree is built first, right after the pair
+			stack.push_back(right);
+			stack.push_back(left);
+		}
+	}
+
+private:
+	std::vector<BuildTriangle> &triangles;
+
+	// Runs scan(first, last, result) over chunks of [begin, end) on up to `threads` threads, each
+	// into its own `empty` result, then merges the results of the chunks with merge(into, from)
+	template <typename Result, typename Scan, typename Merge>
+	Result reduce(uint32_t begin, uint32_t end, unsigned threads, const Result &empty, Scan scan,
+				  Merge merge) const {
+		size_t count = end - begin;
+		if (threads == 1 || count <= 2 * CHUNK_SIZE) {
+			Result result = empty;
+			scan(begin, end, result);
+			return result;
+		}
+		std::vector<Result> results((count + CHUNK_SIZE - 1) / CHUNK_SIZE, empty);
+		parallelFor(
+			results.size(),
+			[&](size_t chunk) {
+				size_t first = begin + chunk * CHUNK_SIZE;
+				scan(first, std::min<size_t>(end, first + CHUNK_SIZE), results[chunk]);
+			},
+			threads);
+		for (size_t chunk = 1; chunk < results.size(); chunk++)
+			merge(results[0], results[chunk]);
+		return results[0];
+	}
+
+	// Slice of the centroid box a centroid falls in, along one axis
+	static int binOf(float centroid, float low, float scale, int binCount) {
+		return std::min(static_cast<int>((centroid - low) * scale), binCount - 1);
+	}
+
+	// Splits the triangles of task at the best plane, the ones left of it moved first, and
+	// fills the tasks of both sides but their node. False when the node is better off a leaf.
+	bool split(const BuildTask &task, unsigned threads, BuildTask &left, BuildTask &right) const {
+		uint32_t count = task.end - task.begin;
+		if (count == 1 || task.depth >= MAX_DEPTH)
+			return false;
+
+		int binCount = static_cast<int>(std::min<uint32_t>(count, BIN_COUNT));
+		float low[3];
+		float scale[3];
+		for (int axis = 0; axis < 3; axis++) {
+			low[axis] = task.bounds.centroids.min[axis];
+			float extent = task.bounds.centroids.max[axis] - low[axis];
+			scale[axis] = extent > 0.0f ? binCount / extent : 0.0f;
+		}
+		Bins bins = reduce(
+			task.begin, task.end, threads, Bins(binCount),
+			[&](size_t first, size_t last, Bins &bins) {
+				for (size_t i = first; i < last; i++) {
+					const BuildTriangle &triangle = triangles[i];
+					for (int axis = 0; axis < 3; axis++) {
+						int bin = binOf(triangle.centroid(axis), low[axis], scale[axis], binCount);
+						bins.boxes[axis][bin].grow(triangle.box);
+						bins.counts[axis][bin]++;
+					}
+				}
+			},
+			[](Bins &into, const Bins &from) {
+				for (int axis = 0; axis < 3; axis++) {
+					for (int bin = 0; bin < into.count; bin++) {
+						into.boxes[axis][bin].grow(from.boxes[axis][bin]);
+						into.counts[axis][bin] += from.counts[axis][bin];
+					}
+				}
+			});
+
+		// Cost of the planes after every bin but the last: the triangles on each side times the
+		// area of their box, swept from both ends
+		float bestCost = INF;
+		int bestAxis = -1;
+		int bestBin = 0;
+		for (int axis = 0; axis < 3; axis++) {
+			if (scale[axis] == 0.0f)
+				continue;
+			float rightCost[BIN_COUNT];
+			Box rightBox = Box::empty();
+			uint32_t rightCount = 0;
+			for (int bin = binCount - 1; bin > 0; bin--) {
+				rightBox.grow(bins.boxes[axis][bin]);
+				rightCount += bins.counts[axis][bin];
+				rightCost[bin] = rightCount * rightBox.halfArea();
+			}
+			Box leftBox = Box::empty();
+			uint32_t leftCount = 0;
+			for (int bin = 0; bin < binCount - 1; bin++) {
+				leftBox.grow(bins.boxes[axis][bin]);
+				leftCount += bins.counts[axis][bin];
+				float cost = leftCount * leftBox.halfArea() + rightCost[bin + 1];
+				if (leftCount > 0 && leftCount < count && cost < bestCost) {
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = bin;
+				}
+			}
+		}
+		// Every centroid in one point: nothing tells the triangles apart
+		if (bestAxis < 0)
+			return false;
+		float area = task.bounds.box.halfArea();
+		if (count <= BVH_MAX_LEAF_TRIANGLES && TRAVERSAL_COST * area + bestCost >= count * area)
+			return false;
+
+		// The boxes of both sides are the ones of their bins, their centroid boxes are grown
+		// while partitioning, which tests every triangle exactly once
+		left = {0, task.begin, 0, task.depth + 1, {}};
+		right = {0, 0, task.end, task.depth + 1, {}};
+		for (int bin = 0; bin < binCount; bin++) {
+			BuildTask &side = bin <= bestBin ? left : right;
+			side.bounds.box.grow(bins.boxes[bestAxis][bin]);
+		}
+		auto middle = std::partition(
+			triangles.begin() + task.begin, triangles.begin() + task.end,
+			[&](const BuildTriangle &triangle) {
+				const float centroid[3] = {triangle.centroid(0), triangle.centroid(1),
+										   triangle.centroid(2)};
+				bool isLeft =
+					binOf(centroid[bestAxis], low[bestAxis], scale[bestAxis], binCount) <= bestBin;
+				(isLeft ? left : right).bounds.centroids.grow(centroid);
+				return isLeft;
+			});
+		left.end = right.begin = static_cast<uint32_t>(middle - triangles.begin());
+		return true;
+	}
+};
+
+Bvh buildBvh(const Mesh &mesh, unsigned threads) {
+	Bvh bvh;
+	const size_t triangleCount = fullIndexCount(mesh) / 3;
+	if (triangleCount == 0)
+		return bvh;
+
+	std::vector<BuildTriangle> triangles(triangleCount);
+	parallelFor(
+		(triangleCount + CHUNK_SIZE - 1) / CHUNK_SIZE,
+		[&](size_t chunk) {
+			size_t end = std::min(triangleCount, (chunk + 1) * CHUNK_SIZE);
+			for (size_t t = chunk * CHUNK_SIZE; t < end; t++) {
+				BuildTriangle &triangle = triangles[t];
+				for (int corner = 0; corner < 3; corner++) {
+					const Vec3 &p = mesh.vertices[mesh.indices[t * 3 + corner]].pos;
+					const float point[3] = {p.x, p.y, p.z};
+					triangle.box.grow(point);
+				}
+				triangle.triangle = static_cast<uint32_t>(t);
+			}
+		},
+		threads);
+	BvhBuilder builder(triangles);
+
+	// The top of the tree is split with every thread binning each node, down to subtrees of about
+	// an eighth of a thread's share. Those are then built one per thread into their own node
+	// arrays and appended, each after the others.
+	size_t workers = threads ? threads : workerCount();
+	uint32_t end = static_cast<uint32_t>(triangleCount);
+	BuildTask root{0, 0, end, 0, builder.rangeBounds(0, end, threads)};
+	bvh.nodes.resize(1);
+	if (workers <= 1) {
+		builder.build(root, bvh.nodes, 1);
+	} else {
+		std::vector<BuildTask> deferred;
+		size_t deferCount = std::max<size_t>(triangleCount / (workers * 8), CHUNK_SIZE);
+		builder.build(root, bvh.nodes, threads, &deferred, deferCount);
+
+		std::vector<std::vector<BvhNode>> subtrees(deferred.size());
+		parallelFor(
+			deferred.size(),
+			[&](size_t i) {
+				subtrees[i].resize(1);
+				BuildTask task = deferred[i];
+				task.node = 0;
+				builder.build(task, subtrees[i], 1);
+			},
+			threads);
+		for (size_t i = 0; i < deferred.size(); i++) {
+			// Node k > 0 of the subtree lands at base + k, its root replaces the node left for it
+			std::vector<BvhNode> &subtree = subtrees[i];
+			uint32_t base = static_cast<uint32_t>(bvh.nodes.size()) - 1;
+			for (BvhNode &node : subtree) {
+				if (node.count == 0)
+					node.first += base;
+			}
+			bvh.nodes[deferred[i].node] = subtree[0];
+			bvh.nodes.insert(bvh.nodes.end(), subtree.begin() + 1, subtree.end());
+			std::vector<BvhNode>().swap(subtree);
+		}
+	}
+
+	bvh.triangles.resize(triangleCount);
+	for (size_t i = 0; i < triangleCount; i++)
+		bvh.triangles[i] = triangles[i].triangle;
+	return bvh;
+}
+
+// Distance at which the ray enters the box of node, when it does before maxDistance
+static bool intersectBox(const BvhNode &node, const float *origin, const float *inverse,
+						 float maxDistance, float &entry) {
+	const float low[3] = {node.min.x, node.min.y, node.min.z};
+	const float high[3] = {node.max.x, node.max.y, node.max.z};
+	float near = 0.0f;
+	float far = maxDistance;
+	for (int axis = 0; axis < 3; axis++) {
+		// A ray parallel to a face and starting on it gives NaN, which min and max skip
+		float t0 = (low[axis] - origin[axis]) * inverse[axis];
+		float t1 = (high[axis] - origin[axis]) * inverse[axis];
+		near = std::max(near, std::min(t0, t1));
+		far = std::min(far, std::max(t0, t1));
+	}
+	entry = near;
+	return near <= far;
+}
+
+// Moller-Trumbore, from both sides. Keeps the hit when it is nearer than hit.
+static bool intersectTriangle(const Mesh &mesh, uint32_t triangle, const float *origin,
+							  const float *direction, RayHit &hit) {
+	const Vec3 &a = mesh.vertices[mesh.indices[triangle * 3]].pos;
+	const Vec3 &b = mesh.vertices[mesh.indices[triangle * 3 + 1]].pos;
+	const Vec3 &c = mesh.vertices[mesh.indices[triangle * 3 + 2]].pos;
+	const float ab[3] = {b.x - a.x, b.y - a.y, b.z - a.z};
+	const float ac[3] = {c.x - a.x, c.y - a.y, c.z - a.z};
+	auto cross = [](const float *u, const float *v, float *out) {
+		out[0] = u[1] * v[2] - u[2] * v[1];
+		out[1] = u[2] * v[0] - u[0] * v[2];
+		out[2] = u[0] * v[1] - u[1] * v[0];
+	};
+	auto dot = [](const float *u, const float *v) { return u[0] * v[0] + u[1] * v[1] + u[2] * v[2]; };
+
+	float p[3];
+	cross(direction, ac, p);
+	float determinant = dot(ab, p);
+	if (determinant == 0.0f)
+		return false;
+	float inverse = 1.0f / determinant;
+	const float s[3] = {origin[0] - a.x, origin[1] - a.y, origin[2] - a.z};
+	float u = dot(s, p) * inverse;
+	if (u < 0.0f || u > 1.0f)
+		return false;
+	float q[3];
+	cross(s, ab, q);
+	float v = dot(direction, q) * inverse;
+	if (v < 0.0f || u + v > 1.0f)
+		return false;
+	float distance = dot(ac, q) * inverse;
+	if (distance < 0.0f || distance >= hit.distance)
+		return false;
+	hit = {triangle, distance, u, v};
+	return true;
+}
+
+bool intersectBvh(const Bvh &bvh, const Mesh &mesh, const Vec3 &origin, const Vec3 &direction,
+				  RayHit &hit) {
+	const float o[3] = {origin.x, origin.y, origin.z};
+	const float d[3] = {direction.x, direction.y, direction.z};
+	// 1 / 0 is infinite, and the slabs of that axis then hold the whole ray or none of it
+	const float inverse[3] = {1.0f / d[0], 1.0f / d[1], 1.0f / d[2]};
+	float entry;
+	if (bvh.nodes.empty() || !intersectBox(bvh.nodes[0], o, inverse, hit.distance, entry))
+		return false;
+
+	// The nearer child is visited first and the other one pushed with its entry distance, so it is
+	// skipped if a hit closer than that turns up meanwhile
+	struct Pending {
+		uint32_t node;
+		float entry;
+	} stack[64];
+	int size = 0;
+	uint32_t current = 0;
+	bool found = false;
+	while (true) {
+		const BvhNode &node = bvh.nodes[current];
+		if (node.count == 0) {
+			uint32_t near = node.first;
+			uint32_t far = node.first + 1;
+			float nearEntry;
+			float farEntry;
+			bool hitNear = intersectBox(bvh.nodes[near], o, inverse, hit.distance, nearEntry);
+			bool hitFar = intersectBox(bvh.nodes[far], o, inverse, hit.distance, farEntry);
+			if (hitNear && hitFar) {
+				if (farEntry < nearEntry) {
+					std::swap(near, far);
+					std::swap(nearEntry, farEntry);
+				}
+				stack[size++] = {far, farEntry};
+				current = near;
+				continue;
+			}
+			if (hitNear || hitFar) {
+				current = hitNear ? near : far;
+				continue;
+			}
+		} else {
+			for (uint32_t i = node.first; i < node.first + node.count; i++)
+				found |= intersectTriangle(mesh, bvh.triangles[i], o, d, hit);
+		}
+
+		while (size > 0 && stack[size - 1].entry > hit.distance)
+			size--;
+		if (size == 0)
+			return found;
+		current = stack[--size].node;
+	}
+}
+
+bool intersectTriangles(const Mesh &mesh, const Vec3 &origin, const Vec3 &direction, RayHit &hit) {
+	const float o[3] = {origin.x, origin.y, origin.z};
+	const float d[3] = {direction.x, direction.y, direction.z};
+	uint32_t triangleCount = static_cast<uint32_t>(fullIndexCount(mesh) / 3);
+	bool found = false;
+	for (uint32_t t = 0; t < triangleCount; t++)
+		found |= intersectTriangle(mesh, t, o, d, hit);
+	return found;
+}
+
+size_t submeshOfTriangle(const Mesh &mesh, uint32_t triangle) {
+	size_t index = static_cast<size_t>(triangle) * 3;
+	for (size_t i = 0; i < mesh.submeshes.size(); i++) {
+		const Submesh &submesh = mesh.submeshes[i];
+		if (index >= submesh.indexOffset && index < submesh.indexOffset + submesh.indexCount)
+			return i;
+	}
+	return SIZE_MAX;
+}
+
+float bvhCost(const Bvh &bvh) {
+	if (bvh.nodes.empty())
+		return 0.0f;
+	auto halfArea = [](const BvhNode &node) {
+		float x = node.max.x - node.min.x;
+		float y = node.max.y - node.min.y;
+		float z = node.max.z - node.min.z;
+		return x * y + y * z + z * x;
+	};
+	float rootArea = halfArea(bvh.nodes[0]);
+	if (rootArea <= 0.0f)
+		return static_cast<float>(bvh.triangles.size());
+	double cost = 0.0;
+	for (const BvhNode &node : bvh.nodes)
+		cost += halfArea(node) * (node.count ? node.count : TRAVERSAL_COST);
+	return static_cast<float>(cost / rootArea);
+}
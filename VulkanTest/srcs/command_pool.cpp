@@ -57,7 +57,8 @@ void Scop::recordCommandBuffer(VkCommandBuffer commandBuffer,
 	VkBuffer vertexBuffers[] = {vertexBuffer};
 	VkDeviceSize offsets[] = {0};
 	vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-	vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+	vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0,
+						 indexLayout.narrow ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32);
 	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1,
 							&descriptorSets[currentFrame], 0, nullptr);
 
@@ -74,7 +75,66 @@ void Scop::recordCommandBuffer(VkCommandBuffer commandBuffer,
 	scissor.offset = {0, 0};
 	scissor.extent = swapChainExtent;
 	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
-	vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+
+	// The visible meshlets of the visible submeshes, or their level of detail when the camera is
+	// far enough, cut along the index ranges. Pieces that are neighbours in the index buffer and
+	// share a material and a vertex offset become one indirect command, and the commands of a run
+	// of one material go out in one vkCmdDrawIndexedIndirect (in batches of maxIndirectDraws). The
+	// material slot is pushed once per run.
+	MeshletCuller culler(clipTransform);
+	drawCommands.clear();
+	size_t firstCommand = 0;
+	DrawConstants range{UINT32_MAX};
+	auto drawCommandRun = [&]() {
+		if (drawCommands.size() == firstCommand)
+			return;
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+						   sizeof(range), &range);
+		for (size_t first = firstCommand; first < drawCommands.size(); first += maxIndirectDraws) {
+			uint32_t count = static_cast<uint32_t>(
+				std::min<size_t>(maxIndirectDraws, drawCommands.size() - first));
+			vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffers[currentFrame],
+									 first * sizeof(VkDrawIndexedIndirectCommand), count,
+									 sizeof(VkDrawIndexedIndirectCommand));
+		}
+		firstCommand = drawCommands.size();
+	};
+	// Nothing is drawn when the sphere of the whole model is off-screen. A submesh is skipped
+	// when its sphere or its box is.
+	bool modelVisible = culler.isVisible(model.bounds);
+	for (size_t i = 0; modelVisible && i < model.submeshes.size(); i++) {
+		const Submesh &submesh = model.submeshes[i];
+		if ((isolatedSubmesh >= 0 && i != static_cast<size_t>(isolatedSubmesh)) ||
+			!culler.isVisible(submesh.bounds) || isOutsideFrustum(submesh.bounds, clipTransform))
+			continue;
+		uint32_t material = materialSlot(model, submesh);
+		if (material != range.material) {
+			drawCommandRun();
+			range.material = material;
+		}
+		uint32_t level = levelOfDetail ? selectLod(model, i, clipTransform, viewport.width,
+												   viewport.height, options.lodError)
+									   : 0;
+		visibleRanges.clear();
+		appendVisibleRanges(model, indexLayout, i, level, meshletCulling ? &culler : nullptr,
+							visibleRanges);
+		for (const IndexRange &next : visibleRanges) {
+			int32_t vertexOffset = static_cast<int32_t>(next.vertexOffset);
+			if (drawCommands.size() > firstCommand) {
+				VkDrawIndexedIndirectCommand &last = drawCommands.back();
+				if (last.firstIndex + last.indexCount == next.indexOffset &&
+					last.vertexOffset == vertexOffset) {
+					last.indexCount += next.indexCount;
+					continue;
+				}
+			}
+			drawCommands.push_back({next.indexCount, 1, next.indexOffset, vertexOffset, 0});
+		}
+	}
+	drawCommandRun();
+	// Read when the command buffer runs, the fence of this frame says the last one is done
+	memcpy(indirectBuffersMapped[currentFrame], drawCommands.data(),
+		   drawCommands.size() * sizeof(VkDrawIndexedIndirectCommand));
 	vkCmdEndRenderPass(commandBuffer);
 	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
 		throw std::runtime_error("failed to record command buffer!");
@@ -85,6 +85,15 @@ void Scop::createLogicalDevice() {
 
 	VkPhysicalDeviceFeatures deviceFeatures{};
 	deviceFeatures.samplerAnisotropy = VK_TRUE;
+	// Several indirect draws per vkCmdDrawIndexedIndirect when the device has it, one otherwise
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+	if (supportedFeatures.multiDrawIndirect) {
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		deviceFeatures.multiDrawIndirect = VK_TRUE;
+		maxIndirectDraws = properties.limits.maxDrawIndirectCount;
+	}
 	VkDeviceCreateInfo createInfo{};
 	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 
@@ -1,17 +1,104 @@
 #include "scop.hpp"
 
+// Parses the N of --stream=N, a budget in MiB
+static bool parseStreamBudget(const std::string &value, size_t &budget) {
+	if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos ||
+		value.size() > 9)
+		return false;
+	budget = std::stoul(value) << 20;
+	return budget != 0;
+}
+
+// Parses the ratio of --overdraw=R, at least 1
+static bool parseOverdrawThreshold(const std::string &value, float &threshold) {
+	char *end;
+	threshold = strtof(value.c_str(), &end);
+	return !value.empty() && *end == '\0' && threshold >= 1.0f;
+}
+
+// Parses the degrees of --crease=D, 0 to 180
+static bool parseCreaseAngle(const std::string &value, float &degrees) {
+	char *end;
+	degrees = strtof(value.c_str(), &end);
+	return !value.empty() && *end == '\0' && degrees >= 0.0f && degrees <= 180.0f;
+}
+
+// Parses the pixels of --lod-error=P, 0 or more
+static bool parseLodError(const std::string &value, float &pixels) {
+	char *end;
+	pixels = strtof(value.c_str(), &end);
+	return !value.empty() && *end == '\0' && pixels >= 0.0f;
+}
+
+// Parses the fraction of --weld-epsilon=E, 0 to 1
+static bool parseWeldEpsilon(const std::string &value, float &epsilon) {
+	char *end;
+	epsilon = strtof(value.c_str(), &end);
+	return !value.empty() && *end == '\0' && epsilon >= 0.0f && epsilon <= 1.0f;
+}
+
+// Parses the method of --weld=auto|hash|sort
+static bool parseWeld(const std::string &value, ObjWeld &weld) {
+	if (value == "auto")
+		weld = ObjWeld::Auto;
+	else if (value == "hash")
+		weld = ObjWeld::Hash;
+	else if (value == "sort")
+		weld = ObjWeld::Sort;
+	else
+		return false;
+	return true;
+}
+
 int main(int argc, char **argv) {
 	//compareMatrices();
-	if (argc != 3) {
-		std::cerr << "Usage: " << argv[0] << " <model> <texture>" << std::endl;
+	ScopOptions options;
+	std::vector<std::string> args;
+	bool validArgs = true;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--no-cache")
+			options.useMeshCache = false;
+		else if (arg == "--compact-vertices")
+			options.compactVertices = true;
+		else if (arg == "--generate-normals")
+			options.generateNormals = true;
+		else if (arg.rfind("--stream=", 0) == 0)
+			validArgs &= parseStreamBudget(arg.substr(9), options.streamBudget);
+		else if (arg.rfind("--weld=", 0) == 0)
+			validArgs &= parseWeld(arg.substr(7), options.weld);
+		else if (arg.rfind("--weld-epsilon=", 0) == 0)
+			validArgs &= parseWeldEpsilon(arg.substr(15), options.weldEpsilon);
+		else if (arg.rfind("--overdraw=", 0) == 0)
+			validArgs &= parseOverdrawThreshold(arg.substr(11), options.overdrawThreshold);
+		else if (arg.rfind("--crease=", 0) == 0)
+			validArgs &= parseCreaseAngle(arg.substr(9), options.creaseAngle);
+		else if (arg.rfind("--lod-error=", 0) == 0)
+			validArgs &= parseLodError(arg.substr(12), options.lodError);
+		else if (arg.rfind("--", 0) == 0)
+			validArgs = false;
+		else
+			args.push_back(arg);
+	}
+
+	if (!validArgs || args.size() != 2) {
+		std::cerr << "Usage: " << argv[0] << " [--no-cache] [--stream=<MiB>] [--weld=auto|hash|sort]"
+				  << " [--weld-epsilon=<ratio>] [--overdraw=<ratio>] [--crease=<degrees>]"
+				  << " [--generate-normals]"
+				  << " [--lod-error=<pixels>] [--compact-vertices] <model> <texture>" << std::endl;
 		return EXIT_FAILURE;
 	}
+	if (options.compactVertices && options.streamBudget) {
+		std::cerr << "--compact-vertices is ignored with --stream" << std::endl;
+		options.compactVertices = false;
+	}
 
-	const std::string MODEL_PATH = "models/" + std::string(argv[1]);
-	const std::string TEXTURE_PATH = "textures/" + std::string(argv[2]);
+	const std::string MODEL_PATH = "models/" + args[0];
+	const std::string TEXTURE_PATH = "textures/" + args[1];
 
 	try {
-		Scop app(MODEL_PATH.c_str(), TEXTURE_PATH.c_str());
+		Scop app(MODEL_PATH.c_str(), TEXTURE_PATH.c_str(), options);
 		app.run();
 	} catch (const std::exception &e) {
 		std::cerr << e.what() << std::endl;
@@ -0,0 +1,265 @@
+#include "mesh.hpp"
+#include "flat_id_map.hpp"
+#include "mtlloader.hpp"
+#include "vertex_kernels.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+void computeUVs(Vertex &vertex) {
+	sphericalUVs(&vertex.pos, 1, &vertex.texCoord);
+}
+
+void buildMesh(ObjMesh &objMesh, Mesh &mesh) {
+	std::vector<Vertex> &vertices = mesh.vertices;
+	std::vector<uint32_t> &indices = mesh.indices;
+
+	// Center on the box of the positions. Every welded corner is used by a face, and unlike the
+	// mean of the corners the center does not drift toward the densely tessellated parts.
+	Vec3 center = computeBounds(objMesh.positions.data(), objMesh.positions.size()).center;
+	translatePositions(objMesh.positions.data(), objMesh.positions.size(), center);
+
+	// The spherical projection runs over all the positions at once, not vertex by vertex in the
+	// dedup loop. The BMP rows are uploaded bottom-up, which already matches the OBJ v axis.
+	if (objMesh.texCoords.empty()) {
+		objMesh.texCoords.resize(objMesh.positions.size());
+		sphericalUVs(objMesh.positions.data(), objMesh.positions.size(),
+					 objMesh.texCoords.data());
+	}
+
+	// Load vertices. The loader already welded the corners on their (v, vt, vn) indices, the table
+	// only merges the vertices that end up equal anyway, like positions written twice in the file.
+	// The normal is part of the value, so corners the file gives different normals stay apart.
+	// There are at most as many of them as welded corners, so it never grows.
+	FlatIdMap<Vertex, VertexHash> uniqueVertices(objMesh.positions.size());
+	std::vector<uint32_t> remap(objMesh.positions.size());
+	vertices.reserve(objMesh.positions.size());
+
+	for (size_t i = 0; i < objMesh.positions.size(); i++) {
+		Vertex vertex{};
+
+		vertex.pos = objMesh.positions[i];
+		vertex.texCoord = objMesh.texCoords[i];
+		if (!objMesh.normals.empty())
+			vertex.normal = objMesh.normals[i];
+		bool isNew;
+		remap[i] = uniqueVertices.insert(vertex, static_cast<uint32_t>(vertices.size()), isNew);
+		if (isNew) {
+			vertices.push_back(vertex);
+		}
+	}
+
+	indices.reserve(objMesh.indices.size());
+	for (uint32_t index : objMesh.indices) {
+		indices.push_back(remap[index]);
+	}
+
+	// Merging vertices leaves every index where it was, so the submesh ranges still hold
+	mesh.submeshes = std::move(objMesh.submeshes);
+	for (auto &submesh : mesh.submeshes) {
+		submesh.bounds = computeBounds(&vertices[0].pos, sizeof(Vertex),
+									   &indices[submesh.indexOffset], submesh.indexCount);
+	}
+	mesh.materials = std::move(objMesh.materials);
+	mesh.materialLibraries = std::move(objMesh.materialLibraries);
+	mesh.bounds = computeBounds(vertices);
+}
+
+size_t buildMaterialTable(const Mesh &mesh, const std::string &modelPath,
+						  std::vector<GpuMaterial> &table, std::ostream &log) {
+	std::vector<MtlMaterial> definitions;
+	size_t slash = modelPath.find_last_of('/');
+	std::string directory = slash == std::string::npos ? "" : modelPath.substr(0, slash + 1);
+	for (const auto &library : mesh.materialLibraries) {
+		// loadMtl reports missing libraries and the lines it could not read
+		loadMtl((directory + library).c_str(), definitions, log);
+	}
+
+	GpuMaterial fallback = {{1.0f, 1.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 0.0f}, MATERIAL_TEXTURED, {}};
+	table.assign(mesh.materials.size() + 1, fallback);
+
+	size_t found = 0;
+	for (size_t i = 0; i < mesh.materials.size(); i++) {
+		// The first definition of a name wins, like in most viewers
+		auto definition = std::find_if(
+			definitions.begin(), definitions.end(),
+			[&](const MtlMaterial &material) { return material.name == mesh.materials[i]; });
+		if (definition == definitions.end())
+			continue;
+		GpuMaterial &entry = table[i];
+		for (int c = 0; c < 3; c++) {
+			entry.diffuse[c] = definition->diffuse[c];
+			entry.specular[c] = definition->specular[c];
+		}
+		entry.diffuse[3] = definition->dissolve;
+		entry.specular[3] = definition->shininess;
+		entry.flags = definition->diffuseMap.empty() ? 0 : MATERIAL_TEXTURED;
+		found++;
+	}
+	return found;
+}
+
+// Index runs of the submeshes, full mesh first and then every level of detail, in the order of
+// IndexLayout::firstRange
+static std::vector<IndexRange> submeshRuns(const Mesh &mesh) {
+	std::vector<IndexRange> runs;
+	for (const Submesh &submesh : mesh.submeshes)
+		runs.push_back({submesh.indexOffset, submesh.indexCount, 0});
+	for (const MeshLod &lod : mesh.lods) {
+		for (size_t i = 0; i + 1 < lod.firstIndex.size(); i++)
+			runs.push_back({lod.firstIndex[i], lod.firstIndex[i + 1] - lod.firstIndex[i], 0});
+	}
+	return runs;
+}
+
+IndexLayout wideIndexLayout(const Mesh &mesh) {
+	IndexLayout layout;
+	layout.ranges = submeshRuns(mesh);
+	for (size_t i = 0; i <= layout.ranges.size(); i++)
+		layout.firstRange.push_back(static_cast<uint32_t>(i));
+	return layout;
+}
+
+IndexLayout narrowIndices(const Mesh &mesh, std::vector<uint16_t> &narrow) {
+	const uint32_t maxSpan = 65535;
+	IndexLayout layout;
+	layout.narrow = true;
+
+	for (const IndexRange &run : submeshRuns(mesh)) {
+		layout.firstRange.push_back(static_cast<uint32_t>(layout.ranges.size()));
+		uint32_t end = run.indexOffset + run.indexCount;
+		uint32_t start = run.indexOffset;
+		while (start < end) {
+			// Grow the range one triangle at a time while it fits in 16 bits
+			uint32_t min = UINT32_MAX;
+			uint32_t max = 0;
+			uint32_t next = start;
+			while (next < end) {
+				uint32_t triangleEnd = std::min(next + 3, end);
+				uint32_t triangleMin = min;
+				uint32_t triangleMax = max;
+				for (uint32_t i = next; i < triangleEnd; i++) {
+					triangleMin = std::min(triangleMin, mesh.indices[i]);
+					triangleMax = std::max(triangleMax, mesh.indices[i]);
+				}
+				if (triangleMax - triangleMin > maxSpan)
+					break;
+				min = triangleMin;
+				max = triangleMax;
+				next = triangleEnd;
+			}
+			if (next == start) {
+				narrow.clear();
+				return wideIndexLayout(mesh);
+			}
+			layout.ranges.push_back({start, next - start, min});
+			start = next;
+		}
+	}
+	layout.firstRange.push_back(static_cast<uint32_t>(layout.ranges.size()));
+
+	narrow.resize(mesh.indices.size());
+	for (const IndexRange &range : layout.ranges) {
+		for (uint32_t i = range.indexOffset; i < range.indexOffset + range.indexCount; i++)
+			narrow[i] = static_cast<uint16_t>(mesh.indices[i] - range.vertexOffset);
+	}
+	return layout;
+}
+
+// Octahedral encoding (Cigolle et al., "A Survey of Efficient Representations for Independent Unit
+// Vectors"): the normal projected on the octahedron |x| + |y| + |z| = 1, its lower half folded
+// over the upper one, leaves x and y to store
+static void encodeOctahedral(const Vec3 &normal, int8_t encoded[2]) {
+	float sum = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+	float x = sum > 0.0f ? normal.x / sum : 0.0f;
+	float y = sum > 0.0f ? normal.y / sum : 0.0f;
+	if (normal.z < 0.0f) {
+		float folded = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		y = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = folded;
+	}
+	encoded[0] = static_cast<int8_t>(std::lround(x * 127.0f));
+	encoded[1] = static_cast<int8_t>(std::lround(y * 127.0f));
+}
+
+VertexDecode quantizeVertices(const std::vector<Vertex> &vertices,
+							  std::vector<CompactVertex> &compact) {
+	const float inf = std::numeric_limits<float>::infinity();
+	float min[5] = {inf, inf, inf, inf, inf};
+	float max[5] = {-inf, -inf, -inf, -inf, -inf};
+	for (const Vertex &vertex : vertices) {
+		const float values[5] = {vertex.pos.x, vertex.pos.y, vertex.pos.z, vertex.texCoord.s,
+								 vertex.texCoord.t};
+		for (int i = 0; i < 5; i++) {
+			min[i] = std::min(min[i], values[i]);
+			max[i] = std::max(max[i], values[i]);
+		}
+	}
+
+	// A flat range decodes to its minimum whatever the stored value
+	VertexDecode decode;
+	float scale[5];
+	for (int i = 0; i < 5; i++) {
+		if (vertices.empty())
+			min[i] = max[i] = 0.0f;
+		float extent = max[i] - min[i];
+		scale[i] = extent > 0.0f ? 65535.0f / extent : 0.0f;
+		if (i < 3) {
+			decode.positionOffset[i] = min[i];
+			decode.positionScale[i] = extent;
+		} else {
+			decode.texCoordOffset[i - 3] = min[i];
+			decode.texCoordScale[i - 3] = extent;
+		}
+	}
+
+	compact.resize(vertices.size());
+	for (size_t v = 0; v < vertices.size(); v++) {
+		const Vertex &vertex = vertices[v];
+		const float values[5] = {vertex.pos.x, vertex.pos.y, vertex.pos.z, vertex.texCoord.s,
+								 vertex.texCoord.t};
+		uint16_t quantized[5];
+		for (int i = 0; i < 5; i++)
+			quantized[i] = static_cast<uint16_t>(
+				std::min(std::lround((values[i] - min[i]) * scale[i]), 65535L));
+		compact[v] = {{quantized[0], quantized[1], quantized[2]}, {}, {quantized[3], quantized[4]}};
+		encodeOctahedral(vertex.normal, compact[v].normal);
+	}
+	decode.normalDecode[0] = 1.0f;
+	return decode;
+}
+
+MeshBounds computeBounds(const std::vector<Vertex> &vertices) {
+	return computeBounds(vertices.empty() ? nullptr : &vertices[0].pos, vertices.size(),
+						 sizeof(Vertex));
+}
+
+bool isOutsideFrustum(const MeshBounds &bounds, const Mat4 &clip) {
+	// Clip space position of the 8 corners, then look for a plane they are all behind
+	float corners[8][4];
+	for (int i = 0; i < 8; i++) {
+		float x = (i & 1) ? bounds.max.x : bounds.min.x;
+		float y = (i & 2) ? bounds.max.y : bounds.min.y;
+		float z = (i & 4) ? bounds.max.z : bounds.min.z;
+		for (int row = 0; row < 4; row++)
+			corners[i][row] = clip[0][row] * x + clip[1][row] * y + clip[2][row] * z + clip[3][row];
+	}
+
+	for (int plane = 0; plane < 6; plane++) {
+		bool outside = true;
+		for (int i = 0; i < 8 && outside; i++) {
+			const float *c = corners[i];
+			switch (plane) {
+			case 0: outside = c[0] < -c[3]; break;
+			case 1: outside = c[0] > c[3]; break;
+			case 2: outside = c[1] < -c[3]; break;
+			case 3: outside = c[1] > c[3]; break;
+			case 4: outside = c[2] < 0.0f; break;
+			default: outside = c[2] > c[3]; break;
+			}
+		}
+		if (outside)
+			return true;
+	}
+	return false;
+}
@@ -0,0 +1,342 @@
+#include "mesh_cache.hpp"
+#include "mapped_file.hpp"
+#include "simplify.hpp"
+#include <cstdio>
+#include <cstring>
+
+static const char MESH_CACHE_MAGIC[8] = {'S', 'C', 'O', 'P', 'M', 'S', 'H', '\0'};
+
+struct SourceStamp {
+	uint64_t size;
+	int64_t mtime;
+	uint64_t hash;
+};
+
+struct MeshCacheHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t vertexSize;
+	SourceStamp source;
+	uint64_t settings;
+	uint64_t vertexCount;
+	uint64_t indexCount;
+	uint64_t submeshCount;
+	uint64_t materialCount;
+	uint64_t libraryCount;
+	uint64_t meshletCount;
+	uint64_t lodCount;
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+	uint64_t submeshOffset;
+	uint64_t meshletOffset;
+	uint64_t lodOffset; // lodCount float errors, then lodCount rows of submeshCount + 1 firstIndex
+	uint64_t stringOffset;
+	uint64_t stringSize;
+	float boundsMin[3];
+	float boundsMax[3];
+	float boundsSphere[4]; // center and radius
+};
+
+// A submesh without its name. The names of the submeshes, then the materials, then the libraries
+// follow as NUL-terminated strings.
+struct CachedSubmesh {
+	uint32_t material;
+	uint32_t indexOffset;
+	uint32_t indexCount;
+	uint32_t firstMeshlet;
+	float boundsMin[3];
+	float boundsMax[3];
+	float boundsSphere[4]; // center and radius
+};
+
+struct CachedMeshlet {
+	uint32_t indexOffset;
+	uint32_t indexCount;
+	float center[3];
+	float radius;
+	float coneAxis[3];
+	float coneCos;
+	float coneSin;
+};
+
+static void storeBounds(const MeshBounds &bounds, float min[3], float max[3], float sphere[4]) {
+	for (int i = 0; i < 3; i++) {
+		min[i] = bounds.min[i];
+		max[i] = bounds.max[i];
+		sphere[i] = bounds.center[i];
+	}
+	sphere[3] = bounds.radius;
+}
+
+static MeshBounds loadBounds(const float min[3], const float max[3], const float sphere[4]) {
+	return {Vec3(min[0], min[1], min[2]), Vec3(max[0], max[1], max[2]),
+			Vec3(sphere[0], sphere[1], sphere[2]), sphere[3]};
+}
+
+static uint64_t fnv1a(const char *data, size_t size, uint64_t hash) {
+	for (size_t i = 0; i < size; i++) {
+		hash ^= static_cast<unsigned char>(data[i]);
+		hash *= 0x100000001B3ull;
+	}
+	return hash;
+}
+
+static bool stampSource(const char *sourcePath, SourceStamp &stamp) {
+	struct stat st;
+	if (stat(sourcePath, &st) == -1)
+		return false;
+	stamp.size = static_cast<uint64_t>(st.st_size);
+	stamp.mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+
+	// 16 blocks of 4 KiB spread over the file, first and last included
+	MappedFile source(sourcePath);
+	if (!source.isOpen())
+		return false;
+	const size_t blockCount = 16;
+	const size_t blockSize = 4096;
+	stamp.hash = 0xCBF29CE484222325ull;
+	if (source.size() <= blockCount * blockSize) {
+		stamp.hash = fnv1a(source.data(), source.size(), stamp.hash);
+		return true;
+	}
+	for (size_t i = 0; i < blockCount; i++) {
+		size_t offset = (source.size() - blockSize) * i / (blockCount - 1);
+		stamp.hash = fnv1a(source.data() + offset, blockSize, stamp.hash);
+	}
+	return true;
+}
+
+static size_t alignUp(size_t value, size_t alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+bool readMeshCache(const std::string &cachePath, const char *sourcePath, Mesh &mesh,
+				   uint64_t settings) {
+	MappedFile cache(cachePath.c_str());
+	if (!cache.isOpen() || cache.size() < sizeof(MeshCacheHeader))
+		return false;
+
+	MeshCacheHeader header;
+	memcpy(&header, cache.data(), sizeof(header));
+	if (memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+		header.version != MESH_CACHE_VERSION || header.vertexSize != sizeof(Vertex))
+		return false;
+
+	SourceStamp stamp;
+	if (!stampSource(sourcePath, stamp) || stamp.size != header.source.size ||
+		stamp.mtime != header.source.mtime || stamp.hash != header.source.hash ||
+		header.settings != settings)
+		return false;
+
+	// Every count is checked against what the rest of the file can hold by dividing, never by
+	// multiplying it first, so a corrupt header cannot overflow its way through. Every name takes
+	// at least its NUL byte.
+	auto fits = [&](uint64_t offset, uint64_t count, size_t elementSize) {
+		return offset <= cache.size() && count <= (cache.size() - offset) / elementSize;
+	};
+	if (!fits(header.vertexOffset, header.vertexCount, sizeof(Vertex)) ||
+		!fits(header.indexOffset, header.indexCount, sizeof(uint32_t)) ||
+		!fits(header.submeshOffset, header.submeshCount, sizeof(CachedSubmesh)) ||
+		!fits(header.meshletOffset, header.meshletCount, sizeof(CachedMeshlet)) ||
+		!fits(header.stringOffset, header.stringSize, 1) ||
+		header.materialCount > header.stringSize || header.libraryCount > header.stringSize ||
+		header.submeshCount + header.materialCount + header.libraryCount > header.stringSize)
+		return false;
+	// submeshCount is below the file size here, and lodCount at most LOD_MAX_LEVELS
+	if (header.lodCount > LOD_MAX_LEVELS ||
+		!fits(header.lodOffset, header.lodCount * (header.submeshCount + 2), sizeof(uint32_t)))
+		return false;
+
+	const char *strings = cache.data() + header.stringOffset;
+	const char *stringsEnd = strings + header.stringSize;
+	auto nextString = [&](std::string &out) {
+		const char *nul = static_cast<const char *>(memchr(strings, '\0', stringsEnd - strings));
+		if (nul == nullptr)
+			return false;
+		out.assign(strings, nul);
+		strings = nul + 1;
+		return true;
+	};
+
+	mesh = Mesh();
+	const Vertex *cachedVertices =
+		reinterpret_cast<const Vertex *>(cache.data() + header.vertexOffset);
+	const uint32_t *cachedIndices =
+		reinterpret_cast<const uint32_t *>(cache.data() + header.indexOffset);
+	mesh.vertices.assign(cachedVertices, cachedVertices + header.vertexCount);
+	mesh.indices.assign(cachedIndices, cachedIndices + header.indexCount);
+	// The values are checked too: the meshlets, the BVH and the GPU all index with them unchecked
+	for (uint32_t index : mesh.indices) {
+		if (index >= header.vertexCount)
+			return false;
+	}
+
+	mesh.submeshes.resize(header.submeshCount);
+	for (size_t i = 0; i < mesh.submeshes.size(); i++) {
+		CachedSubmesh cached;
+		memcpy(&cached, cache.data() + header.submeshOffset + i * sizeof(cached), sizeof(cached));
+		if (cached.indexOffset > header.indexCount ||
+			cached.indexCount > header.indexCount - cached.indexOffset)
+			return false;
+		Submesh &submesh = mesh.submeshes[i];
+		if (!nextString(submesh.name))
+			return false;
+		if (cached.material != NO_MATERIAL && cached.material >= header.materialCount)
+			return false;
+		submesh.material = cached.material;
+		submesh.indexOffset = cached.indexOffset;
+		submesh.indexCount = cached.indexCount;
+		submesh.bounds = loadBounds(cached.boundsMin, cached.boundsMax, cached.boundsSphere);
+		if (header.meshletCount > 0) {
+			if (cached.firstMeshlet > header.meshletCount ||
+				(i > 0 && cached.firstMeshlet < mesh.firstMeshlet.back()))
+				return false;
+			mesh.firstMeshlet.push_back(cached.firstMeshlet);
+		}
+	}
+	if (header.meshletCount > 0)
+		mesh.firstMeshlet.push_back(static_cast<uint32_t>(header.meshletCount));
+
+	mesh.meshlets.resize(header.meshletCount);
+	for (size_t i = 0; i < mesh.meshlets.size(); i++) {
+		CachedMeshlet cached;
+		memcpy(&cached, cache.data() + header.meshletOffset + i * sizeof(cached), sizeof(cached));
+		if (cached.indexOffset > header.indexCount ||
+			cached.indexCount > header.indexCount - cached.indexOffset)
+			return false;
+		Meshlet &meshlet = mesh.meshlets[i];
+		meshlet.indexOffset = cached.indexOffset;
+		meshlet.indexCount = cached.indexCount;
+		meshlet.center = Vec3(cached.center[0], cached.center[1], cached.center[2]);
+		meshlet.radius = cached.radius;
+		meshlet.coneAxis = Vec3(cached.coneAxis[0], cached.coneAxis[1], cached.coneAxis[2]);
+		meshlet.coneCos = cached.coneCos;
+		meshlet.coneSin = cached.coneSin;
+	}
+
+	const char *cachedLods = cache.data() + header.lodOffset;
+	mesh.lods.resize(header.lodCount);
+	for (MeshLod &lod : mesh.lods) {
+		memcpy(&lod.error, cachedLods, sizeof(lod.error));
+		cachedLods += sizeof(lod.error);
+	}
+	for (MeshLod &lod : mesh.lods) {
+		lod.firstIndex.resize(header.submeshCount + 1);
+		memcpy(lod.firstIndex.data(), cachedLods, lod.firstIndex.size() * sizeof(uint32_t));
+		cachedLods += lod.firstIndex.size() * sizeof(uint32_t);
+		for (size_t i = 0; i < lod.firstIndex.size(); i++) {
+			if (lod.firstIndex[i] > header.indexCount ||
+				(i > 0 && lod.firstIndex[i] < lod.firstIndex[i - 1]))
+				return false;
+		}
+	}
+	mesh.materials.resize(header.materialCount);
+	for (auto &material : mesh.materials) {
+		if (!nextString(material))
+			return false;
+	}
+	mesh.materialLibraries.resize(header.libraryCount);
+	for (auto &library : mesh.materialLibraries) {
+		if (!nextString(library))
+			return false;
+	}
+	mesh.bounds = loadBounds(header.boundsMin, header.boundsMax, header.boundsSphere);
+	return true;
+}
+
+bool writeMeshCache(const std::string &cachePath, const char *sourcePath, const Mesh &mesh,
+					uint64_t settings) {
+	std::string strings;
+	for (const auto &submesh : mesh.submeshes)
+		strings.append(submesh.name).push_back('\0');
+	for (const auto &material : mesh.materials)
+		strings.append(material).push_back('\0');
+	for (const auto &library : mesh.materialLibraries)
+		strings.append(library).push_back('\0');
+
+	MeshCacheHeader header{};
+	memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+	header.version = MESH_CACHE_VERSION;
+	header.vertexSize = sizeof(Vertex);
+	if (!stampSource(sourcePath, header.source))
+		return false;
+	header.settings = settings;
+	header.vertexCount = mesh.vertices.size();
+	header.indexCount = mesh.indices.size();
+	header.submeshCount = mesh.submeshes.size();
+	header.materialCount = mesh.materials.size();
+	header.libraryCount = mesh.materialLibraries.size();
+	header.meshletCount = mesh.meshlets.size();
+	header.lodCount = mesh.lods.size();
+	header.vertexOffset = alignUp(sizeof(header), 16);
+	header.indexOffset = alignUp(header.vertexOffset + mesh.vertices.size() * sizeof(Vertex), 16);
+	header.submeshOffset = alignUp(header.indexOffset + mesh.indices.size() * sizeof(uint32_t), 16);
+	header.meshletOffset =
+		alignUp(header.submeshOffset + mesh.submeshes.size() * sizeof(CachedSubmesh), 16);
+	header.lodOffset =
+		alignUp(header.meshletOffset + mesh.meshlets.size() * sizeof(CachedMeshlet), 16);
+	header.stringOffset =
+		header.lodOffset + mesh.lods.size() * (mesh.submeshes.size() + 2) * sizeof(uint32_t);
+	header.stringSize = strings.size();
+	storeBounds(mesh.bounds, header.boundsMin, header.boundsMax, header.boundsSphere);
+
+	std::string tmpPath = cachePath + ".tmp";
+	FILE *file = fopen(tmpPath.c_str(), "wb");
+	if (file == nullptr)
+		return false;
+
+	bool ok = true;
+	uint64_t written = 0;
+	auto put = [&](const void *data, size_t size) {
+		ok = ok && fwrite(data, 1, size, file) == size;
+		written += size;
+	};
+	auto padTo = [&](uint64_t offset) {
+		const char padding[16] = {};
+		put(padding, offset - written);
+	};
+
+	put(&header, sizeof(header));
+	padTo(header.vertexOffset);
+	put(mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+	padTo(header.indexOffset);
+	put(mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+	padTo(header.submeshOffset);
+	for (size_t i = 0; i < mesh.submeshes.size(); i++) {
+		const Submesh &submesh = mesh.submeshes[i];
+		CachedSubmesh cached{};
+		cached.material = submesh.material;
+		cached.indexOffset = submesh.indexOffset;
+		cached.indexCount = submesh.indexCount;
+		cached.firstMeshlet = mesh.meshlets.empty() ? 0 : mesh.firstMeshlet[i];
+		storeBounds(submesh.bounds, cached.boundsMin, cached.boundsMax, cached.boundsSphere);
+		put(&cached, sizeof(cached));
+	}
+	padTo(header.meshletOffset);
+	for (const Meshlet &meshlet : mesh.meshlets) {
+		CachedMeshlet cached{};
+		cached.indexOffset = meshlet.indexOffset;
+		cached.indexCount = meshlet.indexCount;
+		for (int i = 0; i < 3; i++) {
+			cached.center[i] = meshlet.center[i];
+			cached.coneAxis[i] = meshlet.coneAxis[i];
+		}
+		cached.radius = meshlet.radius;
+		cached.coneCos = meshlet.coneCos;
+		cached.coneSin = meshlet.coneSin;
+		put(&cached, sizeof(cached));
+	}
+	padTo(header.lodOffset);
+	for (const MeshLod &lod : mesh.lods)
+		put(&lod.error, sizeof(lod.error));
+	for (const MeshLod &lod : mesh.lods)
+		put(lod.firstIndex.data(), lod.firstIndex.size() * sizeof(uint32_t));
+	put(strings.data(), strings.size());
+
+	ok = fclose(file) == 0 && ok;
+	if (!ok || rename(tmpPath.c_str(), cachePath.c_str()) != 0) {
+		remove(tmpPath.c_str());
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,242 @@
+#include "mesh_clean.hpp"
+#include "flat_id_map.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+static const uint32_t NONE = UINT32_MAX;
+
+// Cells of the weld grid are numbered from the low corner of the bounds, 21 bits per axis packed
+// in one key: a slot of the table is then 16 bytes instead of 32.
+static const int CELL_BITS = 21;
+static const double MAX_CELLS = 1 << (CELL_BITS - 1);
+
+struct GridCellHash {
+	size_t operator()(uint64_t cell) const {
+		cell ^= cell >> 31;
+		cell *= 0xD6E8FEB86659FD93ull;
+		return static_cast<size_t>(cell ^ (cell >> 32));
+	}
+};
+
+static uint64_t gridCell(const int64_t cell[3]) {
+	return static_cast<uint64_t>(cell[0]) << (2 * CELL_BITS) |
+		   static_cast<uint64_t>(cell[1]) << CELL_BITS | static_cast<uint64_t>(cell[2]);
+}
+
+// A triangle rotated so its smallest vertex comes first, which keeps the winding
+struct TriangleKey {
+	uint32_t a, b, c;
+
+	bool operator==(const TriangleKey &other) const {
+		return a == other.a && b == other.b && c == other.c;
+	}
+};
+
+static TriangleKey triangleKey(uint32_t a, uint32_t b, uint32_t c) {
+	if (b < a && b < c)
+		return {b, c, a};
+	if (c < a && c < b)
+		return {c, a, b};
+	return {a, b, c};
+}
+
+// Maps every vertex to the first vertex within distance of it with texture coordinates within
+// uvDistance and a normal within normalDistance, itself when there is none. Only those first
+// vertices, the roots, go into the grid: a root is never within distance of an earlier root, so
+// its cell holds a handful at most. With cells 2 * distance wide the ball around a vertex only
+// reaches the neighbours on the side of the cell it is closest to, one per axis, so 8 cells cover
+// it. Cells grow past that when the bounds would need more than MAX_CELLS of them, which only puts
+// more roots in each.
+static std::vector<uint32_t> weldVertices(const std::vector<Vertex> &vertices,
+										  const MeshBounds &bounds, float distance,
+										  float uvDistance, float normalDistance) {
+	std::vector<uint32_t> remap(vertices.size());
+	double cellSize = std::max(2.0 * distance, (bounds.max - bounds.min).length() / MAX_CELLS);
+	FlatIdMap<uint64_t, GridCellHash> cells(vertices.size());
+	// Most vertices have no root near them. A bit per hashed cell, set for the cells holding
+	// roots, answers most of their lookups from a few hundred KiB instead of the table.
+	size_t bitCount = 64;
+	while (bitCount < vertices.size() * 8)
+		bitCount *= 2;
+	std::vector<uint64_t> occupied(bitCount / 64, 0);
+	auto occupiedBit = [&](uint64_t cell) { return GridCellHash()(cell) & (bitCount - 1); };
+	std::vector<uint32_t> cellRoots;
+	std::vector<uint32_t> nextRoot(vertices.size(), NONE);
+	float distanceSquared = distance * distance;
+
+	for (size_t v = 0; v < vertices.size(); v++) {
+		const Vertex &vertex = vertices[v];
+		// Numbered from 1, so the neighbours below the first cell stay positive
+		int64_t cell[3];
+		int side[3];
+		for (int axis = 0; axis < 3; axis++) {
+			double scaled = (vertex.pos[axis] - bounds.min[axis]) / cellSize;
+			double floor = std::floor(scaled);
+			cell[axis] = static_cast<int64_t>(floor) + 1;
+			side[axis] = scaled - floor < 0.5 ? -1 : 1;
+		}
+
+		uint32_t root = NONE;
+		for (int corner = 0; corner < 8 && root == NONE; corner++) {
+			int64_t neighbourCell[3] = {cell[0] + (corner & 1 ? side[0] : 0),
+										cell[1] + (corner & 2 ? side[1] : 0),
+										cell[2] + (corner & 4 ? side[2] : 0)};
+			uint64_t neighbour = gridCell(neighbourCell);
+			size_t bit = occupiedBit(neighbour);
+			if (!(occupied[bit / 64] >> (bit % 64) & 1))
+				continue;
+			uint32_t id = cells.find(neighbour);
+			if (id == cells.none)
+				continue;
+			for (uint32_t r = cellRoots[id]; r != NONE && root == NONE; r = nextRoot[r]) {
+				const Vertex &other = vertices[r];
+				float dx = other.pos.x - vertex.pos.x;
+				float dy = other.pos.y - vertex.pos.y;
+				float dz = other.pos.z - vertex.pos.z;
+				if (dx * dx + dy * dy + dz * dz <= distanceSquared &&
+					std::fabs(other.texCoord.s - vertex.texCoord.s) <= uvDistance &&
+					std::fabs(other.texCoord.t - vertex.texCoord.t) <= uvDistance &&
+					std::fabs(other.normal.x - vertex.normal.x) <= normalDistance &&
+					std::fabs(other.normal.y - vertex.normal.y) <= normalDistance &&
+					std::fabs(other.normal.z - vertex.normal.z) <= normalDistance)
+					root = r;
+			}
+		}
+		if (root != NONE) {
+			remap[v] = root;
+			continue;
+		}
+
+		remap[v] = static_cast<uint32_t>(v);
+		uint64_t own = gridCell(cell);
+		size_t bit = occupiedBit(own);
+		occupied[bit / 64] |= uint64_t(1) << (bit % 64);
+		bool isNew;
+		uint32_t id = cells.insert(own, static_cast<uint32_t>(cellRoots.size()), isNew);
+		if (isNew)
+			cellRoots.push_back(NONE);
+		nextRoot[v] = cellRoots[id];
+		cellRoots[id] = static_cast<uint32_t>(v);
+	}
+	return remap;
+}
+
+MeshCleanStats cleanMesh(Mesh &mesh, float epsilon, bool compareTexCoords, bool compareNormals) {
+	MeshCleanStats stats{};
+	std::vector<Vertex> &vertices = mesh.vertices;
+	std::vector<uint32_t> &indices = mesh.indices;
+	float distance = epsilon * (mesh.bounds.max - mesh.bounds.min).length();
+
+	std::vector<uint32_t> remap;
+	if (distance > 0.0f) {
+		float uvDistance = compareTexCoords ? epsilon : std::numeric_limits<float>::infinity();
+		float normalDistance = compareNormals ? epsilon : std::numeric_limits<float>::infinity();
+		remap = weldVertices(vertices, mesh.bounds, distance, uvDistance, normalDistance);
+		for (size_t v = 0; v < vertices.size(); v++)
+			stats.weldedVertices += remap[v] != v;
+	} else {
+		remap.resize(vertices.size());
+		for (size_t v = 0; v < vertices.size(); v++)
+			remap[v] = static_cast<uint32_t>(v);
+	}
+
+	// The welded triangles, the degenerate ones marked with a first vertex of NONE. A triangle is
+	// degenerate when two of its corners became one vertex, or when its corners lie exactly on a
+	// line. Thin triangles that nothing welded are valid and stay: dropping them opens cracks in
+	// the long strips of scanned and CAD meshes.
+	size_t triangleCount = indices.size() / 3;
+	std::vector<TriangleKey> keys(triangleCount);
+	for (size_t t = 0; t < triangleCount; t++) {
+		uint32_t a = remap[indices[t * 3]];
+		uint32_t b = remap[indices[t * 3 + 1]];
+		uint32_t c = remap[indices[t * 3 + 2]];
+		keys[t] = triangleKey(a, b, c);
+		if (a == b || b == c || c == a) {
+			keys[t].a = NONE;
+			continue;
+		}
+		// In double, where the edges of float corners are exact, so collinear corners rarely
+		// round to a cross product that is not zero
+		double ab[3], ca[3];
+		for (int axis = 0; axis < 3; axis++) {
+			ab[axis] = static_cast<double>(vertices[b].pos[axis]) - vertices[a].pos[axis];
+			ca[axis] = static_cast<double>(vertices[a].pos[axis]) - vertices[c].pos[axis];
+		}
+		if (ab[1] * ca[2] - ab[2] * ca[1] == 0.0 && ab[2] * ca[0] - ab[0] * ca[2] == 0.0 &&
+			ab[0] * ca[1] - ab[1] * ca[0] == 0.0)
+			keys[t].a = NONE;
+	}
+
+	// Duplicates share their smallest vertex. The triangles are bucketed on it with a counting
+	// sort, in order, and each one is only compared with the few earlier ones of its bucket.
+	std::vector<uint32_t> firstOfVertex(vertices.size() + 1, 0);
+	for (const TriangleKey &key : keys) {
+		if (key.a != NONE)
+			firstOfVertex[key.a + 1]++;
+	}
+	for (size_t v = 0; v < vertices.size(); v++)
+		firstOfVertex[v + 1] += firstOfVertex[v];
+	std::vector<uint32_t> bucketed(firstOfVertex.back());
+	std::vector<uint32_t> cursor(firstOfVertex.begin(), firstOfVertex.end() - 1);
+	for (size_t t = 0; t < triangleCount; t++) {
+		if (keys[t].a != NONE)
+			bucketed[cursor[keys[t].a]++] = static_cast<uint32_t>(t);
+	}
+	std::vector<bool> duplicate(triangleCount, false);
+	for (size_t v = 0; v < vertices.size(); v++) {
+		for (uint32_t i = firstOfVertex[v]; i < firstOfVertex[v + 1]; i++) {
+			for (uint32_t j = firstOfVertex[v]; j < i && !duplicate[bucketed[i]]; j++) {
+				if (keys[bucketed[j]] == keys[bucketed[i]])
+					duplicate[bucketed[i]] = true;
+			}
+		}
+	}
+
+	// The triangles kept move down over the ones dropped
+	uint32_t out = 0;
+	for (Submesh &submesh : mesh.submeshes) {
+		uint32_t first = out;
+		for (uint32_t t = submesh.indexOffset / 3; t < (submesh.indexOffset + submesh.indexCount) / 3;
+			 t++) {
+			if (keys[t].a == NONE) {
+				stats.degenerateTriangles++;
+			} else if (duplicate[t]) {
+				stats.duplicateTriangles++;
+			} else {
+				indices[out++] = remap[indices[t * 3]];
+				indices[out++] = remap[indices[t * 3 + 1]];
+				indices[out++] = remap[indices[t * 3 + 2]];
+			}
+		}
+		submesh.indexOffset = first;
+		submesh.indexCount = out - first;
+	}
+	indices.resize(out);
+	mesh.submeshes.erase(std::remove_if(mesh.submeshes.begin(), mesh.submeshes.end(),
+										[](const Submesh &submesh) { return submesh.indexCount == 0; }),
+						 mesh.submeshes.end());
+
+	// The vertices still used, in their order
+	std::vector<uint32_t> compact(vertices.size(), NONE);
+	for (uint32_t index : indices)
+		compact[index] = 0;
+	uint32_t kept = 0;
+	for (size_t v = 0; v < vertices.size(); v++) {
+		if (compact[v] == NONE)
+			continue;
+		compact[v] = kept;
+		vertices[kept++] = vertices[v];
+	}
+	stats.unusedVertices = vertices.size() - kept - stats.weldedVertices;
+	vertices.resize(kept);
+	for (uint32_t &index : indices)
+		index = compact[index];
+
+	for (Submesh &submesh : mesh.submeshes) {
+		submesh.bounds = computeBounds(&vertices[0].pos, sizeof(Vertex),
+									   &indices[submesh.indexOffset], submesh.indexCount);
+	}
+	mesh.bounds = computeBounds(vertices);
+	return stats;
+}
@@ -0,0 +1,568 @@
+#include "mesh_optimize.hpp"
+#include "meshlet.hpp"
+#include "simplify.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// FIFO cache of size entries: one is still cached while fewer than size misses happened since its
+// own. Used for vertices and for cache lines of the vertex buffer.
+class FifoCache {
+public:
+	FifoCache(size_t entryCount, unsigned size) : missedAt(entryCount, 0), size(size) {}
+
+	// Forgets everything cached
+	void reset() { misses += size; }
+
+	bool miss(size_t entry) {
+		if (missedAt[entry] != 0 && misses - missedAt[entry] < size)
+			return false;
+		missedAt[entry] = ++misses;
+		return true;
+	}
+
+	unsigned missTriangle(const uint32_t *triangle) {
+		return miss(triangle[0]) + miss(triangle[1]) + miss(triangle[2]);
+	}
+
+private:
+	std::vector<uint64_t> missedAt;
+	uint64_t misses = 0;
+	uint64_t size;
+};
+
+VertexCacheStats analyzeVertexCache(const std::vector<uint32_t> &indices, size_t vertexCount,
+									unsigned cacheSize) {
+	VertexCacheStats stats;
+	if (indices.size() < 3)
+		return stats;
+
+	FifoCache cache(vertexCount, cacheSize);
+	std::vector<bool> referenced(vertexCount, false);
+	size_t misses = 0;
+	size_t referencedCount = 0;
+	for (uint32_t index : indices) {
+		misses += cache.miss(index);
+		if (!referenced[index]) {
+			referenced[index] = true;
+			referencedCount++;
+		}
+	}
+	stats.acmr = static_cast<double>(misses) / (indices.size() / 3);
+	stats.atvr = static_cast<double>(misses) / referencedCount;
+	return stats;
+}
+
+double analyzeVertexFetch(const std::vector<uint32_t> &indices, size_t vertexCount,
+						  size_t vertexSize) {
+	if (indices.empty() || vertexCount == 0)
+		return 0.0;
+
+	const size_t lineSize = 64;
+	FifoCache cache((vertexCount * vertexSize + lineSize - 1) / lineSize, 256);
+	size_t loads = 0;
+	for (uint32_t index : indices) {
+		size_t first = index * vertexSize / lineSize;
+		size_t last = ((index + 1) * vertexSize - 1) / lineSize;
+		for (size_t line = first; line <= last; line++)
+			loads += cache.miss(line);
+	}
+	return static_cast<double>(loads * lineSize) / (vertexCount * vertexSize);
+}
+
+struct ScreenVertex {
+	float x;
+	float y;
+	float z;
+};
+
+// Top and left edges own the pixel centers lying exactly on them, shared edges are drawn once
+static bool isTopLeft(const ScreenVertex &a, const ScreenVertex &b) {
+	return (a.y == b.y && b.x < a.x) || b.y > a.y;
+}
+
+static float edge(const ScreenVertex &a, const ScreenVertex &b, float x, float y) {
+	return (b.x - a.x) * (y - a.y) - (b.y - a.y) * (x - a.x);
+}
+
+static void drawTriangle(const ScreenVertex &a, const ScreenVertex &b, const ScreenVertex &c,
+						 int size, std::vector<float> &depth, OverdrawStats &stats) {
+	float area = edge(a, b, c.x, c.y);
+	// Back face, or nothing to draw
+	if (area <= 0.0f)
+		return;
+
+	int minX = std::max(0, static_cast<int>(std::floor(std::min({a.x, b.x, c.x}))));
+	int maxX = std::min(size - 1, static_cast<int>(std::ceil(std::max({a.x, b.x, c.x}))));
+	int minY = std::max(0, static_cast<int>(std::floor(std::min({a.y, b.y, c.y}))));
+	int maxY = std::min(size - 1, static_cast<int>(std::ceil(std::max({a.y, b.y, c.y}))));
+	bool ownsBC = isTopLeft(b, c), ownsCA = isTopLeft(c, a), ownsAB = isTopLeft(a, b);
+
+	for (int y = minY; y <= maxY; y++) {
+		for (int x = minX; x <= maxX; x++) {
+			float px = x + 0.5f, py = y + 0.5f;
+			float wa = edge(b, c, px, py), wb = edge(c, a, px, py), wc = edge(a, b, px, py);
+			if (wa < 0.0f || wb < 0.0f || wc < 0.0f || (wa == 0.0f && !ownsBC) ||
+				(wb == 0.0f && !ownsCA) || (wc == 0.0f && !ownsAB))
+				continue;
+			float z = (wa * a.z + wb * b.z + wc * c.z) / area;
+			float &stored = depth[static_cast<size_t>(y) * size + x];
+			if (z < stored) {
+				stored = z;
+				stats.shaded++;
+			}
+		}
+	}
+}
+
+OverdrawStats analyzeOverdraw(const Mesh &mesh, int viewCount, int size) {
+	float radius = 0.0f;
+	for (const Vertex &vertex : mesh.vertices)
+		radius = std::max(radius, vertex.pos.length());
+	float scale = radius > 0.0f ? 0.95f * size / (2.0f * radius) : 1.0f;
+
+	OverdrawStats stats;
+	std::vector<float> depth(static_cast<size_t>(size) * size);
+	std::vector<ScreenVertex> screen(mesh.vertices.size());
+	size_t indexCount = fullIndexCount(mesh);
+	const float goldenAngle = static_cast<float>(M_PI * (3.0 - std::sqrt(5.0)));
+	for (int view = 0; view < viewCount; view++) {
+		// Directions spread evenly over the sphere, the same on every run
+		float y = 1.0f - 2.0f * (view + 0.5f) / viewCount;
+		float ring = std::sqrt(1.0f - y * y);
+		Vec3 direction(std::cos(goldenAngle * view) * ring, y, std::sin(goldenAngle * view) * ring);
+		// right x up points back to the camera, so front faces are counter-clockwise on screen
+		Vec3 helper =
+			std::fabs(direction.y) < 0.9f ? Vec3(0.0f, 1.0f, 0.0f) : Vec3(1.0f, 0.0f, 0.0f);
+		Vec3 right = direction.cross(helper).normalize();
+		Vec3 up = right.cross(direction);
+		for (size_t i = 0; i < mesh.vertices.size(); i++) {
+			const Vec3 &pos = mesh.vertices[i].pos;
+			screen[i] = {pos.dot(right) * scale + size / 2.0f, pos.dot(up) * scale + size / 2.0f,
+						 pos.dot(direction)};
+		}
+
+		std::fill(depth.begin(), depth.end(), std::numeric_limits<float>::infinity());
+		for (size_t i = 0; i + 2 < indexCount; i += 3)
+			drawTriangle(screen[mesh.indices[i]], screen[mesh.indices[i + 1]],
+						 screen[mesh.indices[i + 2]], size, depth, stats);
+		for (float stored : depth)
+			stats.covered += stored != std::numeric_limits<float>::infinity();
+	}
+	stats.overdraw = stats.covered ? static_cast<double>(stats.shaded) / stats.covered : 0.0;
+	return stats;
+}
+
+// Scores of the Forsyth heuristic. The optimizer models an LRU cache a bit bigger than most GPUs
+// have, the three vertices of the last triangle get a fixed score so that strips are not favored
+// over fans, and vertices with few triangles left get a boost so that none is left stranded.
+static const int modeledCacheSize = 32;
+static const int maxScoredValence = 32;
+
+struct ForsythScores {
+	float cache[modeledCacheSize];
+	float valence[maxScoredValence + 1];
+
+	ForsythScores() {
+		for (int i = 0; i < modeledCacheSize; i++) {
+			float scaled = 1.0f - static_cast<float>(i - 3) / (modeledCacheSize - 3);
+			cache[i] = i < 3 ? 0.75f : std::pow(scaled, 1.5f);
+		}
+		valence[0] = 0.0f;
+		for (int i = 1; i <= maxScoredValence; i++)
+			valence[i] = 2.0f / std::sqrt(static_cast<float>(i));
+	}
+
+	float score(int cachePosition, uint32_t liveTriangles) const {
+		// A vertex without triangles left will never be used again
+		if (liveTriangles == 0)
+			return -1.0f;
+		float score = cachePosition < 0 ? 0.0f : cache[cachePosition];
+		return score + (liveTriangles <= maxScoredValence
+							? valence[liveTriangles]
+							: 2.0f / std::sqrt(static_cast<float>(liveTriangles)));
+	}
+};
+
+// Reorders the triangleCount triangles at indices in place. localIds maps mesh vertices to the
+// dense numbering of this run, it is all none on entry and on return.
+static void optimizeTriangles(uint32_t *indices, size_t triangleCount,
+							  std::vector<uint32_t> &localIds) {
+	static const ForsythScores scores;
+	const uint32_t none = UINT32_MAX;
+
+	std::vector<uint32_t> vertices;
+	std::vector<uint32_t> corners(triangleCount * 3);
+	for (size_t i = 0; i < corners.size(); i++) {
+		uint32_t &local = localIds[indices[i]];
+		if (local == none) {
+			local = static_cast<uint32_t>(vertices.size());
+			vertices.push_back(indices[i]);
+		}
+		corners[i] = local;
+	}
+	for (uint32_t vertex : vertices)
+		localIds[vertex] = none;
+
+	// Triangles of every vertex, the live ones first: emitting one swaps it past the live range
+	size_t vertexCount = vertices.size();
+	std::vector<uint32_t> liveTriangles(vertexCount, 0);
+	std::vector<uint32_t> adjacencyStart(vertexCount + 1, 0);
+	std::vector<uint32_t> adjacency(corners.size());
+	for (uint32_t corner : corners)
+		liveTriangles[corner]++;
+	for (size_t v = 0; v < vertexCount; v++)
+		adjacencyStart[v + 1] = adjacencyStart[v] + liveTriangles[v];
+	std::vector<uint32_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+	for (size_t i = 0; i < corners.size(); i++)
+		adjacency[fill[corners[i]]++] = static_cast<uint32_t>(i / 3);
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScore(vertexCount);
+	std::vector<float> triangleScore(triangleCount, 0.0f);
+	std::vector<bool> emitted(triangleCount, false);
+	for (size_t v = 0; v < vertexCount; v++)
+		vertexScore[v] = scores.score(-1, liveTriangles[v]);
+	for (size_t i = 0; i < corners.size(); i++)
+		triangleScore[i / 3] += vertexScore[corners[i]];
+
+	uint32_t best =
+		static_cast<uint32_t>(std::max_element(triangleScore.begin(), triangleScore.end()) -
+							  triangleScore.begin());
+	uint32_t cache[modeledCacheSize + 3];
+	size_t cacheCount = 0;
+	size_t nextUnemitted = 0;
+	uint32_t *out = indices;
+
+	for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++) {
+		// Nothing in the cache has a triangle left: take the next one in the original order
+		if (best == none) {
+			while (emitted[nextUnemitted])
+				nextUnemitted++;
+			best = static_cast<uint32_t>(nextUnemitted);
+		}
+		const uint32_t *triangle = &corners[best * 3];
+		emitted[best] = true;
+		for (int k = 0; k < 3; k++) {
+			uint32_t v = triangle[k];
+			*out++ = vertices[v];
+			uint32_t *live = &adjacency[adjacencyStart[v]];
+			uint32_t *last = live + --liveTriangles[v];
+			std::swap(*std::find(live, last, best), *last);
+		}
+
+		// The triangle's vertices move to the front of the cache, the rest keep their order
+		uint32_t updated[modeledCacheSize + 3];
+		size_t updatedCount = 0;
+		for (int k = 0; k < 3; k++) {
+			if (std::find(updated, updated + updatedCount, triangle[k]) == updated + updatedCount)
+				updated[updatedCount++] = triangle[k];
+		}
+		for (size_t i = 0; i < cacheCount; i++) {
+			if (cache[i] != triangle[0] && cache[i] != triangle[1] && cache[i] != triangle[2])
+				updated[updatedCount++] = cache[i];
+		}
+
+		// Rescore everything that moved, evicted vertices included
+		for (size_t i = 0; i < updatedCount; i++) {
+			uint32_t v = updated[i];
+			cachePosition[v] = i < modeledCacheSize ? static_cast<int>(i) : -1;
+			float score = scores.score(cachePosition[v], liveTriangles[v]);
+			float delta = score - vertexScore[v];
+			vertexScore[v] = score;
+			for (uint32_t a = adjacencyStart[v]; a < adjacencyStart[v] + liveTriangles[v]; a++)
+				triangleScore[adjacency[a]] += delta;
+		}
+		cacheCount = std::min<size_t>(updatedCount, modeledCacheSize);
+		std::copy(updated, updated + cacheCount, cache);
+
+		// The next triangle is the best one touching the cache
+		best = none;
+		float bestScore = -1.0f;
+		for (size_t i = 0; i < cacheCount; i++) {
+			uint32_t v = cache[i];
+			for (uint32_t a = adjacencyStart[v]; a < adjacencyStart[v] + liveTriangles[v]; a++) {
+				if (triangleScore[adjacency[a]] > bestScore) {
+					bestScore = triangleScore[adjacency[a]];
+					best = adjacency[a];
+				}
+			}
+		}
+	}
+}
+
+void optimizeVertexFetch(Mesh &mesh) {
+	const uint32_t none = UINT32_MAX;
+	const size_t blockSize = 65536;
+	// remap[v] is the newest copy of vertex v, earlierCopy[c] the copy before c, in an earlier block
+	std::vector<uint32_t> remap(mesh.vertices.size(), none);
+	std::vector<uint32_t> earlierCopy;
+	std::vector<uint32_t> blockOf;
+	std::vector<Vertex> vertices;
+	vertices.reserve(mesh.vertices.size());
+
+	// Puts the triangle in the last block, copying the corners that block does not have yet
+	size_t blockStart = 0;
+	uint32_t block = 0;
+	auto addTriangle = [&](uint32_t *corner, size_t cornerCount) {
+		size_t added = 0;
+		for (size_t i = 0; i < cornerCount; i++)
+			added += remap[corner[i]] == none || remap[corner[i]] < blockStart;
+		if (vertices.size() + added - blockStart > blockSize) {
+			blockStart = vertices.size();
+			block++;
+		}
+
+		for (size_t i = 0; i < cornerCount; i++) {
+			uint32_t &vertex = remap[corner[i]];
+			if (vertex == none || vertex < blockStart) {
+				earlierCopy.push_back(vertex);
+				blockOf.push_back(block);
+				vertex = static_cast<uint32_t>(vertices.size());
+				vertices.push_back(mesh.vertices[corner[i]]);
+			}
+			corner[i] = vertex;
+		}
+	};
+	size_t fullCount = fullIndexCount(mesh);
+	for (size_t t = 0; t < fullCount; t += 3)
+		addTriangle(&mesh.indices[t], std::min<size_t>(3, fullCount - t));
+
+	// The triangles of the levels of detail go in a block holding all of their corners already
+	// when there is one, and are then grouped by block so that narrowIndices cuts each submesh of
+	// a level into a range per block, not at every change of block
+	auto copyIn = [&](uint32_t vertex, uint32_t wanted) {
+		uint32_t copy = remap[vertex];
+		while (copy != none && blockOf[copy] > wanted)
+			copy = earlierCopy[copy];
+		return copy != none && blockOf[copy] == wanted ? copy : none;
+	};
+	std::vector<uint32_t> blocks;
+	std::vector<uint32_t> order;
+	std::vector<uint32_t> grouped;
+	for (const MeshLod &lod : mesh.lods) {
+		for (size_t s = 0; s + 1 < lod.firstIndex.size(); s++) {
+			uint32_t *indices = mesh.indices.data() + lod.firstIndex[s];
+			size_t triangleCount = (lod.firstIndex[s + 1] - lod.firstIndex[s]) / 3;
+			blocks.clear();
+			for (size_t t = 0; t < triangleCount; t++) {
+				uint32_t *corner = &indices[t * 3];
+				uint32_t found = none;
+				for (uint32_t copy = remap[corner[0]]; copy != none && found == none;
+					 copy = earlierCopy[copy]) {
+					uint32_t second = copyIn(corner[1], blockOf[copy]);
+					uint32_t third = copyIn(corner[2], blockOf[copy]);
+					if (second == none || third == none)
+						continue;
+					found = blockOf[copy];
+					corner[0] = copy;
+					corner[1] = second;
+					corner[2] = third;
+				}
+				if (found == none) {
+					addTriangle(corner, 3);
+					found = block;
+				}
+				blocks.push_back(found);
+			}
+
+			order.resize(triangleCount);
+			for (size_t t = 0; t < triangleCount; t++)
+				order[t] = static_cast<uint32_t>(t);
+			std::stable_sort(order.begin(), order.end(),
+							 [&](uint32_t a, uint32_t b) { return blocks[a] < blocks[b]; });
+			grouped.clear();
+			for (uint32_t t : order)
+				grouped.insert(grouped.end(), &indices[t * 3], &indices[t * 3] + 3);
+			std::copy(grouped.begin(), grouped.end(), indices);
+		}
+	}
+
+	for (size_t i = 0; i < mesh.vertices.size(); i++) {
+		if (remap[i] == none)
+			vertices.push_back(mesh.vertices[i]);
+	}
+	mesh.vertices = std::move(vertices);
+}
+
+void optimizeVertexCache(uint32_t *indices, size_t triangleCount,
+						 std::vector<uint32_t> &localIds) {
+	optimizeTriangles(indices, triangleCount, localIds);
+}
+
+// Misses of the triangles through FIFO caches of 8, 16 and 32 entries, the sizes scop_meshstat
+// reports, added up
+static size_t countMisses(const uint32_t *indices, size_t triangleCount,
+						  std::vector<FifoCache> &caches) {
+	size_t misses = 0;
+	for (FifoCache &cache : caches) {
+		cache.reset();
+		for (size_t i = 0; i < triangleCount * 3; i++)
+			misses += cache.miss(indices[i]);
+	}
+	return misses;
+}
+
+// Keeps the order the range came in when it already misses no more than the Forsyth order over
+// the three cache sizes. The sum is what gets compared, not every size alone: an order tuned for
+// one size can lose at another. Strips of patches that fit a 32-entry FIFO, like teapot.obj, miss
+// less there in file order (0.620 against 0.754) but thrash at 16 entries (1.029 against 0.759)
+// and 8, so they are reordered: a GPU whose post-transform cache holds 32 vertices pays about 20%
+// more vertex shading for them, one holding 16 or fewer gets it cut by a quarter.
+static void optimizeRange(uint32_t *indices, size_t triangleCount,
+						  std::vector<uint32_t> &localIds, std::vector<FifoCache> &caches,
+						  std::vector<uint32_t> &input) {
+	input.assign(indices, indices + triangleCount * 3);
+	size_t inputMisses = countMisses(indices, triangleCount, caches);
+	optimizeTriangles(indices, triangleCount, localIds);
+	if (inputMisses <= countMisses(indices, triangleCount, caches))
+		std::copy(input.begin(), input.end(), indices);
+}
+
+void optimizeVertexCache(Mesh &mesh) {
+	std::vector<uint32_t> localIds(mesh.vertices.size(), UINT32_MAX);
+	std::vector<FifoCache> caches;
+	for (unsigned size : {8u, 16u, 32u})
+		caches.emplace_back(mesh.vertices.size(), size);
+	std::vector<uint32_t> input;
+	// Meshlets cut the vertex cache order, reordering inside them gets most of the reuse back
+	if (!mesh.meshlets.empty()) {
+		for (const Meshlet &meshlet : mesh.meshlets)
+			optimizeRange(mesh.indices.data() + meshlet.indexOffset, meshlet.indexCount / 3,
+						  localIds, caches, input);
+		return;
+	}
+	for (const Submesh &submesh : mesh.submeshes)
+		optimizeRange(mesh.indices.data() + submesh.indexOffset, submesh.indexCount / 3, localIds,
+					  caches, input);
+}
+
+// First triangle of every cluster of the run, plus triangleCount at the end
+static std::vector<size_t> findClusters(const uint32_t *indices, size_t triangleCount,
+										float threshold, FifoCache &cache) {
+	// The vertex cache order restarts wherever a triangle misses on all of its vertices
+	std::vector<size_t> runs;
+	cache.reset();
+	for (size_t t = 0; t < triangleCount; t++) {
+		if (cache.missTriangle(&indices[t * 3]) == 3 || t == 0)
+			runs.push_back(t);
+	}
+	runs.push_back(triangleCount);
+
+	std::vector<size_t> clusters;
+	for (size_t r = 0; r + 1 < runs.size(); r++) {
+		size_t start = runs[r];
+		size_t end = runs[r + 1];
+		size_t misses = 0;
+		cache.reset();
+		for (size_t t = start; t < end; t++)
+			misses += cache.missTriangle(&indices[t * 3]);
+		float limit = threshold * misses / (end - start);
+
+		clusters.push_back(start);
+		cache.reset();
+		misses = 0;
+		for (size_t t = start; t + 1 < end; t++) {
+			misses += cache.missTriangle(&indices[t * 3]);
+			if (misses <= limit * (t + 1 - clusters.back())) {
+				clusters.push_back(t + 1);
+				cache.reset();
+				misses = 0;
+			}
+		}
+	}
+	clusters.push_back(triangleCount);
+	return clusters;
+}
+
+void optimizeOverdraw(Mesh &mesh, float threshold) {
+	const std::vector<Vertex> &vertices = mesh.vertices;
+	auto corner = [&](size_t index) { return vertices[mesh.indices[index]].pos; };
+
+	// Area weighted centers of every triangle, of the clusters and of the mesh
+	Vec3 meshCenter(0.0f, 0.0f, 0.0f);
+	float meshArea = 0.0f;
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+		Vec3 a = corner(i), b = corner(i + 1), c = corner(i + 2);
+		float area = (b - a).cross(c - a).length();
+		meshCenter += (a + b + c) * (area / 3.0f);
+		meshArea += area;
+	}
+	if (meshArea > 0.0f)
+		meshCenter /= meshArea;
+
+	FifoCache cache(vertices.size(), 16);
+	std::vector<uint32_t> reordered;
+	for (const Submesh &submesh : mesh.submeshes) {
+		uint32_t *indices = mesh.indices.data() + submesh.indexOffset;
+		std::vector<size_t> clusters =
+			findClusters(indices, submesh.indexCount / 3, threshold, cache);
+
+		std::vector<float> facing(clusters.size() - 1);
+		for (size_t k = 0; k + 1 < clusters.size(); k++) {
+			Vec3 center(0.0f, 0.0f, 0.0f);
+			Vec3 normal(0.0f, 0.0f, 0.0f);
+			float area = 0.0f;
+			for (size_t t = clusters[k]; t < clusters[k + 1]; t++) {
+				size_t i = submesh.indexOffset + t * 3;
+				Vec3 a = corner(i), b = corner(i + 1), c = corner(i + 2);
+				Vec3 cross = (b - a).cross(c - a);
+				float length = cross.length();
+				center += (a + b + c) * (length / 3.0f);
+				normal += cross;
+				area += length;
+			}
+			float normalLength = normal.length();
+			facing[k] = area > 0.0f && normalLength > 0.0f
+							? (center / area - meshCenter).dot(normal / normalLength)
+							: 0.0f;
+		}
+
+		std::vector<size_t> order(facing.size());
+		for (size_t k = 0; k < order.size(); k++)
+			order[k] = k;
+		std::stable_sort(order.begin(), order.end(),
+						 [&](size_t a, size_t b) { return facing[a] > facing[b]; });
+
+		reordered.clear();
+		for (size_t k : order)
+			reordered.insert(reordered.end(), indices + clusters[k] * 3,
+							 indices + clusters[k + 1] * 3);
+		std::copy(reordered.begin(), reordered.end(), indices);
+	}
+}
+
+MeshProcessStats processMesh(Mesh &mesh, const MeshSettings &settings,
+							 const MeshPassRunner &runner) {
+	MeshProcessStats stats;
+	auto runPass = [&](const char *pass, const std::function<void()> &run) {
+		if (runner)
+			runner(pass, run, stats);
+		else
+			run();
+	};
+
+	runPass("clean", [&]() {
+		stats.cleaned = cleanMesh(mesh, settings.weldEpsilon, settings.hasTexCoords,
+								  settings.hasNormals);
+	});
+	// The normals of the file are kept, like the streaming loader does
+	if (!settings.hasNormals) {
+		runPass("normals", [&]() {
+			size_t smoothVertexCount = mesh.vertices.size();
+			generateNormals(mesh, radians(settings.creaseAngle), settings.threads);
+			stats.generatedNormals = true;
+			stats.creaseVertices = mesh.vertices.size() - smoothVertexCount;
+		});
+	}
+	runPass("vcache", [&]() { optimizeVertexCache(mesh); });
+	runPass("overdraw", [&]() { optimizeOverdraw(mesh, settings.overdrawThreshold); });
+	// The meshlets regroup the triangles, each of them is then put back in vertex cache order
+	runPass("meshlets", [&]() {
+		buildMeshlets(mesh);
+		optimizeVertexCache(mesh);
+	});
+	runPass("lods", [&]() { buildLods(mesh, settings.threads); });
+	runPass("vfetch", [&]() { optimizeVertexFetch(mesh); });
+	return stats;
+}
@@ -0,0 +1,347 @@
+#include "meshlet.hpp"
+#include "flat_id_map.hpp"
+#include <algorithm>
+#include <cmath>
+
+// Unit normal of the triangle at indices[i], false when it has no area. Counter-clockwise
+// triangles are the front faces of the pipeline, so the normal points to the side they are seen
+// from.
+static bool triangleNormal(const Mesh &mesh, uint32_t i, Vec3 &normal) {
+	const Vec3 &a = mesh.vertices[mesh.indices[i]].pos;
+	const Vec3 &b = mesh.vertices[mesh.indices[i + 1]].pos;
+	const Vec3 &c = mesh.vertices[mesh.indices[i + 2]].pos;
+	Vec3 cross = (b - a).cross(c - a);
+	float length = cross.length();
+	if (!(length > 0.0f))
+		return false;
+	normal = cross / length;
+	return true;
+}
+
+// normals holds the normal of every triangle of the meshlet, zero for the ones without area
+static Meshlet makeMeshlet(const Mesh &mesh, uint32_t begin, uint32_t end, const Vec3 *normals) {
+	Meshlet meshlet{};
+	meshlet.indexOffset = begin;
+	meshlet.indexCount = end - begin;
+
+	// Sphere around the center of the box of the vertices
+	const Vec3 &first = mesh.vertices[mesh.indices[begin]].pos;
+	float min[3] = {first.x, first.y, first.z};
+	float max[3] = {first.x, first.y, first.z};
+	for (uint32_t i = begin; i < end; i++) {
+		const Vec3 &pos = mesh.vertices[mesh.indices[i]].pos;
+		const float p[3] = {pos.x, pos.y, pos.z};
+		for (int axis = 0; axis < 3; axis++) {
+			min[axis] = std::min(min[axis], p[axis]);
+			max[axis] = std::max(max[axis], p[axis]);
+		}
+	}
+	meshlet.center = Vec3((min[0] + max[0]) * 0.5f, (min[1] + max[1]) * 0.5f,
+						  (min[2] + max[2]) * 0.5f);
+	float radiusSquared = 0.0f;
+	for (uint32_t i = begin; i < end; i++) {
+		const Vec3 &pos = mesh.vertices[mesh.indices[i]].pos;
+		float dx = pos.x - meshlet.center.x;
+		float dy = pos.y - meshlet.center.y;
+		float dz = pos.z - meshlet.center.z;
+		radiusSquared = std::max(radiusSquared, dx * dx + dy * dy + dz * dz);
+	}
+	meshlet.radius = std::sqrt(radiusSquared);
+
+	// Cone around the mean of the triangle normals, as wide as the normal furthest from it
+	meshlet.coneCos = 0.0f;
+	meshlet.coneSin = 1.0f;
+	uint32_t triangleCount = meshlet.indexCount / 3;
+	float sum[3] = {0.0f, 0.0f, 0.0f};
+	for (uint32_t t = 0; t < triangleCount; t++) {
+		sum[0] += normals[t].x;
+		sum[1] += normals[t].y;
+		sum[2] += normals[t].z;
+	}
+	float length = std::sqrt(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+	if (!(length > 0.0f))
+		return meshlet;
+	meshlet.coneAxis = Vec3(sum[0] / length, sum[1] / length, sum[2] / length);
+	float minDot = 1.0f;
+	for (uint32_t t = 0; t < triangleCount; t++) {
+		const Vec3 &normal = normals[t];
+		if (normal.x != 0.0f || normal.y != 0.0f || normal.z != 0.0f)
+			minDot = std::min(minDot, normal.x * meshlet.coneAxis.x +
+										  normal.y * meshlet.coneAxis.y +
+										  normal.z * meshlet.coneAxis.z);
+	}
+	if (minDot > 0.0f) {
+		meshlet.coneCos = minDot;
+		meshlet.coneSin = std::sqrt(1.0f - minDot * minDot);
+	}
+	return meshlet;
+}
+
+// Numbers the values of ids densely in order of first use into dense, localIds maps them and is
+// all none on entry and on return. Returns how many there are.
+static uint32_t numberDensely(const uint32_t *ids, size_t count, std::vector<uint32_t> &localIds,
+							  std::vector<uint32_t> &dense) {
+	const uint32_t none = UINT32_MAX;
+	std::vector<uint32_t> seen;
+	dense.resize(count);
+	for (size_t i = 0; i < count; i++) {
+		uint32_t &local = localIds[ids[i]];
+		if (local == none) {
+			local = static_cast<uint32_t>(seen.size());
+			seen.push_back(ids[i]);
+		}
+		dense[i] = local;
+	}
+	for (uint32_t id : seen)
+		localIds[id] = none;
+	return static_cast<uint32_t>(seen.size());
+}
+
+// Grows the meshlets of the triangleCount triangles at mesh.indices[offset] and reorders them to
+// match. positionIds numbers the distinct positions of the mesh, localIds is all none on entry
+// and on return.
+static void growMeshlets(Mesh &mesh, uint32_t offset, uint32_t triangleCount,
+						 const std::vector<uint32_t> &positionIds, std::vector<uint32_t> &localIds) {
+	const uint32_t none = UINT32_MAX;
+	const uint32_t *indices = mesh.indices.data() + offset;
+	size_t cornerCount = static_cast<size_t>(triangleCount) * 3;
+
+	// Vertices and positions of the run numbered from 0 in order of use, so that the per vertex
+	// state below stays small and close together
+	std::vector<uint32_t> vertexOf;
+	std::vector<uint32_t> meshPositions(cornerCount);
+	for (size_t i = 0; i < cornerCount; i++)
+		meshPositions[i] = positionIds[indices[i]];
+	uint32_t vertexCount = numberDensely(indices, cornerCount, localIds, vertexOf);
+	std::vector<uint32_t> positionOf;
+	uint32_t positionCount =
+		numberDensely(meshPositions.data(), cornerCount, localIds, positionOf);
+
+	// Triangles around every position
+	std::vector<uint32_t> adjacencyStart(positionCount + 1, 0);
+	std::vector<uint32_t> adjacency(cornerCount);
+	for (uint32_t position : positionOf)
+		adjacencyStart[position + 1]++;
+	for (size_t p = 0; p < positionCount; p++)
+		adjacencyStart[p + 1] += adjacencyStart[p];
+	std::vector<uint32_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+	for (size_t i = 0; i < cornerCount; i++)
+		adjacency[fill[positionOf[i]]++] = static_cast<uint32_t>(i / 3);
+
+	std::vector<Vec3> normals(triangleCount);
+	for (uint32_t t = 0; t < triangleCount; t++)
+		triangleNormal(mesh, offset + t * 3, normals[t]);
+
+	// Meshlet that last used each vertex, which tells what a triangle adds to the current one
+	std::vector<uint32_t> lastMeshlet(vertexCount, none);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<uint32_t> candidateOf(triangleCount, none);
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> order;
+	std::vector<uint32_t> meshletEnds;
+	order.reserve(triangleCount);
+	uint32_t nextSeed = 0;
+
+	while (order.size() < triangleCount) {
+		uint32_t id = static_cast<uint32_t>(meshletEnds.size());
+		uint32_t meshletStart = static_cast<uint32_t>(order.size());
+		uint32_t meshletVertices = 0;
+		Vec3 normalSum;
+		candidates.clear();
+		while (emitted[nextSeed])
+			nextSeed++;
+		uint32_t triangle = nextSeed;
+
+		for (;;) {
+			emitted[triangle] = true;
+			order.push_back(triangle);
+			normalSum += normals[triangle];
+			for (uint32_t k = 0; k < 3; k++) {
+				uint32_t &last = lastMeshlet[vertexOf[triangle * 3 + k]];
+				if (last != id) {
+					last = id;
+					meshletVertices++;
+				}
+				uint32_t position = positionOf[triangle * 3 + k];
+				for (uint32_t a = adjacencyStart[position]; a < adjacencyStart[position + 1]; a++) {
+					uint32_t neighbour = adjacency[a];
+					if (!emitted[neighbour] && candidateOf[neighbour] != id) {
+						candidateOf[neighbour] = id;
+						candidates.push_back(neighbour);
+					}
+				}
+			}
+			if (order.size() - meshletStart == MESHLET_MAX_TRIANGLES)
+				break;
+
+			float length = normalSum.length();
+			Vec3 axis = length > 0.0f ? normalSum / length : normalSum;
+			uint32_t best = none;
+			uint32_t bestExtra = 0;
+			float bestSpread = 0.0f;
+			size_t kept = 0;
+			for (uint32_t candidate : candidates) {
+				if (emitted[candidate])
+					continue;
+				candidates[kept++] = candidate;
+				uint32_t extra = 0;
+				for (uint32_t k = 0; k < 3; k++)
+					extra += lastMeshlet[vertexOf[candidate * 3 + k]] != id;
+				if (meshletVertices + extra > MESHLET_MAX_VERTICES)
+					continue;
+				const Vec3 &normal = normals[candidate];
+				float spread = 1.0f - (normal.x * axis.x + normal.y * axis.y + normal.z * axis.z);
+				if (best == none || extra < bestExtra ||
+					(extra == bestExtra && spread < bestSpread)) {
+					best = candidate;
+					bestExtra = extra;
+					bestSpread = spread;
+				}
+			}
+			candidates.resize(kept);
+
+			// Nothing connected left: go on with the next triangle of the current order
+			if (best == none && candidates.empty() &&
+				meshletVertices + 3 <= MESHLET_MAX_VERTICES) {
+				while (nextSeed < triangleCount && emitted[nextSeed])
+					nextSeed++;
+				if (nextSeed < triangleCount)
+					best = nextSeed;
+			}
+			if (best == none)
+				break;
+			triangle = best;
+		}
+		meshletEnds.push_back(static_cast<uint32_t>(order.size()));
+	}
+
+	std::vector<uint32_t> reordered(cornerCount);
+	std::vector<Vec3> orderedNormals(triangleCount);
+	for (size_t i = 0; i < order.size(); i++) {
+		for (uint32_t k = 0; k < 3; k++)
+			reordered[i * 3 + k] = indices[order[i] * 3 + k];
+		orderedNormals[i] = normals[order[i]];
+	}
+	std::copy(reordered.begin(), reordered.end(), mesh.indices.begin() + offset);
+
+	uint32_t begin = 0;
+	for (uint32_t end : meshletEnds) {
+		mesh.meshlets.push_back(
+			makeMeshlet(mesh, offset + begin * 3, offset + end * 3, orderedNormals.data() + begin));
+		begin = end;
+	}
+}
+
+void buildMeshlets(Mesh &mesh) {
+	const uint32_t none = UINT32_MAX;
+	mesh.meshlets.clear();
+	mesh.firstMeshlet.clear();
+
+	// Vertices split by a texture seam are still neighbours, so triangles meet through positions
+	std::vector<uint32_t> positionIds(mesh.vertices.size());
+	FlatIdMap<Vertex, VertexHash> uniquePositions(mesh.vertices.size());
+	for (size_t v = 0; v < mesh.vertices.size(); v++) {
+		Vertex position{};
+		position.pos = mesh.vertices[v].pos;
+		bool isNew;
+		positionIds[v] = uniquePositions.insert(
+			position, static_cast<uint32_t>(uniquePositions.size()), isNew);
+	}
+
+	std::vector<uint32_t> localIds(mesh.vertices.size(), none);
+	for (const Submesh &submesh : mesh.submeshes) {
+		mesh.firstMeshlet.push_back(static_cast<uint32_t>(mesh.meshlets.size()));
+		growMeshlets(mesh, submesh.indexOffset, submesh.indexCount / 3, positionIds, localIds);
+	}
+	mesh.firstMeshlet.push_back(static_cast<uint32_t>(mesh.meshlets.size()));
+}
+
+MeshletCuller::MeshletCuller(const Mat4 &clip) {
+	// Row r of clip applied to a model space position is clip[0][r] * x + ... + clip[3][r]
+	auto row = [&](int r, int i) { return clip[i][r]; };
+	for (int i = 0; i < 4; i++) {
+		planes[0][i] = row(3, i) + row(0, i); // x >= -w
+		planes[1][i] = row(3, i) - row(0, i); // x <= w
+		planes[2][i] = row(3, i) + row(1, i); // y >= -w
+		planes[3][i] = row(3, i) - row(1, i); // y <= w
+		planes[4][i] = row(2, i);			  // z >= 0
+		planes[5][i] = row(3, i) - row(2, i); // z <= w
+	}
+	for (auto &plane : planes) {
+		float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+		if (length > 0.0f) {
+			for (float &coefficient : plane)
+				coefficient /= length;
+		}
+	}
+
+	// The eye is the one point clip sends to x = y = w = 0, solved with Cramer's rule
+	Vec3 a(row(0, 0), row(0, 1), row(0, 2));
+	Vec3 b(row(1, 0), row(1, 1), row(1, 2));
+	Vec3 c(row(3, 0), row(3, 1), row(3, 2));
+	float det = a.dot(b.cross(c));
+	if (det != 0.0f) {
+		eye = (b.cross(c) * -row(0, 3) + c.cross(a) * -row(1, 3) + a.cross(b) * -row(3, 3)) / det;
+		hasEye = true;
+	}
+}
+
+bool MeshletCuller::isVisible(const Meshlet &meshlet) const {
+	const Vec3 &center = meshlet.center;
+	for (const auto &plane : planes) {
+		if (plane[0] * center.x + plane[1] * center.y + plane[2] * center.z + plane[3] <
+			-meshlet.radius)
+			return false;
+	}
+	if (!hasEye)
+		return true;
+
+	// A triangle faces away when the eye is behind its plane. Over the sphere and the cone the
+	// smallest dot(position - eye, normal) is |d| cos(phi + half angle) - radius, with d from the
+	// eye to the center and phi the angle between d and the axis.
+	Vec3 d = center - eye;
+	float closest =
+		d.dot(meshlet.coneAxis) * meshlet.coneCos - d.cross(meshlet.coneAxis).length() * meshlet.coneSin;
+	return closest <= meshlet.radius;
+}
+
+bool MeshletCuller::isVisible(const MeshBounds &bounds) const {
+	const Vec3 &center = bounds.center;
+	for (const auto &plane : planes) {
+		if (plane[0] * center.x + plane[1] * center.y + plane[2] * center.z + plane[3] <
+			-bounds.radius)
+			return false;
+	}
+	return true;
+}
+
+void appendVisibleRanges(const Mesh &mesh, const IndexLayout &layout, size_t submesh,
+						 uint32_t level, const MeshletCuller *culler,
+						 std::vector<IndexRange> &ranges) {
+	size_t slot = level * mesh.submeshes.size() + submesh;
+	uint32_t r = layout.firstRange[slot];
+	if (!culler || level > 0 || mesh.firstMeshlet.empty()) {
+		ranges.insert(ranges.end(), layout.ranges.begin() + r,
+					  layout.ranges.begin() + layout.firstRange[slot + 1]);
+		return;
+	}
+
+	// Meshlets and ranges both cover the submesh in index buffer order
+	for (uint32_t m = mesh.firstMeshlet[submesh]; m < mesh.firstMeshlet[submesh + 1]; m++) {
+		const Meshlet &meshlet = mesh.meshlets[m];
+		if (!culler->isVisible(meshlet))
+			continue;
+		uint32_t start = meshlet.indexOffset;
+		uint32_t end = start + meshlet.indexCount;
+		while (layout.ranges[r].indexOffset + layout.ranges[r].indexCount <= start)
+			r++;
+		while (start < end) {
+			const IndexRange &range = layout.ranges[r];
+			uint32_t pieceEnd = std::min(end, range.indexOffset + range.indexCount);
+			ranges.push_back({start, pieceEnd - start, range.vertexOffset});
+			start = pieceEnd;
+			if (start < end)
+				r++;
+		}
+	}
+}
@@ -1,50 +1,241 @@
+#include "mesh_optimize.hpp"
 #include "objloader.hpp"
 #include "scop.hpp"
-#include <unordered_map>
+#include "vertex_kernels.hpp"
+#include <cstdio>
 
-void Scop::loadModel() {
-	std::vector<Vec3> temp_vertices;
+// Runs on a loading thread, so it only fills mesh and log and never touches Vulkan
+void Scop::loadModel(Mesh &mesh, std::ostream &log) {
+	auto start = std::chrono::steady_clock::now();
+	std::string cachePath = std::string(MODEL_PATH) + ".scopmesh";
+	uint64_t settings = options.meshCacheSettings();
 
-	if (!loadObj(MODEL_PATH, temp_vertices)) {
-		throw std::runtime_error("failed to load model!");
+	if (options.useMeshCache && readMeshCache(cachePath, MODEL_PATH, mesh, settings)) {
+		log << "Model loaded from " << cachePath << " in " << millisecondsSince(start) << " ms"
+			<< std::endl;
+		printSubmeshes(mesh, log);
+		printLods(mesh, log);
+		return;
 	}
 
-	std::unordered_map<Vertex, uint32_t> uniqueVertices{};
-
-	// Calculate center of mass
-	Vec3 sum(0.0f, 0.0f, 0.0f);
-	int vertexCount = temp_vertices.size();
+	loadObjModel(mesh, log);
+	log << "Model parsed from " << MODEL_PATH << " in " << millisecondsSince(start) << " ms"
+		<< std::endl;
+	printSubmeshes(mesh, log);
+	printLods(mesh, log);
 
-	for (const auto &vertex : temp_vertices) {
-		sum += vertex;
+	if (options.useMeshCache && !writeMeshCache(cachePath, MODEL_PATH, mesh, settings)) {
+		log << "Warning: could not write mesh cache " << cachePath << std::endl;
 	}
+}
 
-	Vec3 center = sum / (float)vertexCount;
+void Scop::loadObjModel(Mesh &mesh, std::ostream &log) {
+	ObjMesh objMesh;
 
-	for (auto &vertex : temp_vertices) {
-		vertex -= center;
+	if (!loadObj(MODEL_PATH, objMesh, 0, options.weld, log)) {
+		throw std::runtime_error("failed to load model!");
 	}
 
-	// Load vertices
-	for (size_t i = 0; i < temp_vertices.size(); i++) {
-		Vertex vertex{};
+	// The normals of the file are dropped before buildMesh when they are to be generated, or the
+	// vertices they split would stay split
+	if (options.generateNormals)
+		objMesh.normals.clear();
+	MeshSettings settings;
+	settings.weldEpsilon = options.weldEpsilon;
+	settings.creaseAngle = options.creaseAngle;
+	settings.overdrawThreshold = options.overdrawThreshold;
+	// buildMesh projects the texture coordinates when the file has none
+	settings.hasTexCoords = !objMesh.texCoords.empty();
+	settings.hasNormals = !objMesh.normals.empty();
+	buildMesh(objMesh, mesh);
+
+	// The clean and the normals are timed apart, every pass after them adds to one total
+	VertexCacheStats before = {};
+	double fetchBefore = 0.0;
+	double cleanTime = 0.0, normalsTime = 0.0, optimizeTime = 0.0;
+	auto timePass = [&](const char *pass, const std::function<void()> &run,
+						const MeshProcessStats &) {
+		if (strcmp(pass, "vcache") == 0) {
+			before = analyzeVertexCache(mesh.indices, mesh.vertices.size());
+			fetchBefore = analyzeVertexFetch(mesh.indices, mesh.vertices.size(), sizeof(Vertex));
+		}
+		auto start = std::chrono::steady_clock::now();
+		run();
+		double time = millisecondsSince(start);
+		if (strcmp(pass, "clean") == 0)
+			cleanTime = time;
+		else if (strcmp(pass, "normals") == 0)
+			normalsTime = time;
+		else
+			optimizeTime += time;
+	};
+	MeshProcessStats processed = processMesh(mesh, settings, timePass);
+
+	const MeshCleanStats &cleaned = processed.cleaned;
+	log << "Clean: " << cleaned.weldedVertices << " vertices welded, " << cleaned.unusedVertices
+		<< " unused, " << cleaned.degenerateTriangles << " degenerate and "
+		<< cleaned.duplicateTriangles << " duplicate triangles removed in " << cleanTime << " ms"
+		<< std::endl;
+	if (processed.generatedNormals)
+		log << "Normals: " << processed.creaseVertices << " vertices split at creases in "
+			<< normalsTime << " ms" << std::endl;
+	else
+		log << "Normals: from the OBJ file" << std::endl;
 
-		vertex.pos = temp_vertices[i];
-		vertex.color = {1.0f, 1.0f, 1.0f};
+	std::vector<uint32_t> full(mesh.indices.begin(), mesh.indices.begin() + fullIndexCount(mesh));
+	VertexCacheStats after = analyzeVertexCache(full, mesh.vertices.size());
+	double fetchAfter = analyzeVertexFetch(full, mesh.vertices.size(), sizeof(Vertex));
+	char stats[192];
+	snprintf(stats, sizeof(stats),
+			 "Vertex cache: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, overfetch %.2f -> %.2f, "
+			 "%zu meshlets, %zu levels of detail",
+			 before.acmr, after.acmr, before.atvr, after.atvr, fetchBefore, fetchAfter,
+			 mesh.meshlets.size(), mesh.lods.size());
+	log << stats << " in " << optimizeTime << " ms" << std::endl;
+}
+
+// Streams the OBJ straight into the device-local buffers. The file is read in windows and every
+// batch of finished vertices / indices goes through one persistently mapped staging buffer. Only
+// those take about options.streamBudget bytes: the OBJ attributes and the weld table on top of
+// them still grow with the file.
+// Vertices are not merged by value and nothing is cached, both would need the whole mesh; only
+// the submesh table and the names end up in model.
+void Scop::loadStreamedModel() {
+	auto start = std::chrono::steady_clock::now();
+
+	// Roughly an eighth of the budget for the text window and a quarter for the corners parsed
+	// from it, a quarter for the batch being built and a quarter for the staging buffer
+	const size_t budget = std::max<size_t>(options.streamBudget, 1 << 20);
+	ObjStreamLimits limits;
+	limits.windowSize = budget / 8;
+	limits.batchVertices = budget / 8 / sizeof(Vertex);
+	limits.batchIndices = budget / 8 / sizeof(uint32_t);
+
+	VkDeviceSize stagingVertexSize = limits.batchVertices * sizeof(Vertex);
+	VkDeviceSize stagingSize = stagingVertexSize + limits.batchIndices * sizeof(uint32_t);
+	VkBuffer stagingBuffer;
+	VkDeviceMemory stagingBufferMemory;
+	createBuffer(stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				 stagingBuffer, stagingBufferMemory);
+	void *data;
+	vkMapMemory(device, stagingBufferMemory, 0, stagingSize, 0, &data);
+	Vertex *stagingVertices = static_cast<Vertex *>(data);
+	uint32_t *stagingIndices =
+		reinterpret_cast<uint32_t *>(static_cast<char *>(data) + stagingVertexSize);
+
+	Vec3 center;
+	bool hasTexCoords = false;
+	bool hasNormals = false;
+	VkDeviceSize vertexOffset = 0;
+	VkDeviceSize indexOffset = 0;
+
+	auto begin = [&](const ObjStreamInfo &info) {
+		if (info.vertexCount == 0 || info.indexCount > UINT32_MAX) {
+			throw std::runtime_error("failed to load model!");
+		}
+		// Centered on the box like buildMesh does, so the bounds are known before any vertex
+		center = info.bounds.center;
+		model.bounds = info.bounds;
+		translateBounds(model.bounds, center);
+		hasTexCoords = info.hasTexCoords;
+		hasNormals = info.hasNormals;
+		indexCount = static_cast<uint32_t>(info.indexCount);
+		model.submeshes = info.submeshes;
+		for (auto &submesh : model.submeshes)
+			translateBounds(submesh.bounds, center);
+		model.materials = info.materials;
+		model.materialLibraries = info.materialLibraries;
+		indexLayout = wideIndexLayout(model);
+		createBuffer(info.vertexCount * sizeof(Vertex),
+					 VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+					 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
+		createBuffer(info.indexCount * sizeof(uint32_t),
+					 VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+					 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
+	};
 
-		computeUVs(vertex);
-		if (uniqueVertices.count(vertex) == 0) {
-			uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-			vertices.push_back(vertex);
+	std::vector<Vec3> positions;
+	std::vector<Vec2> texCoords;
+	auto emit = [&](const ObjMesh &batch) {
+		positions.assign(batch.positions.begin(), batch.positions.end());
+		translatePositions(positions.data(), positions.size(), center);
+		if (!hasTexCoords) {
+			texCoords.resize(positions.size());
+			sphericalUVs(positions.data(), positions.size(), texCoords.data());
 		}
-		indices.push_back(uniqueVertices[vertex]);
+		for (size_t i = 0; i < batch.positions.size(); i++) {
+			Vertex vertex{};
+
+			vertex.pos = positions[i];
+			vertex.texCoord = hasTexCoords ? batch.texCoords[i] : texCoords[i];
+			// No normals without the whole mesh, but the ones the OBJ has are used
+			if (hasNormals)
+				vertex.normal = batch.normals[i];
+			stagingVertices[i] = vertex;
+		}
+		memcpy(stagingIndices, batch.indices.data(), batch.indices.size() * sizeof(uint32_t));
+
+		VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+		VkBufferCopy vertexRegion{0, vertexOffset, batch.positions.size() * sizeof(Vertex)};
+		VkBufferCopy indexRegion{stagingVertexSize, indexOffset,
+								 batch.indices.size() * sizeof(uint32_t)};
+		if (vertexRegion.size > 0)
+			vkCmdCopyBuffer(commandBuffer, stagingBuffer, vertexBuffer, 1, &vertexRegion);
+		vkCmdCopyBuffer(commandBuffer, stagingBuffer, indexBuffer, 1, &indexRegion);
+		endSingleTimeCommands(commandBuffer);
+
+		vertexOffset += vertexRegion.size;
+		indexOffset += indexRegion.size;
+	};
+
+	auto releaseStaging = [&]() {
+		vkUnmapMemory(device, stagingBufferMemory);
+		vkDestroyBuffer(device, stagingBuffer, nullptr);
+		vkFreeMemory(device, stagingBufferMemory, nullptr);
+	};
+	// begin and emit throw, and so may the loader itself, the staging buffer goes either way
+	bool loaded;
+	try {
+		loaded = streamObj(MODEL_PATH, limits, begin, emit);
+	} catch (...) {
+		releaseStaging();
+		throw;
+	}
+	releaseStaging();
+	if (!loaded) {
+		throw std::runtime_error("failed to load model!");
+	}
+
+	std::cout << "Model streamed from " << MODEL_PATH << " in " << millisecondsSince(start)
+			  << " ms (" << vertexOffset / sizeof(Vertex) << " vertices, " << indexCount
+			  << " indices)" << std::endl;
+	printSubmeshes(model, std::cout);
+}
+
+void Scop::loadMaterials(const Mesh &mesh, std::vector<GpuMaterial> &materials,
+						 std::ostream &log) {
+	size_t found = buildMaterialTable(mesh, MODEL_PATH, materials, log);
+	if (found < mesh.materials.size()) {
+		log << mesh.materials.size() - found
+			<< " materials not found in the material libraries, drawn in white" << std::endl;
 	}
 }
 
-void Scop::computeUVs(Vertex &vertex) {
-	float theta = atan2(vertex.pos.z, vertex.pos.x) / (2 * M_PI);
-	float phi = acos(vertex.pos.y / vertex.pos.length()) / M_PI;
+void Scop::printSubmeshes(const Mesh &mesh, std::ostream &log) {
+	if (mesh.submeshes.size() <= 1)
+		return;
+	log << mesh.submeshes.size() << " submeshes, " << mesh.materials.size()
+		<< " materials (Tab to view them one by one)" << std::endl;
+}
 
-	vertex.texCoord.s = theta + 0.5f;
-	vertex.texCoord.t = phi;
+void Scop::printLods(const Mesh &mesh, std::ostream &log) {
+	if (mesh.lods.empty())
+		return;
+	log << "Levels of detail (L to turn them off):";
+	for (const MeshLod &lod : mesh.lods) {
+		log << " " << (lod.firstIndex.back() - lod.firstIndex.front()) / 3 << " triangles (error "
+			<< lod.error << ")";
+	}
+	log << std::endl;
 }
@@ -0,0 +1,117 @@
+#include "mtlloader.hpp"
+#include "mapped_file.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+// MTL files are a few kilobytes at most, so unlike the OBJ loader this one simply copies every
+// statement out of the mapping and converts it with strtof.
+
+static inline bool isBlank(char c) {
+	return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Up to count floats, returns how many were read. The rest of the line must be blank.
+static int parseFloats(const std::string &text, float *out, int count) {
+	const char *p = text.c_str();
+	int read = 0;
+	while (read < count) {
+		char *next;
+		float value = strtof(p, &next);
+		if (next == p)
+			break;
+		out[read++] = value;
+		p = next;
+	}
+	while (isBlank(*p))
+		p++;
+	return *p == '\0' ? read : 0;
+}
+
+// "Kd r [g b]", a single value is a grey
+static bool parseColor(const std::string &text, Vec3 &out) {
+	float rgb[3];
+	int count = parseFloats(text, rgb, 3);
+	if (count == 1)
+		out = Vec3(rgb[0], rgb[0], rgb[0]);
+	else if (count == 3)
+		out = Vec3(rgb[0], rgb[1], rgb[2]);
+	return count == 1 || count == 3;
+}
+
+bool loadMtl(const char *filepath, std::vector<MtlMaterial> &materials, std::ostream &log) {
+	MappedFile file(filepath);
+
+	if (!file.isOpen()) {
+		log << "Cannot open mtl file " << filepath << "\n";
+		return false;
+	}
+
+	const char *p = file.data();
+	const char *end = p + file.size();
+	MtlMaterial *material = nullptr;
+	size_t line = 0;
+
+	while (p < end) {
+		line++;
+		const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+		if (!eol)
+			eol = end;
+		while (p < eol && isBlank(*p))
+			p++;
+		const char *keyEnd = p;
+		while (keyEnd < eol && !isBlank(*keyEnd))
+			keyEnd++;
+		std::string key(p, keyEnd);
+		const char *valueEnd = eol;
+		while (valueEnd > keyEnd && isBlank(valueEnd[-1]))
+			valueEnd--;
+		while (keyEnd < valueEnd && isBlank(*keyEnd))
+			keyEnd++;
+		std::string value(keyEnd, valueEnd);
+		p = eol + (eol < end);
+
+		if (key == "newmtl") {
+			materials.push_back(MtlMaterial());
+			material = &materials.back();
+			material->name = value;
+			continue;
+		}
+		// Comments, blank lines and statements before the first newmtl
+		if (material == nullptr || key.empty() || key[0] == '#')
+			continue;
+
+		bool ok = true;
+		float number = 0.0f;
+		if (key == "Kd") {
+			ok = parseColor(value, material->diffuse);
+		} else if (key == "Ks") {
+			ok = parseColor(value, material->specular);
+		} else if (key == "Ns") {
+			ok = parseFloats(value, &number, 1) == 1;
+			if (ok)
+				material->shininess = number;
+		} else if (key == "d") {
+			ok = parseFloats(value, &number, 1) == 1;
+			if (ok)
+				material->dissolve = number;
+		} else if (key == "Tr") {
+			// Transparency, the opposite of d
+			ok = parseFloats(value, &number, 1) == 1;
+			if (ok)
+				material->dissolve = 1.0f - number;
+		} else if (key == "map_Kd") {
+			// Options like "-s 1 1 1" come first, the file name is the last word
+			size_t nameStart = value.find_last_of(" \t");
+			material->diffuseMap = value.substr(nameStart == std::string::npos ? 0 : nameStart + 1);
+			ok = !material->diffuseMap.empty();
+		}
+		// Forms this loader does not read, like "Kd spectral file.spd", "Kd xyz x y z" or
+		// "d -halo 0.5", keep the default of the statement and the rest of the library is read
+		if (!ok) {
+			log << "Skipping line " << line << " of " << filepath << " in material "
+				<< material->name << ": " << key << " " << value << "\n";
+		}
+	}
+	return true;
+}
@@ -0,0 +1,399 @@
+#include "normals.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <cmath>
+
+// Items handed to a thread at a time, small enough for the last ones to even out
+static const size_t CHUNK_SIZE = 16384;
+
+// acos to within 7e-5 radians (Abramowitz and Stegun 4.4.45), plenty for a weight
+static float fastAcos(float x) {
+	x = std::min(std::max(x, -1.0f), 1.0f);
+	float a = std::fabs(x);
+	float angle =
+		std::sqrt(1.0f - a) * (1.5707288f + a * (-0.2121144f + a * (0.0742610f - 0.0187293f * a)));
+	return x < 0.0f ? 3.14159265f - angle : angle;
+}
+
+// A triangle around a vertex: its unit normal, and its normal weighted by area and corner angle
+struct FanCorner {
+	float unit[3];
+	float weighted[3];
+	bool degenerate;
+};
+
+static float dot3(const float *a, const float *b) {
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// Adds the weighted normals of the corners within the crease of unit to sum
+static void sumWithin(const std::vector<FanCorner> &fan, const float *unit, float creaseCos,
+					  float sum[3]) {
+	sum[0] = sum[1] = sum[2] = 0.0f;
+	for (const FanCorner &other : fan) {
+		if (other.degenerate || (unit && dot3(unit, other.unit) < creaseCos))
+			continue;
+		sum[0] += other.weighted[0];
+		sum[1] += other.weighted[1];
+		sum[2] += other.weighted[2];
+	}
+}
+
+// Fans of more corners than this compare directions quantized to OCT_CELLS x OCT_CELLS cells of
+// an octahedral map, about 4 degrees across, instead of every pair of corners: a pole of a scan
+// can gather thousands of triangles, and stays at most OCT_CELLS^2 squared dot products.
+static const size_t MAX_EXACT_FAN = 64;
+static const int OCT_CELLS = 32;
+
+// Octahedral cell of a unit vector, and the unit vector at the center of a cell
+static uint32_t octCell(const float *unit) {
+	float l1 = std::fabs(unit[0]) + std::fabs(unit[1]) + std::fabs(unit[2]);
+	float u = unit[0] / l1, v = unit[1] / l1;
+	if (unit[2] < 0.0f) {
+		float fu = (1.0f - std::fabs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+		v = (1.0f - std::fabs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+		u = fu;
+	}
+	int x = std::min(static_cast<int>((u + 1.0f) * 0.5f * OCT_CELLS), OCT_CELLS - 1);
+	int y = std::min(static_cast<int>((v + 1.0f) * 0.5f * OCT_CELLS), OCT_CELLS - 1);
+	return static_cast<uint32_t>(y * OCT_CELLS + x);
+}
+
+static void octCellCenter(uint32_t cell, float unit[3]) {
+	float u = ((cell % OCT_CELLS) + 0.5f) * 2.0f / OCT_CELLS - 1.0f;
+	float v = ((cell / OCT_CELLS) + 0.5f) * 2.0f / OCT_CELLS - 1.0f;
+	float z = 1.0f - std::fabs(u) - std::fabs(v);
+	float fold = std::max(-z, 0.0f);
+	u += u >= 0.0f ? -fold : fold;
+	v += v >= 0.0f ? -fold : fold;
+	float length = std::sqrt(u * u + v * v + z * z);
+	unit[0] = u / length;
+	unit[1] = v / length;
+	unit[2] = z / length;
+}
+
+// The distinct normals of the corners of one vertex, in order of first corner, and the one each
+// corner takes. The corners agree in the common case of a smooth vertex, then all take normal 0.
+class FanBuilder {
+public:
+	FanBuilder(const Mesh &mesh, const std::vector<float> &crosses, float creaseCos)
+		: mesh(mesh), crosses(crosses), creaseCos(creaseCos),
+		  halfCreaseCos(creaseCos > -1.0f ? std::sqrt((1.0f + creaseCos) * 0.5f) : -2.0f) {}
+
+	void build(const uint32_t *corners, size_t cornerCount) {
+		fan.resize(cornerCount);
+		for (size_t i = 0; i < cornerCount; i++)
+			fan[i] = fanCorner(corners[i]);
+
+		normals.clear();
+		slots.assign(cornerCount, 0);
+		float sum[3];
+		if (withinHalfCrease() || (cornerCount <= MAX_EXACT_FAN && pairwiseSmooth())) {
+			sumWithin(fan, nullptr, creaseCos, sum);
+			addNormal(sum);
+			return;
+		}
+		if (cornerCount > MAX_EXACT_FAN) {
+			buildQuantized();
+			return;
+		}
+		// Two corners at least are not degenerate, the degenerate ones take the first normal
+		for (size_t i = 0; i < cornerCount; i++) {
+			if (fan[i].degenerate)
+				continue;
+			sumWithin(fan, fan[i].unit, creaseCos, sum);
+			slots[i] = addNormal(sum);
+		}
+	}
+
+	std::vector<Vec3> normals;
+	std::vector<uint32_t> slots;
+
+private:
+	// The corners of a large fan that fall in one octahedral cell
+	struct Group {
+		float unit[3]; // center of the cell
+		float weighted[3];
+		float sum[3];
+		uint32_t slot;
+	};
+
+	// Every corner within half the crease angle of their mean direction, so any two are within the
+	// crease of each other. Settles most vertices, poles included, in one pass.
+	bool withinHalfCrease() const {
+		float mean[3] = {0.0f, 0.0f, 0.0f};
+		bool degenerate = true;
+		for (const FanCorner &corner : fan) {
+			if (corner.degenerate)
+				continue;
+			degenerate = false;
+			for (int i = 0; i < 3; i++)
+				mean[i] += corner.unit[i];
+		}
+		float length = std::sqrt(dot3(mean, mean));
+		if (!(length > 0.0f))
+			return degenerate;
+		for (int i = 0; i < 3; i++)
+			mean[i] /= length;
+		for (const FanCorner &corner : fan) {
+			if (!corner.degenerate && dot3(corner.unit, mean) < halfCreaseCos)
+				return false;
+		}
+		return true;
+	}
+
+	bool pairwiseSmooth() const {
+		for (size_t i = 0; i < fan.size(); i++) {
+			for (size_t j = 0; j < i; j++) {
+				if (!fan[i].degenerate && !fan[j].degenerate &&
+					dot3(fan[i].unit, fan[j].unit) < creaseCos)
+					return false;
+			}
+		}
+		return true;
+	}
+
+	// The corners of a large fan are grouped by octahedral cell, and each group takes the sum of
+	// the groups whose cell centers are within the crease of its own
+	void buildQuantized() {
+		order.clear();
+		for (size_t i = 0; i < fan.size(); i++) {
+			if (!fan[i].degenerate)
+				order.push_back({octCell(fan[i].unit), static_cast<uint32_t>(i)});
+		}
+		std::sort(order.begin(), order.end());
+		groups.clear();
+		cornerGroup.assign(fan.size(), 0);
+		for (size_t k = 0; k < order.size(); k++) {
+			if (k == 0 || order[k].first != order[k - 1].first) {
+				Group group = {};
+				octCellCenter(order[k].first, group.unit);
+				group.slot = UINT32_MAX;
+				groups.push_back(group);
+			}
+			Group &group = groups.back();
+			const FanCorner &corner = fan[order[k].second];
+			for (int i = 0; i < 3; i++)
+				group.weighted[i] += corner.weighted[i];
+			cornerGroup[order[k].second] = static_cast<uint32_t>(groups.size() - 1);
+		}
+		for (Group &group : groups) {
+			for (const Group &other : groups) {
+				if (dot3(group.unit, other.unit) < creaseCos)
+					continue;
+				for (int i = 0; i < 3; i++)
+					group.sum[i] += other.weighted[i];
+			}
+		}
+		for (size_t i = 0; i < fan.size(); i++) {
+			if (fan[i].degenerate)
+				continue;
+			Group &group = groups[cornerGroup[i]];
+			if (group.slot == UINT32_MAX)
+				group.slot = addNormal(group.sum);
+			slots[i] = group.slot;
+		}
+	}
+
+	FanCorner fanCorner(uint32_t corner) const {
+		FanCorner result;
+		uint32_t t = corner / 3;
+		const float *cross = &crosses[t * 3];
+		float length = std::sqrt(dot3(cross, cross));
+		result.degenerate = !(length > 0.0f);
+		if (result.degenerate)
+			return result;
+
+		const uint32_t *triangle = &mesh.indices[t * 3];
+		uint32_t k = corner - t * 3;
+		const Vec3 &a = mesh.vertices[triangle[k]].pos;
+		const Vec3 &b = mesh.vertices[triangle[(k + 1) % 3]].pos;
+		const Vec3 &c = mesh.vertices[triangle[(k + 2) % 3]].pos;
+		float ab[3] = {b.x - a.x, b.y - a.y, b.z - a.z};
+		float ac[3] = {c.x - a.x, c.y - a.y, c.z - a.z};
+		float lengths = std::sqrt(dot3(ab, ab) * dot3(ac, ac));
+		float angle = lengths > 0.0f ? fastAcos(dot3(ab, ac) / lengths) : 0.0f;
+		for (int i = 0; i < 3; i++) {
+			result.unit[i] = cross[i] / length;
+			result.weighted[i] = cross[i] * angle;
+		}
+		return result;
+	}
+
+	// Index of the normalized sum among the normals, added when it is new
+	uint32_t addNormal(const float sum[3]) {
+		float length = std::sqrt(dot3(sum, sum));
+		Vec3 normal;
+		if (length > 0.0f)
+			normal = Vec3(sum[0] / length, sum[1] / length, sum[2] / length);
+		for (size_t i = 0; i < normals.size(); i++) {
+			if (normals[i].x == normal.x && normals[i].y == normal.y && normals[i].z == normal.z)
+				return static_cast<uint32_t>(i);
+		}
+		normals.push_back(normal);
+		return static_cast<uint32_t>(normals.size() - 1);
+	}
+
+	const Mesh &mesh;
+	const std::vector<float> &crosses;
+	float creaseCos;
+	float halfCreaseCos;
+	std::vector<FanCorner> fan;
+	std::vector<std::pair<uint32_t, uint32_t>> order; // cell and corner of a large fan
+	std::vector<Group> groups;
+	std::vector<uint32_t> cornerGroup;
+};
+
+void generateNormals(Mesh &mesh, float creaseAngle, unsigned threads) {
+	const size_t vertexCount = mesh.vertices.size();
+	const size_t cornerCount = mesh.indices.size() / 3 * 3;
+	const size_t triangleCount = cornerCount / 3;
+	const std::vector<Vertex> &vertices = mesh.vertices;
+	const std::vector<uint32_t> &indices = mesh.indices;
+	// At 180 degrees or more every triangle is within the crease of every other one
+	float creaseCos = creaseAngle < 3.14159265f ? std::cos(creaseAngle) : -2.0f;
+
+	// (b - a) x (c - a) of every triangle, its normal times twice its area
+	std::vector<float> crosses(cornerCount);
+	parallelFor(
+		(triangleCount + CHUNK_SIZE - 1) / CHUNK_SIZE,
+		[&](size_t chunk) {
+			size_t end = std::min(triangleCount, (chunk + 1) * CHUNK_SIZE);
+			for (size_t t = chunk * CHUNK_SIZE; t < end; t++) {
+				const Vec3 &a = vertices[indices[t * 3]].pos;
+				const Vec3 &b = vertices[indices[t * 3 + 1]].pos;
+				const Vec3 &c = vertices[indices[t * 3 + 2]].pos;
+				float ab[3] = {b.x - a.x, b.y - a.y, b.z - a.z};
+				float ac[3] = {c.x - a.x, c.y - a.y, c.z - a.z};
+				crosses[t * 3] = ab[1] * ac[2] - ab[2] * ac[1];
+				crosses[t * 3 + 1] = ab[2] * ac[0] - ab[0] * ac[2];
+				crosses[t * 3 + 2] = ab[0] * ac[1] - ab[1] * ac[0];
+			}
+		},
+		threads);
+
+	// The corners around vertex v are vertexCorners[firstCorner[v]..firstCorner[v + 1]), in
+	// corner order. A two level counting sort with no shared counters: every block of corners
+	// counts how many it has in each range of vertices and files them there, then every range
+	// counts and files its own corners by vertex. Each pass reads every corner once.
+	size_t parts = std::min<size_t>(threads ? threads : workerCount(),
+									std::max<size_t>(vertexCount, 1));
+	size_t partSize = std::max<size_t>((vertexCount + parts - 1) / parts, 1);
+	size_t blockCount = parts * 4;
+	auto blockStart = [&](size_t block) { return cornerCount * block / blockCount; };
+	std::vector<uint32_t> blockParts(blockCount * parts, 0);
+	parallelFor(
+		blockCount,
+		[&](size_t block) {
+			uint32_t *counts = &blockParts[block * parts];
+			for (size_t i = blockStart(block); i < blockStart(block + 1); i++)
+				counts[indices[i] / partSize]++;
+		},
+		threads);
+	// blockParts becomes where each block files the corners of each range, ranges first
+	std::vector<uint32_t> partCorner(parts + 1, 0);
+	uint32_t total = 0;
+	for (size_t part = 0; part < parts; part++) {
+		partCorner[part] = total;
+		for (size_t block = 0; block < blockCount; block++) {
+			uint32_t count = blockParts[block * parts + part];
+			blockParts[block * parts + part] = total;
+			total += count;
+		}
+	}
+	partCorner[parts] = total;
+	std::vector<uint32_t> partCorners(cornerCount);
+	parallelFor(
+		blockCount,
+		[&](size_t block) {
+			uint32_t *cursor = &blockParts[block * parts];
+			for (size_t i = blockStart(block); i < blockStart(block + 1); i++)
+				partCorners[cursor[indices[i] / partSize]++] = static_cast<uint32_t>(i);
+		},
+		threads);
+	std::vector<uint32_t>().swap(blockParts);
+
+	std::vector<uint32_t> firstCorner(vertexCount + 1, 0);
+	std::vector<uint32_t> vertexCorners(cornerCount);
+	std::vector<uint32_t> cursor(vertexCount);
+	firstCorner[vertexCount] = static_cast<uint32_t>(cornerCount);
+	parallelFor(
+		parts,
+		[&](size_t part) {
+			size_t begin = std::min(vertexCount, part * partSize);
+			size_t end = std::min(vertexCount, begin + partSize);
+			const uint32_t *corners = &partCorners[partCorner[part]];
+			size_t count = partCorner[part + 1] - partCorner[part];
+			for (size_t v = begin; v < end; v++)
+				cursor[v] = 0;
+			for (size_t i = 0; i < count; i++)
+				cursor[indices[corners[i]]]++;
+			uint32_t next = partCorner[part];
+			for (size_t v = begin; v < end; v++) {
+				firstCorner[v] = next;
+				next += cursor[v];
+				cursor[v] = firstCorner[v];
+			}
+			for (size_t i = 0; i < count; i++)
+				vertexCorners[cursor[indices[corners[i]]]++] = corners[i];
+		},
+		threads);
+	std::vector<uint32_t>().swap(cursor);
+	std::vector<uint32_t>().swap(partCorners);
+
+	// Every vertex takes its first normal, and counts the copies the others need
+	size_t vertexChunks = (vertexCount + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	std::vector<uint32_t> firstCopy(vertexCount + 1, 0);
+	parallelFor(
+		vertexChunks,
+		[&](size_t chunk) {
+			FanBuilder builder(mesh, crosses, creaseCos);
+			size_t end = std::min(vertexCount, (chunk + 1) * CHUNK_SIZE);
+			for (size_t v = chunk * CHUNK_SIZE; v < end; v++) {
+				builder.build(&vertexCorners[firstCorner[v]], firstCorner[v + 1] - firstCorner[v]);
+				mesh.vertices[v].normal = builder.normals[0];
+				firstCopy[v + 1] = static_cast<uint32_t>(builder.normals.size() - 1);
+			}
+		},
+		threads);
+	for (size_t v = 0; v < vertexCount; v++)
+		firstCopy[v + 1] += firstCopy[v];
+	if (firstCopy[vertexCount] == 0)
+		return;
+
+	// The copies go after the vertices, in the order of the vertex they copy. The fans read the
+	// indices, so the corners that move to a copy are only rewritten once every fan is done; a
+	// corner belongs to one vertex, so each rewrite is listed by one chunk.
+	mesh.vertices.resize(vertexCount + firstCopy[vertexCount]);
+	std::vector<std::vector<std::pair<uint32_t, uint32_t>>> rewrites(vertexChunks);
+	parallelFor(
+		vertexChunks,
+		[&](size_t chunk) {
+			FanBuilder builder(mesh, crosses, creaseCos);
+			size_t end = std::min(vertexCount, (chunk + 1) * CHUNK_SIZE);
+			for (size_t v = chunk * CHUNK_SIZE; v < end; v++) {
+				if (firstCopy[v] == firstCopy[v + 1])
+					continue;
+				const uint32_t *corners = &vertexCorners[firstCorner[v]];
+				builder.build(corners, firstCorner[v + 1] - firstCorner[v]);
+				uint32_t copy = static_cast<uint32_t>(vertexCount + firstCopy[v]) - 1;
+				for (size_t i = 1; i < builder.normals.size(); i++) {
+					mesh.vertices[copy + i].pos = mesh.vertices[v].pos;
+					mesh.vertices[copy + i].texCoord = mesh.vertices[v].texCoord;
+					mesh.vertices[copy + i].normal = builder.normals[i];
+				}
+				for (size_t i = 0; i < builder.slots.size(); i++) {
+					if (builder.slots[i] > 0)
+						rewrites[chunk].push_back({corners[i], copy + builder.slots[i]});
+				}
+			}
+		},
+		threads);
+	parallelFor(
+		vertexChunks,
+		[&](size_t chunk) {
+			for (const std::pair<uint32_t, uint32_t> &rewrite : rewrites[chunk])
+				mesh.indices[rewrite.first] = rewrite.second;
+		},
+		threads);
+}
@@ -0,0 +1,1004 @@
+#include "objloader.hpp"
+#include "flat_id_map.hpp"
+#include "mapped_file.hpp"
+#include "parallel.hpp"
+#include <atomic>
+#include <cstdint>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+
+// The file is mmapped and walked in place: records are recognised by their first character,
+// numbers are converted straight from the mapped bytes, and nothing is copied out per token.
+// Large files are cut into newline-aligned chunks that are parsed on all cores and merged.
+// streamObj reuses the same chunk parser on windows read one after the other instead.
+
+static const double pow10Table[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+									1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+									1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+static inline bool isBlank(char c) {
+	return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static inline bool isDigit(char c) {
+	return static_cast<unsigned char>(c - '0') < 10;
+}
+
+static inline bool isTokenEnd(const char *p, const char *end) {
+	return p == end || isBlank(*p) || *p == '\n';
+}
+
+static inline void skipBlanks(const char *&p, const char *end) {
+	while (p < end && isBlank(*p))
+		p++;
+}
+
+static inline void skipLine(const char *&p, const char *end) {
+	const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+	p = eol ? eol + 1 : end;
+}
+
+// Decimal to float without strtof for the usual case: up to 15 significant digits fit a double
+// exactly, and one multiplication or division by an exact power of ten up to 1e22 rounds them
+// once to the nearest double. Rounding that to float can still be one ulp off strtof when the
+// double lands right between two floats. Longer mantissas and larger exponents go to strtof.
+static bool parseFloat(const char *&p, const char *end, float &out) {
+	const char *s = p;
+	bool negative = false;
+	if (s < end && (*s == '-' || *s == '+')) {
+		negative = *s == '-';
+		s++;
+	}
+
+	uint64_t mantissa = 0;
+	int digits = 0;
+	int exponent = 0;
+	bool any = false;
+
+	for (; s < end && isDigit(*s); s++, any = true) {
+		if (digits < 19) {
+			mantissa = mantissa * 10 + (*s - '0');
+			digits += mantissa != 0;
+		} else {
+			exponent++;
+		}
+	}
+	if (s < end && *s == '.') {
+		for (s++; s < end && isDigit(*s); s++, any = true) {
+			if (digits < 19) {
+				mantissa = mantissa * 10 + (*s - '0');
+				digits += mantissa != 0;
+				exponent--;
+			}
+		}
+	}
+	if (!any)
+		return false;
+
+	if (s < end && (*s == 'e' || *s == 'E')) {
+		const char *e = s + 1;
+		bool negativeExp = false;
+		if (e < end && (*e == '-' || *e == '+')) {
+			negativeExp = *e == '-';
+			e++;
+		}
+		if (e < end && isDigit(*e)) {
+			int value = 0;
+			for (; e < end && isDigit(*e); e++) {
+				if (value < 10000)
+					value = value * 10 + (*e - '0');
+			}
+			exponent += negativeExp ? -value : value;
+			s = e;
+		}
+	}
+
+	if (digits > 15 || exponent < -22 || exponent > 22) {
+		// The text is not null terminated, strtof reads a copy of the number
+		char buffer[128];
+		size_t length = static_cast<size_t>(s - p);
+		if (length >= sizeof(buffer))
+			return false;
+		memcpy(buffer, p, length);
+		buffer[length] = '\0';
+		out = strtof(buffer, nullptr);
+		p = s;
+		return true;
+	}
+
+	double value = static_cast<double>(mantissa);
+	if (exponent < 0)
+		value /= pow10Table[-exponent];
+	else if (exponent > 0)
+		value *= pow10Table[exponent];
+
+	out = static_cast<float>(negative ? -value : value);
+	p = s;
+	return true;
+}
+
+// OBJ indices are 1-based. Negative values count back from the last vertex read so far, which a
+// chunk cannot resolve on its own, so they come back as an offset from the chunk's first vertex.
+static bool parseIndex(const char *&p, const char *end, size_t vertexCount, int64_t &out,
+					   bool &relative) {
+	const char *s = p;
+	bool negative = false;
+	if (s < end && *s == '-') {
+		negative = true;
+		s++;
+	}
+	if (s == end || !isDigit(*s))
+		return false;
+
+	uint64_t value = 0;
+	for (; s < end && isDigit(*s); s++) {
+		value = value * 10 + (*s - '0');
+		if (value > UINT32_MAX)
+			return false;
+	}
+	if (value == 0)
+		return false;
+	relative = negative;
+	out = negative ? static_cast<int64_t>(vertexCount) - static_cast<int64_t>(value)
+				   : static_cast<int64_t>(value - 1);
+	p = s;
+	return true;
+}
+
+// Negative face index that points before the chunk, patched once the chunk bases are known
+struct RelativeIndex {
+	size_t corner;
+	int stream;
+	int64_t offset;
+};
+
+// "o" / "g" / "usemtl" / "mtllib" record, applied before the corner it precedes
+struct ObjRecord {
+	enum Kind { Name, Material, Library };
+
+	Kind kind;
+	size_t corner;
+	std::string value;
+};
+
+// Result of parsing one newline-aligned slice of the file
+struct ObjChunk {
+	std::vector<Vec3> positions;
+	std::vector<Vec2> texCoords;
+	std::vector<Vec3> normals;
+	std::vector<ObjCorner> corners;
+	std::vector<RelativeIndex> relativeIndices;
+	std::vector<ObjRecord> records;
+	size_t positionBase = 0;
+	size_t texCoordBase = 0;
+	size_t normalBase = 0;
+	size_t cornerBase = 0;
+	bool hasTexCoords = false;
+	bool hasNormals = false;
+	const char *error = nullptr;
+};
+
+// One "v", "v/vt", "v//vn" or "v/vt/vn" reference of a face, indexed by stream
+struct PolygonCorner {
+	int64_t index[3];
+	uint8_t present;
+	uint8_t relative;
+};
+
+static bool parseCorner(const char *&p, const char *end, const ObjChunk &chunk,
+						PolygonCorner &corner) {
+	const size_t counts[3] = {chunk.positions.size(), chunk.texCoords.size(),
+							  chunk.normals.size()};
+	corner.present = 0;
+	corner.relative = 0;
+	for (int stream = 0; stream < 3; stream++) {
+		if (stream > 0) {
+			if (p == end || *p != '/')
+				break;
+			p++;
+			if (stream == 1 && p < end && *p == '/')
+				continue;
+		}
+		bool relative;
+		if (!parseIndex(p, end, counts[stream], corner.index[stream], relative))
+			return false;
+		corner.present |= 1 << stream;
+		corner.relative |= relative << stream;
+	}
+	return isTokenEnd(p, end);
+}
+
+static inline bool isRecord(const char *p, const char *end, const char *name, size_t length) {
+	return static_cast<size_t>(end - p) > length && memcmp(p, name, length) == 0 &&
+		   isBlank(p[length]);
+}
+
+static bool parseFloats(const char *&p, const char *end, float *out, int count) {
+	for (int i = 0; i < count; i++) {
+		skipBlanks(p, end);
+		if (!parseFloat(p, end, out[i]) || !isTokenEnd(p, end))
+			return false;
+	}
+	return true;
+}
+
+static bool parseVec3(const char *&p, const char *end, Vec3 &out) {
+	float values[3];
+	if (!parseFloats(p, end, values, 3))
+		return false;
+	out = Vec3(values[0], values[1], values[2]);
+	return true;
+}
+
+// Records the blank-separated words up to the end of the line, or the whole trimmed rest of the
+// line when words is false (names may contain spaces)
+static void parseNames(const char *p, const char *end, ObjRecord::Kind kind, bool words,
+					   ObjChunk &chunk) {
+	const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+	if (!eol)
+		eol = end;
+	while (true) {
+		skipBlanks(p, eol);
+		if (p == eol)
+			return;
+		const char *last = p;
+		while (last < eol && (!words || !isBlank(*last)))
+			last++;
+		const char *trimmed = last;
+		while (trimmed > p && isBlank(trimmed[-1]))
+			trimmed--;
+		chunk.records.push_back({kind, chunk.corners.size(), std::string(p, trimmed)});
+		p = last;
+	}
+}
+
+static void parseChunk(const char *p, const char *end, ObjChunk &chunk) {
+	std::vector<PolygonCorner> polygon;
+
+	while (p < end) {
+		skipBlanks(p, end);
+		if (p == end)
+			break;
+
+		if (isRecord(p, end, "v", 1)) {
+			p += 2;
+			Vec3 position;
+			if (!parseVec3(p, end, position)) {
+				chunk.error = "Error while reading vertices data\n";
+				return;
+			}
+			chunk.positions.push_back(position);
+		} else if (isRecord(p, end, "vt", 2)) {
+			// "vt u [v [w]]", v defaults to 0 and w is ignored
+			p += 3;
+			Vec2 texCoord;
+			if (!parseFloats(p, end, &texCoord.s, 1)) {
+				chunk.error = "Error while reading texture coordinates\n";
+				return;
+			}
+			skipBlanks(p, end);
+			if (p < end && *p != '\n' && !parseFloats(p, end, &texCoord.t, 1)) {
+				chunk.error = "Error while reading texture coordinates\n";
+				return;
+			}
+			chunk.texCoords.push_back(texCoord);
+		} else if (isRecord(p, end, "vn", 2)) {
+			p += 3;
+			Vec3 normal;
+			if (!parseVec3(p, end, normal)) {
+				chunk.error = "Error while reading normals\n";
+				return;
+			}
+			chunk.normals.push_back(normal);
+		} else if (isRecord(p, end, "f", 1)) {
+			p += 2;
+			polygon.clear();
+			while (true) {
+				skipBlanks(p, end);
+				if (p == end || *p == '\n')
+					break;
+				PolygonCorner corner;
+				if (!parseCorner(p, end, chunk, corner)) {
+					chunk.error = "Error while reading face indices\n";
+					return;
+				}
+				polygon.push_back(corner);
+			}
+
+			for (size_t i = 1; i + 1 < polygon.size(); i++) {
+				for (const PolygonCorner *corner : {&polygon[0], &polygon[i], &polygon[i + 1]}) {
+					uint32_t index[3];
+					for (int stream = 0; stream < 3; stream++) {
+						index[stream] = (corner->present >> stream) & 1
+											? static_cast<uint32_t>(corner->index[stream])
+											: ObjCorner::none;
+						if ((corner->relative >> stream) & 1)
+							chunk.relativeIndices.push_back(
+								{chunk.corners.size(), stream, corner->index[stream]});
+					}
+					chunk.hasTexCoords |= index[1] != ObjCorner::none;
+					chunk.hasNormals |= index[2] != ObjCorner::none;
+					chunk.corners.push_back({index[0], index[1], index[2]});
+				}
+			}
+		} else if (isRecord(p, end, "o", 1) || isRecord(p, end, "g", 1)) {
+			parseNames(p + 2, end, ObjRecord::Name, false, chunk);
+		} else if (isRecord(p, end, "usemtl", 6)) {
+			parseNames(p + 7, end, ObjRecord::Material, false, chunk);
+		} else if (isRecord(p, end, "mtllib", 6)) {
+			parseNames(p + 7, end, ObjRecord::Library, true, chunk);
+		}
+		// Anything else (comments, s, l...) and the rest of this line is skipped
+		skipLine(p, end);
+	}
+}
+
+// Cuts [begin, end) into up to count slices that each start at the beginning of a line
+static std::vector<const char *> splitLines(const char *begin, const char *end, size_t count) {
+	std::vector<const char *> bounds{begin};
+	size_t size = end - begin;
+	for (size_t i = 1; i < count; i++) {
+		const char *p = std::max(begin + size * i / count, bounds.back());
+		if (p > begin && p[-1] != '\n')
+			skipLine(p, end);
+		if (p > bounds.back() && p < end)
+			bounds.push_back(p);
+	}
+	bounds.push_back(end);
+	return bounds;
+}
+
+// Gives every distinct (v, vt, vn) corner a vertex id, in order of first use. As long as no
+// corner references "vt" or "vn" a corner is just its position index and a flat remap table is
+// enough; the first one that does moves the ids over to a hash table keyed on the triple.
+class CornerWelder {
+public:
+	explicit CornerWelder(bool hashed = false) : hashed(hashed) {}
+
+	void reserve(size_t positionCount) {
+		if (hashed)
+			byCorner.reserve(positionCount);
+		else
+			byPosition.reserve(positionCount);
+	}
+
+	size_t size() const { return count; }
+
+	// Returns the id of corner, isNew is set when this is its first use
+	uint32_t weld(const ObjCorner &corner, bool &isNew) {
+		if (!hashed && (corner.vt != ObjCorner::none || corner.vn != ObjCorner::none))
+			rehash();
+		if (hashed) {
+			uint32_t vertex = byCorner.insert(corner, count, isNew);
+			count += isNew;
+			return vertex;
+		}
+		if (corner.v >= byPosition.size())
+			byPosition.resize(corner.v + 1, ObjCorner::none);
+		uint32_t &vertex = byPosition[corner.v];
+		isNew = vertex == ObjCorner::none;
+		if (isNew)
+			vertex = count++;
+		return vertex;
+	}
+
+	// Id of a corner welded before, ObjCorner::none if it never was
+	uint32_t find(const ObjCorner &corner) const {
+		if (hashed)
+			return byCorner.find(corner);
+		bool plain = corner.vt == ObjCorner::none && corner.vn == ObjCorner::none;
+		return plain && corner.v < byPosition.size() ? byPosition[corner.v] : ObjCorner::none;
+	}
+
+private:
+	bool hashed;
+	uint32_t count = 0;
+	std::vector<uint32_t> byPosition;
+	FlatIdMap<ObjCorner, ObjCornerHash> byCorner;
+
+	void rehash() {
+		byCorner.reserve(byPosition.size());
+		for (size_t v = 0; v < byPosition.size(); v++) {
+			bool isNew;
+			if (byPosition[v] != ObjCorner::none)
+				byCorner.insert({static_cast<uint32_t>(v), ObjCorner::none, ObjCorner::none},
+								byPosition[v], isNew);
+		}
+		std::vector<uint32_t>().swap(byPosition);
+		hashed = true;
+	}
+};
+
+// Patches the negative indices of a chunk whose bases are set and checks every corner against
+// the attribute counts. Returns the error message, nullptr if the corners are valid.
+static const char *resolveCorners(ObjChunk &chunk, size_t positionCount, size_t texCoordCount,
+								  size_t normalCount) {
+	const size_t bases[3] = {chunk.positionBase, chunk.texCoordBase, chunk.normalBase};
+	for (const RelativeIndex &relative : chunk.relativeIndices) {
+		int64_t index = static_cast<int64_t>(bases[relative.stream]) + relative.offset;
+		if (index < 0)
+			return "Error while reading face indices\n";
+		ObjCorner &corner = chunk.corners[relative.corner];
+		uint32_t &target = relative.stream == 0   ? corner.v
+						   : relative.stream == 1 ? corner.vt
+												  : corner.vn;
+		target = static_cast<uint32_t>(index);
+	}
+	for (const ObjCorner &corner : chunk.corners) {
+		if (corner.v >= positionCount ||
+			(corner.vt != ObjCorner::none && corner.vt >= texCoordCount) ||
+			(corner.vn != ObjCorner::none && corner.vn >= normalCount))
+			return "Face index out of range\n";
+	}
+	return nullptr;
+}
+
+// Appends the attributes of a welded corner's first use to mesh
+static void emitVertex(const ObjCorner &corner, const std::vector<Vec3> &positions,
+					   const std::vector<Vec2> &texCoords, const std::vector<Vec3> &normals,
+					   bool hasTexCoords, bool hasNormals, ObjMesh &mesh) {
+	mesh.positions.push_back(positions[corner.v]);
+	if (hasTexCoords)
+		mesh.texCoords.push_back(corner.vt != ObjCorner::none ? texCoords[corner.vt] : Vec2());
+	if (hasNormals)
+		mesh.normals.push_back(corner.vn != ObjCorner::none ? normals[corner.vn] : Vec3());
+}
+
+// Cuts the corner stream into submeshes wherever the "o" / "g" name or the "usemtl" material
+// changes, and collects the material and library names. Chunks are added in file order.
+class SubmeshBuilder {
+public:
+	SubmeshBuilder() { resetBounds(); }
+
+	void add(const ObjChunk &chunk, const std::vector<Vec3> &positions) {
+		size_t record = 0;
+		for (size_t i = 0; i <= chunk.corners.size(); i++) {
+			for (; record < chunk.records.size() && chunk.records[record].corner == i; record++)
+				apply(chunk.records[record], chunk.cornerBase + i);
+			if (i < chunk.corners.size())
+				include(positions[chunk.corners[i].v]);
+		}
+	}
+
+	void finish(size_t cornerCount, std::vector<Submesh> &submeshes,
+				std::vector<std::string> &materials, std::vector<std::string> &libraries) {
+		cut(cornerCount);
+		// The vertices of a range are not kept, buildMesh tightens the spheres when it has them
+		for (Submesh &range : ranges)
+			sphereAroundBox(range.bounds);
+		submeshes = std::move(ranges);
+		materials = std::move(materialNames);
+		libraries = std::move(libraryNames);
+	}
+
+private:
+	std::vector<Submesh> ranges;
+	std::vector<std::string> materialNames;
+	std::vector<std::string> libraryNames;
+	std::unordered_map<std::string, uint32_t> materialIds;
+	std::string name;
+	uint32_t material = NO_MATERIAL;
+	size_t start = 0;
+	MeshBounds bounds;
+
+	void apply(const ObjRecord &record, size_t corner) {
+		if (record.kind == ObjRecord::Library) {
+			libraryNames.push_back(record.value);
+			return;
+		}
+		cut(corner);
+		if (record.kind == ObjRecord::Name) {
+			name = record.value;
+		} else {
+			auto inserted =
+				materialIds.emplace(record.value, static_cast<uint32_t>(materialNames.size()));
+			if (inserted.second)
+				materialNames.push_back(record.value);
+			material = inserted.first->second;
+		}
+	}
+
+	void include(const Vec3 &position) {
+		for (int i = 0; i < 3; i++) {
+			bounds.min[i] = std::min(bounds.min[i], position[i]);
+			bounds.max[i] = std::max(bounds.max[i], position[i]);
+		}
+	}
+
+	// Closes the range [start, corner) under the current name and material
+	void cut(size_t corner) {
+		if (corner == start)
+			return;
+		Submesh *last = ranges.empty() ? nullptr : &ranges.back();
+		if (last && last->name == name && last->material == material) {
+			last->indexCount += static_cast<uint32_t>(corner - start);
+			for (int i = 0; i < 3; i++) {
+				last->bounds.min[i] = std::min(last->bounds.min[i], bounds.min[i]);
+				last->bounds.max[i] = std::max(last->bounds.max[i], bounds.max[i]);
+			}
+		} else {
+			ranges.push_back({name, material, static_cast<uint32_t>(start),
+							  static_cast<uint32_t>(corner - start), bounds});
+		}
+		start = corner;
+		resetBounds();
+	}
+
+	void resetBounds() {
+		const float inf = std::numeric_limits<float>::infinity();
+		bounds.min = Vec3(inf, inf, inf);
+		bounds.max = Vec3(-inf, -inf, -inf);
+	}
+};
+
+// Welds the corners of every chunk, in file order, into unique (v, vt, vn) vertices
+static void weldCorners(std::vector<ObjChunk> &chunks, const std::vector<Vec3> &positions,
+						const std::vector<Vec2> &texCoords, const std::vector<Vec3> &normals,
+						bool hasTexCoords, bool hasNormals, ObjMesh &mesh) {
+	CornerWelder welder(hasTexCoords || hasNormals);
+	welder.reserve(positions.size());
+	for (ObjChunk &chunk : chunks) {
+		for (const ObjCorner &corner : chunk.corners) {
+			bool isNew;
+			uint32_t vertex = welder.weld(corner, isNew);
+			if (isNew)
+				emitVertex(corner, positions, texCoords, normals, hasTexCoords, hasNormals, mesh);
+			mesh.indices.push_back(vertex);
+		}
+		std::vector<ObjCorner>().swap(chunk.corners);
+	}
+}
+
+// Same vertices and indices as weldCorners, but every pass runs on all threads. The corners are
+// bucketed by position index with a counting sort, then each bucket is sorted on (vt, vn, corner):
+// equal corners form runs led by their first use. Numbering the run leaders in file order, with a
+// prefix sum, gives the first use order weldCorners produces.
+static void weldCornersSorted(std::vector<ObjChunk> &chunks, size_t cornerCount,
+							  const std::vector<Vec3> &positions,
+							  const std::vector<Vec2> &texCoords, const std::vector<Vec3> &normals,
+							  bool hasTexCoords, bool hasNormals, ObjMesh &mesh, unsigned threads) {
+	const size_t positionCount = positions.size();
+	const size_t blockCount = static_cast<size_t>(threads ? threads : workerCount()) * 4;
+	auto blockStart = [&](size_t count, size_t block) { return count * block / blockCount; };
+
+	std::vector<ObjCorner> corners(cornerCount);
+	parallelFor(
+		chunks.size(),
+		[&](size_t i) {
+			std::copy(chunks[i].corners.begin(), chunks[i].corners.end(),
+					  corners.begin() + chunks[i].cornerBase);
+			std::vector<ObjCorner>().swap(chunks[i].corners);
+		},
+		threads);
+
+	// Counting sort on v: count the corners of every position, turn the counts into bucket
+	// starts, then scatter the corner indices. Corners land in a bucket in any order.
+	std::unique_ptr<std::atomic<uint32_t>[]> fill(new std::atomic<uint32_t>[positionCount]());
+	parallelFor(
+		blockCount,
+		[&](size_t block) {
+			for (size_t c = blockStart(cornerCount, block); c < blockStart(cornerCount, block + 1);
+				 c++)
+				fill[corners[c].v].fetch_add(1, std::memory_order_relaxed);
+		},
+		threads);
+	std::vector<uint32_t> bucketStart(positionCount + 1);
+	uint32_t total = 0;
+	for (size_t v = 0; v < positionCount; v++) {
+		bucketStart[v] = total;
+		total += fill[v].load(std::memory_order_relaxed);
+		fill[v].store(bucketStart[v], std::memory_order_relaxed);
+	}
+	bucketStart[positionCount] = total;
+	std::vector<uint32_t> order(cornerCount);
+	parallelFor(
+		blockCount,
+		[&](size_t block) {
+			for (size_t c = blockStart(cornerCount, block); c < blockStart(cornerCount, block + 1);
+				 c++)
+				order[fill[corners[c].v].fetch_add(1, std::memory_order_relaxed)] =
+					static_cast<uint32_t>(c);
+		},
+		threads);
+	fill.reset();
+
+	// Until the final scatter mesh.indices holds the leader of every corner's run, and ids flags
+	// the leaders
+	mesh.indices.resize(cornerCount);
+	std::vector<uint32_t> ids(cornerCount, 0);
+	auto less = [&](uint32_t a, uint32_t b) {
+		const ObjCorner &first = corners[a];
+		const ObjCorner &second = corners[b];
+		if (first.vt != second.vt)
+			return first.vt < second.vt;
+		if (first.vn != second.vn)
+			return first.vn < second.vn;
+		return a < b;
+	};
+	parallelFor(
+		blockCount,
+		[&](size_t block) {
+			for (size_t v = blockStart(positionCount, block);
+				 v < blockStart(positionCount, block + 1); v++) {
+				uint32_t *run = order.data() + bucketStart[v];
+				uint32_t *last = order.data() + bucketStart[v + 1];
+				std::sort(run, last, less);
+				while (run < last) {
+					uint32_t leader = *run;
+					ids[leader] = 1;
+					do
+						mesh.indices[*run++] = leader;
+					while (run < last && corners[*run] == corners[leader]);
+				}
+			}
+		},
+		threads);
+	std::vector<uint32_t>().swap(order);
+
+	// Exclusive prefix sum of the flags, block totals first
+	std::vector<uint32_t> blockIds(blockCount + 1, 0);
+	parallelFor(
+		blockCount,
+		[&](size_t block) {
+			uint32_t count = 0;
+			for (size_t c = blockStart(cornerCount, block); c < blockStart(cornerCount, block + 1);
+				 c++)
+				count += ids[c];
+			blockIds[block + 1] = count;
+		},
+		threads);
+	for (size_t block = 0; block < blockCount; block++)
+		blockIds[block + 1] += blockIds[block];
+	parallelFor(
+		blockCount,
+		[&](size_t block) {
+			uint32_t next = blockIds[block];
+			for (size_t c = blockStart(cornerCount, block); c < blockStart(cornerCount, block + 1);
+				 c++) {
+				if (ids[c])
+					ids[c] = next++;
+			}
+		},
+		threads);
+
+	// Leaders write their vertex, every corner swaps its leader for the leader's id
+	uint32_t vertexCount = blockIds[blockCount];
+	mesh.positions.resize(vertexCount);
+	if (hasTexCoords)
+		mesh.texCoords.resize(vertexCount);
+	if (hasNormals)
+		mesh.normals.resize(vertexCount);
+	parallelFor(
+		blockCount,
+		[&](size_t block) {
+			for (size_t c = blockStart(cornerCount, block); c < blockStart(cornerCount, block + 1);
+				 c++) {
+				uint32_t vertex = ids[mesh.indices[c]];
+				if (mesh.indices[c] == c) {
+					const ObjCorner &corner = corners[c];
+					mesh.positions[vertex] = positions[corner.v];
+					if (hasTexCoords)
+						mesh.texCoords[vertex] =
+							corner.vt != ObjCorner::none ? texCoords[corner.vt] : Vec2();
+					if (hasNormals)
+						mesh.normals[vertex] =
+							corner.vn != ObjCorner::none ? normals[corner.vn] : Vec3();
+				}
+				mesh.indices[c] = vertex;
+			}
+		},
+		threads);
+}
+
+bool loadObj(const char *filepath, ObjMesh &mesh, unsigned threads, ObjWeld weld,
+			 std::ostream &log) {
+	MappedFile file(filepath);
+
+	if (!file.isOpen()) {
+		log << "Cannot open obj file\n";
+		return false;
+	}
+
+	// Small files are not worth a thread each
+	const size_t minChunkSize = 1 << 20;
+	size_t chunkCount = std::min<size_t>(threads ? threads : workerCount(),
+										 file.size() / minChunkSize + 1);
+	std::vector<const char *> bounds =
+		splitLines(file.data(), file.data() + file.size(), chunkCount);
+	std::vector<ObjChunk> chunks(bounds.size() - 1);
+
+	parallelFor(
+		chunks.size(), [&](size_t i) { parseChunk(bounds[i], bounds[i + 1], chunks[i]); },
+		threads);
+
+	// Prefix sums give every chunk its place in the merged attribute streams
+	size_t positionCount = 0;
+	size_t texCoordCount = 0;
+	size_t normalCount = 0;
+	size_t cornerCount = 0;
+	bool hasTexCoords = false;
+	bool hasNormals = false;
+	for (ObjChunk &chunk : chunks) {
+		if (chunk.error) {
+			log << chunk.error;
+			return false;
+		}
+		chunk.positionBase = positionCount;
+		chunk.texCoordBase = texCoordCount;
+		chunk.normalBase = normalCount;
+		chunk.cornerBase = cornerCount;
+		positionCount += chunk.positions.size();
+		texCoordCount += chunk.texCoords.size();
+		normalCount += chunk.normals.size();
+		cornerCount += chunk.corners.size();
+		hasTexCoords |= chunk.hasTexCoords;
+		hasNormals |= chunk.hasNormals;
+	}
+
+	std::vector<Vec3> positions(positionCount);
+	std::vector<Vec2> texCoords(texCoordCount);
+	std::vector<Vec3> normals(normalCount);
+	parallelFor(
+		chunks.size(),
+		[&](size_t i) {
+			ObjChunk &chunk = chunks[i];
+			std::copy(chunk.positions.begin(), chunk.positions.end(),
+					  positions.begin() + chunk.positionBase);
+			std::copy(chunk.texCoords.begin(), chunk.texCoords.end(),
+					  texCoords.begin() + chunk.texCoordBase);
+			std::copy(chunk.normals.begin(), chunk.normals.end(),
+					  normals.begin() + chunk.normalBase);
+			std::vector<Vec3>().swap(chunk.positions);
+			std::vector<Vec2>().swap(chunk.texCoords);
+			std::vector<Vec3>().swap(chunk.normals);
+
+			chunk.error = resolveCorners(chunk, positionCount, texCoordCount, normalCount);
+		},
+		threads);
+
+	for (const ObjChunk &chunk : chunks) {
+		if (chunk.error) {
+			log << chunk.error;
+			return false;
+		}
+	}
+
+	SubmeshBuilder submeshes;
+	for (const ObjChunk &chunk : chunks)
+		submeshes.add(chunk, positions);
+
+	// The sorted weld needs a few bytes more per corner than the hash table, and only beats it
+	// once the mesh is big enough to keep every thread busy
+	const size_t minSortedCorners = 1 << 22;
+	bool sorted = weld == ObjWeld::Sort || (weld == ObjWeld::Auto &&
+											cornerCount >= minSortedCorners &&
+											(threads ? threads : workerCount()) > 1);
+	mesh = ObjMesh();
+	if (sorted) {
+		weldCornersSorted(chunks, cornerCount, positions, texCoords, normals, hasTexCoords,
+						  hasNormals, mesh, threads);
+	} else {
+		mesh.indices.reserve(cornerCount);
+		weldCorners(chunks, positions, texCoords, normals, hasTexCoords, hasNormals, mesh);
+	}
+	submeshes.finish(cornerCount, mesh.submeshes, mesh.materials, mesh.materialLibraries);
+	return true;
+}
+
+// Reads a file through one buffer, handing it out as runs of whole lines. The unfinished line at
+// the end of a window is moved to the front of the buffer for the next one; a single line longer
+// than the buffer grows it.
+class LineWindowReader {
+public:
+	LineWindowReader(const char *filepath, size_t windowSize)
+		: fd(open(filepath, O_RDONLY)), buffer(std::max<size_t>(windowSize, 4096)) {}
+	~LineWindowReader() {
+		if (fd != -1)
+			close(fd);
+	}
+
+	LineWindowReader(const LineWindowReader &) = delete;
+	LineWindowReader &operator=(const LineWindowReader &) = delete;
+
+	bool isOpen() const { return fd != -1; }
+	bool failed() const { return readError; }
+
+	bool rewind() {
+		filled = consumed = 0;
+		atEnd = false;
+		return lseek(fd, 0, SEEK_SET) == 0;
+	}
+
+	// Sets [begin, end) to the next window, false once the file is exhausted or unreadable
+	bool next(const char *&begin, const char *&end) {
+		memmove(buffer.data(), buffer.data() + consumed, filled - consumed);
+		filled -= consumed;
+		consumed = 0;
+
+		while (true) {
+			while (!atEnd && filled < buffer.size()) {
+				ssize_t count = read(fd, buffer.data() + filled, buffer.size() - filled);
+				if (count < 0 && errno == EINTR)
+					continue;
+				if (count < 0) {
+					readError = true;
+					return false;
+				}
+				atEnd = count == 0;
+				filled += count;
+			}
+			if (filled == 0)
+				return false;
+
+			const char *last =
+				static_cast<const char *>(memrchr(buffer.data(), '\n', filled));
+			if (atEnd || last != nullptr) {
+				consumed = atEnd ? filled : last + 1 - buffer.data();
+				begin = buffer.data();
+				end = buffer.data() + consumed;
+				return true;
+			}
+			buffer.resize(buffer.size() * 2);
+		}
+	}
+
+private:
+	int fd;
+	std::vector<char> buffer;
+	size_t filled = 0;
+	size_t consumed = 0;
+	bool atEnd = false;
+	bool readError = false;
+};
+
+// Parses the next window into chunk, reusing its storage, and places it after the attributes
+// counted so far. Returns the error message, nullptr on success.
+static const char *parseWindow(const char *begin, const char *end, size_t positionCount,
+							   size_t texCoordCount, size_t normalCount, size_t cornerCount,
+							   ObjChunk &chunk) {
+	chunk.positions.clear();
+	chunk.texCoords.clear();
+	chunk.normals.clear();
+	chunk.corners.clear();
+	chunk.relativeIndices.clear();
+	chunk.records.clear();
+	chunk.hasTexCoords = chunk.hasNormals = false;
+	chunk.error = nullptr;
+
+	parseChunk(begin, end, chunk);
+	if (chunk.error)
+		return chunk.error;
+	chunk.positionBase = positionCount;
+	chunk.texCoordBase = texCoordCount;
+	chunk.normalBase = normalCount;
+	chunk.cornerBase = cornerCount;
+	return resolveCorners(chunk, positionCount + chunk.positions.size(),
+						  texCoordCount + chunk.texCoords.size(),
+						  normalCount + chunk.normals.size());
+}
+
+bool streamObj(const char *filepath, const ObjStreamLimits &limits,
+			   const std::function<void(const ObjStreamInfo &)> &begin,
+			   const std::function<void(const ObjMesh &)> &emit) {
+	LineWindowReader reader(filepath, limits.windowSize);
+
+	if (!reader.isOpen()) {
+		std::cout << "Cannot open obj file\n";
+		return false;
+	}
+
+	// First pass: attribute pools, corner welding and counts
+	std::vector<Vec3> positions;
+	std::vector<Vec2> texCoords;
+	std::vector<Vec3> normals;
+	CornerWelder welder;
+	SubmeshBuilder submeshes;
+	ObjStreamInfo info{};
+	std::vector<bool> used;
+	ObjChunk chunk;
+	const char *windowBegin;
+	const char *windowEnd;
+
+	while (reader.next(windowBegin, windowEnd)) {
+		const char *error = parseWindow(windowBegin, windowEnd, positions.size(),
+										texCoords.size(), normals.size(), info.indexCount, chunk);
+		if (error) {
+			std::cout << error;
+			return false;
+		}
+		positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+		texCoords.insert(texCoords.end(), chunk.texCoords.begin(), chunk.texCoords.end());
+		normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+		used.resize(positions.size());
+		for (const ObjCorner &corner : chunk.corners) {
+			bool isNew;
+			welder.weld(corner, isNew);
+			used[corner.v] = true;
+		}
+		submeshes.add(chunk, positions);
+		info.indexCount += chunk.corners.size();
+		info.hasTexCoords |= chunk.hasTexCoords;
+		info.hasNormals |= chunk.hasNormals;
+	}
+	if (reader.failed() || !reader.rewind()) {
+		std::cout << "Error while reading obj file\n";
+		return false;
+	}
+
+	info.vertexCount = welder.size();
+	submeshes.finish(info.indexCount, info.submeshes, info.materials, info.materialLibraries);
+	// The boxes of the submeshes cover the positions the faces use, unused "v" lines may lie
+	// anywhere. The sphere around them is measured on those positions only.
+	for (size_t i = 0; i < info.submeshes.size(); i++) {
+		const MeshBounds &bounds = info.submeshes[i].bounds;
+		for (int axis = 0; axis < 3; axis++) {
+			info.bounds.min[axis] = i == 0 ? bounds.min[axis]
+										   : std::min(info.bounds.min[axis], bounds.min[axis]);
+			info.bounds.max[axis] = i == 0 ? bounds.max[axis]
+										   : std::max(info.bounds.max[axis], bounds.max[axis]);
+		}
+	}
+	info.bounds.center = (info.bounds.min + info.bounds.max) * 0.5f;
+	float farthest = 0.0f;
+	for (size_t i = 0; i < positions.size(); i++) {
+		if (used[i])
+			farthest = std::max(farthest, (positions[i] - info.bounds.center).length());
+	}
+	info.bounds.radius = farthest;
+	begin(info);
+
+	// Second pass: the corners come back in the same order, so a vertex is emitted exactly when
+	// its id is the next one
+	ObjMesh batch;
+	batch.positions.reserve(limits.batchVertices);
+	batch.indices.reserve(limits.batchIndices);
+	size_t positionCount = 0;
+	size_t texCoordCount = 0;
+	size_t normalCount = 0;
+	size_t emitted = 0;
+
+	while (reader.next(windowBegin, windowEnd)) {
+		const char *error = parseWindow(windowBegin, windowEnd, positionCount, texCoordCount,
+										normalCount, 0, chunk);
+		if (error) {
+			std::cout << error;
+			return false;
+		}
+		positionCount += chunk.positions.size();
+		texCoordCount += chunk.texCoords.size();
+		normalCount += chunk.normals.size();
+		for (const ObjCorner &corner : chunk.corners) {
+			uint32_t vertex = welder.find(corner);
+			if (vertex == emitted) {
+				emitVertex(corner, positions, texCoords, normals, info.hasTexCoords,
+						   info.hasNormals, batch);
+				emitted++;
+			} else if (vertex > emitted) {
+				std::cout << "Obj file changed while reading it\n";
+				return false;
+			}
+			batch.indices.push_back(vertex);
+
+			if (batch.positions.size() >= limits.batchVertices ||
+				batch.indices.size() >= limits.batchIndices) {
+				emit(batch);
+				batch.positions.clear();
+				batch.texCoords.clear();
+				batch.normals.clear();
+				batch.indices.clear();
+			}
+		}
+	}
+	if (reader.failed() || emitted != info.vertexCount) {
+		std::cout << "Error while reading obj file\n";
+		return false;
+	}
+	if (!batch.indices.empty())
+		emit(batch);
+	return true;
+}
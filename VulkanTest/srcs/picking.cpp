@@ -0,0 +1,53 @@
+#include "scop.hpp"
+
+// Point of model space at (x, y, depth) in normalized device coordinates, through the inverse of
+// proj * view * model
+static Vec3 unproject(const Mat4 &inverse, float x, float y, float depth) {
+	float point[4];
+	for (int i = 0; i < 4; i++)
+		point[i] = inverse[0][i] * x + inverse[1][i] * y + inverse[2][i] * depth + inverse[3][i];
+	return Vec3(point[0] / point[3], point[1] / point[3], point[2] / point[3]);
+}
+
+// Casts a ray through the cursor with the transform of the last frame drawn, from the near plane
+// to the far one, and prints the triangle it hits first with its submesh and material
+void Scop::pickAtCursor() {
+	if (modelBvh.nodes.empty()) {
+		std::cout << "Picking needs the whole model in memory, streamed models are not kept"
+				  << std::endl;
+		return;
+	}
+	double cursorX, cursorY;
+	int width, height;
+	glfwGetCursorPos(window, &cursorX, &cursorY);
+	glfwGetWindowSize(window, &width, &height);
+	if (width <= 0 || height <= 0)
+		return;
+
+	// Window coordinates grow down like the y of Vulkan, which the flipped projection accounts for
+	float x = static_cast<float>(2.0 * cursorX / width - 1.0);
+	float y = static_cast<float>(2.0 * cursorY / height - 1.0);
+	Mat4 inverse = clipTransform.inverse();
+	Vec3 origin = unproject(inverse, x, y, 0.0f);
+	Vec3 direction = unproject(inverse, x, y, 1.0f) - origin;
+
+	auto start = std::chrono::steady_clock::now();
+	RayHit hit;
+	bool found = intersectBvh(modelBvh, model, origin, direction, hit);
+	double ms = millisecondsSince(start);
+	if (!found) {
+		std::cout << "Picked nothing in " << ms << " ms" << std::endl;
+		return;
+	}
+	Vec3 point = origin + direction * hit.distance;
+	std::cout << "Picked triangle " << hit.triangle << " at (" << point.x << ", " << point.y
+			  << ", " << point.z << ")";
+	size_t submeshIndex = submeshOfTriangle(model, hit.triangle);
+	if (submeshIndex != SIZE_MAX) {
+		const Submesh &submesh = model.submeshes[submeshIndex];
+		std::cout << " of submesh " << submeshIndex << " \"" << submesh.name << "\", material \""
+				  << (submesh.material == NO_MATERIAL ? "none" : model.materials[submesh.material])
+				  << "\"";
+	}
+	std::cout << " in " << ms << " ms" << std::endl;
+}
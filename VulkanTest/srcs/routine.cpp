@@ -26,21 +26,17 @@ void Scop::initVulkan() {
 	createRenderPass();
 	createDescriptorSetLayout();
 	createPipelineLayout();
-	VkPipeline pipeline1 = createGraphicsPipeline("shaders/vert.spv", "shaders/frag.spv");
-	VkPipeline pipeline2 = createGraphicsPipeline("shaders/vert2.spv", "shaders/frag2.spv");
-	VkPipeline pipeline3 = createGraphicsPipeline("shaders/vert3.spv", "shaders/frag3.spv");
+	VkPipeline pipeline1 = createGraphicsPipeline("shaders/vert.spv", "shaders/basic.spv");
+	VkPipeline pipeline2 = createGraphicsPipeline("shaders/vert.spv", "shaders/grey.spv");
+	VkPipeline pipeline3 = createGraphicsPipeline("shaders/vert.spv", "shaders/funky.spv");
 	graphicsPipelines.push_back(pipeline1);
 	graphicsPipelines.push_back(pipeline2);
 	graphicsPipelines.push_back(pipeline3);
 	createCommandPool();
 	createDepthResources();
 	createFramebuffers();
-	createTextureImage();
-	createTextureImageView();
 	createTextureSampler();
-	loadModel();
-	createVertexBuffer();
-	createIndexBuffer();
+	createPlaceholderAssets();
 	createUniformBuffers();
 	createDescriptorPool();
 	createDescriptorSets();
@@ -56,6 +52,10 @@ void Scop::mainLoop() {
 	float verticalAngle = 0.0f;
 	const float rotationSpeed = 0.05f;
 	bool rKeyPressedLastFrame = false;
+	bool tabKeyPressedLastFrame = false;
+	bool cKeyPressedLastFrame = false;
+	bool lKeyPressedLastFrame = false;
+	bool leftButtonPressedLastFrame = false;
 
 	while (!glfwWindowShouldClose(window)) {
 		float currentFrame = glfwGetTime();
@@ -69,6 +69,41 @@ void Scop::mainLoop() {
 		}
 		rKeyPressedLastFrame = rKeyPressedNow;
 
+		// Tab steps through the submeshes one at a time, then back to the whole model
+		bool tabKeyPressedNow = glfwGetKey(window, GLFW_KEY_TAB) == GLFW_PRESS;
+		if (tabKeyPressedNow && !tabKeyPressedLastFrame && model.submeshes.size() > 1) {
+			isolatedSubmesh++;
+			if (isolatedSubmesh >= static_cast<int>(model.submeshes.size()))
+				isolatedSubmesh = -1;
+			if (isolatedSubmesh < 0)
+				std::cout << "Showing all submeshes" << std::endl;
+			else
+				std::cout << "Showing submesh " << isolatedSubmesh << " \""
+						  << model.submeshes[isolatedSubmesh].name << "\"" << std::endl;
+		}
+		tabKeyPressedLastFrame = tabKeyPressedNow;
+
+		bool cKeyPressedNow = glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS;
+		if (cKeyPressedNow && !cKeyPressedLastFrame) {
+			meshletCulling = !meshletCulling;
+			std::cout << "Meshlet culling " << (meshletCulling ? "on" : "off") << std::endl;
+		}
+		cKeyPressedLastFrame = cKeyPressedNow;
+
+		bool lKeyPressedNow = glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS;
+		if (lKeyPressedNow && !lKeyPressedLastFrame) {
+			levelOfDetail = !levelOfDetail;
+			std::cout << "Levels of detail " << (levelOfDetail ? "on" : "off") << std::endl;
+		}
+		lKeyPressedLastFrame = lKeyPressedNow;
+
+		// A left click reports what is under the cursor
+		bool leftButtonPressedNow =
+			glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+		if (leftButtonPressedNow && !leftButtonPressedLastFrame)
+			pickAtCursor();
+		leftButtonPressedLastFrame = leftButtonPressedNow;
+
 		if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
 			modelScale += scaleFactor;
 		if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
@@ -91,7 +126,7 @@ void Scop::mainLoop() {
 		if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
 			rollAngle -= rotationSpeed;
 
-		float radius = 5.0f;
+		float radius = framingDistance();
 		cameraPos.x = cos(verticalAngle) * sin(angle) * radius;
 		cameraPos.y = sin(verticalAngle) * radius;
 		cameraPos.z = cos(verticalAngle) * cos(angle) * radius;
@@ -102,6 +137,7 @@ void Scop::mainLoop() {
 
 		verticalAngle = clamp(verticalAngle, minVangle, maxVangle);
 		modelScale = clamp(modelScale, 0.01f, 1.0f);
+		swapInLoadedAssets();
 		drawFrame();
 	}
 
@@ -124,8 +160,8 @@ void Scop::drawFrame() {
 	vkResetFences(device, 1, &inFlightFences[currentFrame]);
 
 	vkResetCommandBuffer(commandBuffers[currentFrame], 0);
-	recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
 	updateUniformBuffer(currentFrame);
+	recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
 
 	VkSubmitInfo submitInfo{};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -168,6 +204,16 @@ void Scop::drawFrame() {
 		throw std::runtime_error("failed to present swap chain image!");
 	}
 
+	if (!firstFramePresented) {
+		firstFramePresented = true;
+		std::cout << "First frame after " << millisecondsSince(startTime) << " ms" << std::endl;
+	}
+	if (!fullModelPresented && !pendingModel.valid() && !pendingTexture.valid()) {
+		fullModelPresented = true;
+		std::cout << "Full model on screen after " << millisecondsSince(startTime) << " ms"
+				  << std::endl;
+	}
+
 	currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
 }
 
@@ -178,15 +224,10 @@ void Scop::cleanup() {
 		vkFreeMemory(device, uniformBuffersMemory[i], nullptr);
 	}
 	vkDestroySampler(device, textureSampler, nullptr);
-	vkDestroyImageView(device, textureImageView, nullptr);
-	vkDestroyImage(device, textureImage, nullptr);
-	vkFreeMemory(device, textureImageMemory, nullptr);
+	cleanupTexture();
 	vkDestroyDescriptorPool(device, descriptorPool, nullptr);
 	vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
-	vkDestroyBuffer(device, vertexBuffer, nullptr);
-	vkFreeMemory(device, vertexBufferMemory, nullptr);
-	vkDestroyBuffer(device, indexBuffer, nullptr);
-	vkFreeMemory(device, indexBufferMemory, nullptr);
+	cleanupModelBuffers();
 	for (auto pipeline : graphicsPipelines)
 		vkDestroyPipeline(device, pipeline, nullptr);
 	vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
@@ -0,0 +1,534 @@
+#include "simplify.hpp"
+#include "flat_id_map.hpp"
+#include "mesh_optimize.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <cmath>
+
+// Vertices searched for a collapse by a thread at a time
+static const size_t CHUNK_SIZE = 16384;
+
+// Sum of the squared distances of a point to a set of planes n . p + d = 0, each weighted by the
+// area of its triangle. Divided by the total weight it is the mean squared distance, which ranks
+// the collapses: one plane far off among many close ones is averaged away, so it is no bound and
+// the error of a level is tracked apart (see Simplifier::distance). Doubles, because the terms are
+// about the square of the model size and cancel out.
+struct Quadric {
+	double xx = 0.0, yy = 0.0, zz = 0.0, xy = 0.0, xz = 0.0, yz = 0.0;
+	double xw = 0.0, yw = 0.0, zw = 0.0, ww = 0.0;
+	double weight = 0.0;
+
+	void addPlane(const double n[3], double d, double w) {
+		xx += w * n[0] * n[0];
+		yy += w * n[1] * n[1];
+		zz += w * n[2] * n[2];
+		xy += w * n[0] * n[1];
+		xz += w * n[0] * n[2];
+		yz += w * n[1] * n[2];
+		xw += w * n[0] * d;
+		yw += w * n[1] * d;
+		zw += w * n[2] * d;
+		ww += w * d * d;
+		weight += w;
+	}
+
+	void add(const Quadric &other) {
+		xx += other.xx;
+		yy += other.yy;
+		zz += other.zz;
+		xy += other.xy;
+		xz += other.xz;
+		yz += other.yz;
+		xw += other.xw;
+		yw += other.yw;
+		zw += other.zw;
+		ww += other.ww;
+		weight += other.weight;
+	}
+
+	double error(const Vec3 &p) const {
+		if (!(weight > 0.0))
+			return 0.0;
+		double x = p.x, y = p.y, z = p.z;
+		double sum = xx * x * x + yy * y * y + zz * z * z +
+					 2.0 * (xy * x * y + xz * x * z + yz * y * z + xw * x + yw * y + zw * z) + ww;
+		return std::max(sum, 0.0) / weight;
+	}
+};
+
+// Border vertices only move along the border, locked ones never move
+enum class VertexKind : uint8_t { Manifold, Border, Locked };
+
+// A vertex next to another one over the triangles around it: out counts the edges from the other
+// one to it in triangle order, in the edges back. An edge once each way is inside the surface,
+// once one way on its border, anything else is not manifold.
+struct Neighbour {
+	uint32_t vertex;
+	uint32_t out;
+	uint32_t in;
+};
+
+struct Collapse {
+	uint32_t from;
+	uint32_t to;
+	double error;
+};
+
+// What the search for the cheapest collapses of a chunk of vertices works with, and finds
+struct CollapseSearch {
+	std::vector<Neighbour> neighbours;
+	std::vector<Neighbour> otherNeighbours;
+	std::vector<Collapse> targets;
+	std::vector<Collapse> collapses;
+};
+
+// (b - a) x (c - a), twice the area of abc along its normal
+static void triangleCross(const Vec3 &a, const Vec3 &b, const Vec3 &c, double n[3]) {
+	double ab[3] = {b.x - a.x, b.y - a.y, b.z - a.z};
+	double ac[3] = {c.x - a.x, c.y - a.y, c.z - a.z};
+	n[0] = ab[1] * ac[2] - ab[2] * ac[1];
+	n[1] = ab[2] * ac[0] - ab[0] * ac[2];
+	n[2] = ab[0] * ac[1] - ab[1] * ac[0];
+}
+
+// The triangles of every submesh, collapsed a pass at a time. Triangles keep their order, so they
+// stay grouped by submesh.
+class Simplifier {
+public:
+	Simplifier(const Mesh &mesh, unsigned threads);
+
+	size_t triangleCount() const { return triangles.size() / 3; }
+
+	// One pass of collapses, cheapest first, stopping at targetCount triangles. Each vertex takes
+	// part in one collapse at most, and only the cheaper half of the candidates is tried so that
+	// the next pass gets a chance at the cheap ones they blocked. error grows to the largest
+	// distance of a vertex that took a collapse. Returns false when none was possible.
+	bool collapsePass(size_t targetCount, double &error);
+
+	// Appends the triangles left to indices and their first index per submesh to firstIndex
+	void appendTriangles(std::vector<uint32_t> &indices, std::vector<uint32_t> &firstIndex) const;
+
+private:
+	void findTriangles();
+	void findNeighbours(uint32_t v, std::vector<Neighbour> &neighbours) const;
+	bool flips(uint32_t from, uint32_t to) const;
+	bool keepsTopology(uint32_t from, uint32_t to, const std::vector<Neighbour> &fromNeighbours,
+					   std::vector<Neighbour> &toNeighbours) const;
+	void findCollapse(uint32_t v, CollapseSearch &search) const;
+	void addPlane(const double n[3], double d, double weight, uint32_t a, uint32_t b,
+				  uint32_t c = UINT32_MAX);
+	void movePlanes(uint32_t from, uint32_t to);
+
+	const std::vector<Vertex> &vertices;
+	size_t submeshCount;
+	std::vector<uint32_t> triangles;
+	std::vector<uint32_t> submeshOf;
+	std::vector<Quadric> quadrics;
+	// The planes of the full mesh every vertex stands for: its own triangles and border planes,
+	// then those of the vertices collapsed onto it, as a list through nextPlane that a collapse
+	// splices onto the one of its target. distance is the largest distance of the vertex to them,
+	// in model space.
+	std::vector<float> planes; // n and d of every plane
+	std::vector<uint32_t> planeOf;
+	std::vector<uint32_t> nextPlane;
+	std::vector<uint32_t> firstPlane;
+	std::vector<uint32_t> lastPlane;
+	std::vector<double> distance;
+	std::vector<VertexKind> kinds;
+	// Triangles around vertex v are vertexTriangles[firstTriangle[v]..firstTriangle[v + 1]),
+	// found again at the start of every pass
+	std::vector<uint32_t> firstTriangle;
+	std::vector<uint32_t> vertexTriangles;
+	unsigned threads;
+	std::vector<Neighbour> neighbours;
+	std::vector<CollapseSearch> searches;
+	std::vector<Collapse> collapses;
+};
+
+Simplifier::Simplifier(const Mesh &mesh, unsigned threads)
+	: vertices(mesh.vertices), submeshCount(mesh.submeshes.size()),
+	  quadrics(mesh.vertices.size()), firstPlane(mesh.vertices.size(), UINT32_MAX),
+	  lastPlane(mesh.vertices.size(), UINT32_MAX), distance(mesh.vertices.size(), 0.0),
+	  kinds(mesh.vertices.size(), VertexKind::Manifold), threads(threads) {
+	const uint32_t none = UINT32_MAX;
+
+	// Triangles with a repeated vertex draw nothing, they are left out of every level
+	for (size_t s = 0; s < mesh.submeshes.size(); s++) {
+		const Submesh &submesh = mesh.submeshes[s];
+		for (uint32_t i = submesh.indexOffset; i + 2 < submesh.indexOffset + submesh.indexCount;
+			 i += 3) {
+			const uint32_t *corner = &mesh.indices[i];
+			if (corner[0] == corner[1] || corner[1] == corner[2] || corner[0] == corner[2])
+				continue;
+			triangles.insert(triangles.end(), corner, corner + 3);
+			submeshOf.push_back(static_cast<uint32_t>(s));
+		}
+	}
+
+	for (size_t t = 0; t < submeshOf.size(); t++) {
+		const uint32_t *corner = &triangles[t * 3];
+		double n[3];
+		triangleCross(vertices[corner[0]].pos, vertices[corner[1]].pos, vertices[corner[2]].pos,
+					  n);
+		double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (!(length > 0.0))
+			continue;
+		n[0] /= length;
+		n[1] /= length;
+		n[2] /= length;
+		const Vec3 &a = vertices[corner[0]].pos;
+		double d = -(n[0] * a.x + n[1] * a.y + n[2] * a.z);
+		addPlane(n, d, length, corner[0], corner[1], corner[2]);
+	}
+
+	// A vertex sharing its position with another one sits on a UV seam, moving it would tear the
+	// surface open
+	std::vector<uint32_t> positionCount;
+	std::vector<uint32_t> positionIds(vertices.size());
+	FlatIdMap<Vertex, VertexHash> uniquePositions(vertices.size());
+	for (size_t v = 0; v < vertices.size(); v++) {
+		Vertex position{};
+		position.pos = vertices[v].pos;
+		bool isNew;
+		positionIds[v] = uniquePositions.insert(
+			position, static_cast<uint32_t>(uniquePositions.size()), isNew);
+		if (isNew)
+			positionCount.push_back(0);
+		positionCount[positionIds[v]]++;
+	}
+	std::vector<uint32_t> vertexSubmesh(vertices.size(), none);
+	for (size_t t = 0; t < submeshOf.size(); t++) {
+		for (int k = 0; k < 3; k++) {
+			uint32_t v = triangles[t * 3 + k];
+			if (vertexSubmesh[v] != none && vertexSubmesh[v] != submeshOf[t])
+				kinds[v] = VertexKind::Locked;
+			vertexSubmesh[v] = submeshOf[t];
+		}
+	}
+
+	findTriangles();
+	for (uint32_t v = 0; v < vertices.size(); v++) {
+		if (positionCount[positionIds[v]] > 1)
+			kinds[v] = VertexKind::Locked;
+		findNeighbours(v, neighbours);
+		size_t borderEdges = 0;
+		for (const Neighbour &neighbour : neighbours) {
+			if (neighbour.out > 1 || neighbour.in > 1)
+				kinds[v] = VertexKind::Locked;
+			if (neighbour.out != neighbour.in)
+				borderEdges++;
+		}
+		if (kinds[v] == VertexKind::Manifold && borderEdges > 0)
+			kinds[v] = borderEdges == 2 ? VertexKind::Border : VertexKind::Locked;
+
+		// Planes through the border edges leaving v, square to their triangle, keep the outline
+		for (uint32_t i = firstTriangle[v]; i < firstTriangle[v + 1]; i++) {
+			const uint32_t *corner = &triangles[vertexTriangles[i] * 3];
+			int k = corner[0] == v ? 0 : corner[1] == v ? 1 : 2;
+			uint32_t next = corner[(k + 1) % 3];
+			auto found = std::find_if(neighbours.begin(), neighbours.end(),
+									  [&](const Neighbour &n) { return n.vertex == next; });
+			if (found->in > 0)
+				continue;
+			double normal[3];
+			triangleCross(vertices[corner[0]].pos, vertices[corner[1]].pos,
+						  vertices[corner[2]].pos, normal);
+			const Vec3 &a = vertices[v].pos;
+			const Vec3 &b = vertices[next].pos;
+			double edge[3] = {b.x - a.x, b.y - a.y, b.z - a.z};
+			double n[3] = {edge[1] * normal[2] - edge[2] * normal[1],
+						   edge[2] * normal[0] - edge[0] * normal[2],
+						   edge[0] * normal[1] - edge[1] * normal[0]};
+			double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			if (!(length > 0.0))
+				continue;
+			n[0] /= length;
+			n[1] /= length;
+			n[2] /= length;
+			double d = -(n[0] * a.x + n[1] * a.y + n[2] * a.z);
+			double weight = edge[0] * edge[0] + edge[1] * edge[1] + edge[2] * edge[2];
+			addPlane(n, d, weight, v, next);
+		}
+	}
+}
+
+// Adds the plane to the quadrics and plane lists of vertices a, b and c when there is one
+void Simplifier::addPlane(const double n[3], double d, double weight, uint32_t a, uint32_t b,
+						  uint32_t c) {
+	uint32_t plane = static_cast<uint32_t>(planes.size() / 4);
+	planes.insert(planes.end(), {static_cast<float>(n[0]), static_cast<float>(n[1]),
+								 static_cast<float>(n[2]), static_cast<float>(d)});
+	for (uint32_t v : {a, b, c}) {
+		if (v == UINT32_MAX)
+			continue;
+		quadrics[v].addPlane(n, d, weight);
+		uint32_t entry = static_cast<uint32_t>(planeOf.size());
+		planeOf.push_back(plane);
+		nextPlane.push_back(UINT32_MAX);
+		if (lastPlane[v] == UINT32_MAX)
+			firstPlane[v] = entry;
+		else
+			nextPlane[lastPlane[v]] = entry;
+		lastPlane[v] = entry;
+	}
+}
+
+// Hands the planes of from to to, measuring how far to is from them. Every entry moves instead of
+// being copied, so the lists never hold more than the planes of the full mesh.
+void Simplifier::movePlanes(uint32_t from, uint32_t to) {
+	if (firstPlane[from] == UINT32_MAX)
+		return;
+	const Vec3 &p = vertices[to].pos;
+	double farthest = distance[to];
+	for (uint32_t entry = firstPlane[from]; entry != UINT32_MAX; entry = nextPlane[entry]) {
+		const float *plane = &planes[planeOf[entry] * 4];
+		farthest = std::max(
+			farthest, std::fabs(static_cast<double>(plane[0]) * p.x + plane[1] * p.y +
+								static_cast<double>(plane[2]) * p.z + plane[3]));
+	}
+	distance[to] = farthest;
+	if (lastPlane[to] == UINT32_MAX)
+		firstPlane[to] = firstPlane[from];
+	else
+		nextPlane[lastPlane[to]] = firstPlane[from];
+	lastPlane[to] = lastPlane[from];
+	firstPlane[from] = lastPlane[from] = UINT32_MAX;
+}
+
+void Simplifier::findTriangles() {
+	firstTriangle.assign(vertices.size() + 1, 0);
+	for (uint32_t v : triangles)
+		firstTriangle[v + 1]++;
+	for (size_t v = 0; v < vertices.size(); v++)
+		firstTriangle[v + 1] += firstTriangle[v];
+	vertexTriangles.resize(triangles.size());
+	std::vector<uint32_t> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+	for (size_t i = 0; i < triangles.size(); i++)
+		vertexTriangles[fill[triangles[i]]++] = static_cast<uint32_t>(i / 3);
+}
+
+void Simplifier::findNeighbours(uint32_t v, std::vector<Neighbour> &neighbours) const {
+	neighbours.clear();
+	auto count = [&](uint32_t vertex) -> Neighbour & {
+		for (Neighbour &neighbour : neighbours) {
+			if (neighbour.vertex == vertex)
+				return neighbour;
+		}
+		neighbours.push_back({vertex, 0, 0});
+		return neighbours.back();
+	};
+	for (uint32_t i = firstTriangle[v]; i < firstTriangle[v + 1]; i++) {
+		const uint32_t *corner = &triangles[vertexTriangles[i] * 3];
+		int k = corner[0] == v ? 0 : corner[1] == v ? 1 : 2;
+		count(corner[(k + 1) % 3]).out++;
+		count(corner[(k + 2) % 3]).in++;
+	}
+}
+
+// Whether moving from onto to turns a triangle around from over, the ones with both go away
+bool Simplifier::flips(uint32_t from, uint32_t to) const {
+	for (uint32_t i = firstTriangle[from]; i < firstTriangle[from + 1]; i++) {
+		const uint32_t *corner = &triangles[vertexTriangles[i] * 3];
+		if (corner[0] == to || corner[1] == to || corner[2] == to)
+			continue;
+		const Vec3 *moved[3];
+		for (int k = 0; k < 3; k++)
+			moved[k] = corner[k] == from ? &vertices[to].pos : &vertices[corner[k]].pos;
+		double before[3];
+		double after[3];
+		triangleCross(vertices[corner[0]].pos, vertices[corner[1]].pos, vertices[corner[2]].pos,
+					  before);
+		triangleCross(*moved[0], *moved[1], *moved[2], after);
+		if (before[0] * after[0] + before[1] * after[1] + before[2] * after[2] <= 0.0)
+			return true;
+	}
+	return false;
+}
+
+// The link condition: the vertices next to both ends of the edge are exactly the third corners of
+// the triangles on it, otherwise the collapse would fold the surface onto itself
+bool Simplifier::keepsTopology(uint32_t from, uint32_t to,
+							   const std::vector<Neighbour> &fromNeighbours,
+							   std::vector<Neighbour> &toNeighbours) const {
+	findNeighbours(to, toNeighbours);
+	size_t common = 0;
+	for (const Neighbour &a : fromNeighbours) {
+		for (const Neighbour &b : toNeighbours)
+			common += a.vertex == b.vertex;
+	}
+	size_t shared = 0;
+	for (uint32_t i = firstTriangle[from]; i < firstTriangle[from + 1]; i++) {
+		const uint32_t *corner = &triangles[vertexTriangles[i] * 3];
+		shared += corner[0] == to || corner[1] == to || corner[2] == to;
+	}
+	return common == shared;
+}
+
+// The cheapest target of v that neither flips a triangle nor folds the surface, if any
+void Simplifier::findCollapse(uint32_t v, CollapseSearch &search) const {
+	if (kinds[v] == VertexKind::Locked || firstTriangle[v] == firstTriangle[v + 1])
+		return;
+	findNeighbours(v, search.neighbours);
+	search.targets.clear();
+	for (const Neighbour &neighbour : search.neighbours) {
+		if (kinds[v] == VertexKind::Border && neighbour.out == neighbour.in)
+			continue;
+		search.targets.push_back(
+			{v, neighbour.vertex, quadrics[v].error(vertices[neighbour.vertex].pos)});
+	}
+	std::sort(search.targets.begin(), search.targets.end(),
+			  [](const Collapse &a, const Collapse &b) { return a.error < b.error; });
+	for (const Collapse &target : search.targets) {
+		if (!flips(v, target.to) &&
+			keepsTopology(v, target.to, search.neighbours, search.otherNeighbours)) {
+			search.collapses.push_back(target);
+			return;
+		}
+	}
+}
+
+bool Simplifier::collapsePass(size_t targetCount, double &error) {
+	findTriangles();
+
+	// The cheapest move of every vertex that may move. The search only reads, so the chunks run
+	// on every thread and are joined in vertex order, which keeps the result the same on any
+	// number of threads.
+	size_t chunkCount = (vertices.size() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	searches.resize(chunkCount);
+	parallelFor(
+		chunkCount,
+		[&](size_t chunk) {
+			CollapseSearch &search = searches[chunk];
+			search.collapses.clear();
+			size_t end = std::min(vertices.size(), (chunk + 1) * CHUNK_SIZE);
+			for (size_t v = chunk * CHUNK_SIZE; v < end; v++)
+				findCollapse(static_cast<uint32_t>(v), search);
+		},
+		threads);
+	collapses.clear();
+	for (const CollapseSearch &search : searches)
+		collapses.insert(collapses.end(), search.collapses.begin(), search.collapses.end());
+	// Only the cheaper half is tried, which needs no full sort
+	auto cheaper = [](const Collapse &a, const Collapse &b) { return a.error < b.error; };
+	auto half = collapses.begin() + (collapses.size() + 1) / 2;
+	std::nth_element(collapses.begin(), half, collapses.end(), cheaper);
+	collapses.erase(half, collapses.end());
+	std::sort(collapses.begin(), collapses.end(), cheaper);
+
+	// A collapse changes every triangle around from, whose corners wait for the next pass
+	std::vector<bool> touched(vertices.size(), false);
+	std::vector<bool> removed(submeshOf.size(), false);
+	size_t count = triangleCount();
+	size_t applied = 0;
+	for (const Collapse &collapse : collapses) {
+		if (count <= targetCount)
+			break;
+		if (touched[collapse.from] || touched[collapse.to])
+			continue;
+		for (uint32_t i = firstTriangle[collapse.from]; i < firstTriangle[collapse.from + 1]; i++) {
+			uint32_t t = vertexTriangles[i];
+			uint32_t *corner = &triangles[t * 3];
+			for (int k = 0; k < 3; k++)
+				touched[corner[k]] = true;
+			if (corner[0] == collapse.to || corner[1] == collapse.to || corner[2] == collapse.to) {
+				removed[t] = true;
+				count--;
+			}
+			for (int k = 0; k < 3; k++) {
+				if (corner[k] == collapse.from)
+					corner[k] = collapse.to;
+			}
+		}
+		quadrics[collapse.to].add(quadrics[collapse.from]);
+		movePlanes(collapse.from, collapse.to);
+		error = std::max(error, distance[collapse.to]);
+		applied++;
+	}
+
+	size_t kept = 0;
+	for (size_t t = 0; t < submeshOf.size(); t++) {
+		if (removed[t])
+			continue;
+		std::copy(&triangles[t * 3], &triangles[t * 3] + 3, &triangles[kept * 3]);
+		submeshOf[kept++] = submeshOf[t];
+	}
+	triangles.resize(kept * 3);
+	submeshOf.resize(kept);
+	return applied > 0;
+}
+
+void Simplifier::appendTriangles(std::vector<uint32_t> &indices,
+								 std::vector<uint32_t> &firstIndex) const {
+	size_t t = 0;
+	for (uint32_t s = 0; s < submeshCount; s++) {
+		firstIndex.push_back(static_cast<uint32_t>(indices.size()));
+		for (; t < submeshOf.size() && submeshOf[t] == s; t++)
+			indices.insert(indices.end(), &triangles[t * 3], &triangles[t * 3] + 3);
+	}
+	firstIndex.push_back(static_cast<uint32_t>(indices.size()));
+}
+
+void buildLods(Mesh &mesh, unsigned threads) {
+	// Below this many triangles a level is not worth a draw of its own
+	const size_t minTriangles = 32;
+	mesh.lods.clear();
+
+	Simplifier simplifier(mesh, threads);
+	std::vector<uint32_t> localIds(mesh.vertices.size(), UINT32_MAX);
+	size_t triangleCount = simplifier.triangleCount();
+	double error = 0.0;
+	while (mesh.lods.size() < LOD_MAX_LEVELS) {
+		size_t target = triangleCount / 2;
+		if (target < minTriangles)
+			break;
+		// Once a pass removes less than 1% of the triangles, the collapses left are the costly
+		// ones around locked vertices and folds: more passes cost time and raise the error fast
+		size_t before;
+		do {
+			before = simplifier.triangleCount();
+		} while (before > target && simplifier.collapsePass(target, error) &&
+				 before - simplifier.triangleCount() >= before / 100);
+		// Stuck on locked vertices or on collapses that would fold the surface
+		if (simplifier.triangleCount() > triangleCount * 3 / 4)
+			break;
+		triangleCount = simplifier.triangleCount();
+
+		MeshLod lod;
+		lod.error = static_cast<float>(error);
+		simplifier.appendTriangles(mesh.indices, lod.firstIndex);
+		for (size_t s = 0; s + 1 < lod.firstIndex.size(); s++)
+			optimizeVertexCache(mesh.indices.data() + lod.firstIndex[s],
+								(lod.firstIndex[s + 1] - lod.firstIndex[s]) / 3, localIds);
+		mesh.lods.push_back(std::move(lod));
+	}
+}
+
+uint32_t selectLod(const Mesh &mesh, size_t submesh, const Mat4 &clip, float viewportWidth,
+				   float viewportHeight, float pixelError) {
+	if (mesh.lods.empty() || !(pixelError > 0.0f))
+		return 0;
+
+	// Row r of clip applied to a model space position is clip[0][r] * x + ... + clip[3][r]
+	auto row = [&](int r, int i) { return clip[i][r]; };
+	auto rowLength = [&](int r) {
+		return std::sqrt(row(r, 0) * row(r, 0) + row(r, 1) * row(r, 1) + row(r, 2) * row(r, 2));
+	};
+	const Vec3 &center = mesh.submeshes[submesh].bounds.center;
+	float radius = mesh.submeshes[submesh].bounds.radius;
+
+	// w changes by at most the length of its row per model space unit, so no point of the bounds
+	// has a smaller w than this; at or behind the eye, the full mesh is drawn
+	float w = row(3, 0) * center.x + row(3, 1) * center.y + row(3, 2) * center.z + row(3, 3) -
+			  radius * rowLength(3);
+	if (!(w > 0.0f))
+		return 0;
+
+	// Pixels a model space length covers at most there, across or up the viewport
+	float pixelsPerUnit =
+		std::max(rowLength(0) * viewportWidth, rowLength(1) * viewportHeight) * 0.5f / w;
+	for (size_t level = mesh.lods.size(); level > 0; level--) {
+		if (mesh.lods[level - 1].error * pixelsPerUnit <= pixelError)
+			return static_cast<uint32_t>(level);
+	}
+	return 0;
+}
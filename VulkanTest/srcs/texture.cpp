@@ -1,19 +1,29 @@
 #include "bmploader.hpp"
 #include "scop.hpp"
 
-void Scop::createTextureImage() {
-	int texWidth, texHeight;
-
+// Runs on a loading thread, the pixels are uploaded by createTextureImage
+TextureData Scop::loadTexture(std::ostream &log) {
+	auto start = std::chrono::steady_clock::now();
 	BMP my_loader = BMP(TEXTURE_PATH);
 
-	texWidth = my_loader.info_header.width;
-	texHeight = my_loader.info_header.height;
-	VkDeviceSize imageSize = texWidth * texHeight * 4;
-
 	if (my_loader.data.empty()) {
 		throw std::runtime_error("Error! Unable to load texture image!");
 	}
 
+	TextureData texture;
+	texture.width = my_loader.info_header.width;
+	texture.height = my_loader.info_header.height;
+	texture.pixels = std::move(my_loader.data);
+	log << "Texture decoded from " << TEXTURE_PATH << " in " << millisecondsSince(start) << " ms"
+		<< std::endl;
+	return texture;
+}
+
+void Scop::createTextureImage(const TextureData &texture) {
+	uint32_t texWidth = texture.width;
+	uint32_t texHeight = texture.height;
+	VkDeviceSize imageSize = texWidth * texHeight * 4;
+
 	VkBuffer stagingBuffer;
 	VkDeviceMemory stagingBufferMemory;
 
@@ -23,11 +33,9 @@ void Scop::createTextureImage() {
 
 	void *data;
 	vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);
-	memcpy(data, my_loader.data.data(), static_cast<size_t>(imageSize));
+	memcpy(data, texture.pixels.data(), static_cast<size_t>(imageSize));
 	vkUnmapMemory(device, stagingBufferMemory);
 
-	my_loader.data.clear();
-
 	createImage(texWidth, texHeight, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL,
 				VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
 				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageMemory);
@@ -35,8 +43,7 @@ void Scop::createTextureImage() {
 	transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED,
 						  VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
 
-	copyBufferToImage(stagingBuffer, textureImage, static_cast<uint32_t>(texWidth),
-					  static_cast<uint32_t>(texHeight));
+	copyBufferToImage(stagingBuffer, textureImage, texWidth, texHeight);
 
 	transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB,
 						  VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
@@ -46,6 +53,12 @@ void Scop::createTextureImage() {
 	vkFreeMemory(device, stagingBufferMemory, nullptr);
 }
 
+void Scop::cleanupTexture() {
+	vkDestroyImageView(device, textureImageView, nullptr);
+	vkDestroyImage(device, textureImage, nullptr);
+	vkFreeMemory(device, textureImageMemory, nullptr);
+}
+
 void Scop::transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout,
 								 VkImageLayout newLayout) {
 	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
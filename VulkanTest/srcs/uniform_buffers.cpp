@@ -15,7 +15,15 @@ void Scop::createDescriptorSetLayout() {
 	samplerLayoutBinding.pImmutableSamplers = nullptr;
 	samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-	std::array<VkDescriptorSetLayoutBinding, 2> bindings = {uboLayoutBinding, samplerLayoutBinding};
+	VkDescriptorSetLayoutBinding materialLayoutBinding{};
+	materialLayoutBinding.binding = 2;
+	materialLayoutBinding.descriptorCount = 1;
+	materialLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	materialLayoutBinding.pImmutableSamplers = nullptr;
+	materialLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	std::array<VkDescriptorSetLayoutBinding, 3> bindings = {uboLayoutBinding, samplerLayoutBinding,
+															materialLayoutBinding};
 
 	VkDescriptorSetLayoutCreateInfo layoutInfo{};
 	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -62,21 +70,44 @@ void Scop::updateUniformBuffer(uint32_t currentImage) {
 	// Camera position and view
 	ubo.view = Mat4::lookAt(cameraPos, Vec3(0.0f, 0.0f, 0.0f), Vec3(0.0f, 1.0f, 0.0f));
 
-	// Perspective projection
-	ubo.proj = Mat4::perspective(radians(45.0f),
-								swapChainExtent.width / (float)swapChainExtent.height, 0.1f, 10.0f);
+	// Perspective projection, its depth range fitted to the bounding sphere of the model. Near
+	// stays within 1/1000 of far when the eye is inside the sphere, to keep depth precision.
+	const Vec3 &center = model.bounds.center;
+	Vec3 worldCenter;
+	for (int i = 0; i < 3; i++)
+		worldCenter[i] = ubo.model[0][i] * center.x + ubo.model[1][i] * center.y +
+						 ubo.model[2][i] * center.z + ubo.model[3][i];
+	float distance = (worldCenter - cameraPos).length();
+	float radius = std::max(model.bounds.radius * modelScale, 1e-6f);
+	float farPlane = distance + radius;
+	float nearPlane = std::max(distance - radius, farPlane * 0.001f);
+	ubo.proj = Mat4::perspective(fieldOfView, swapChainExtent.width / (float)swapChainExtent.height,
+								 nearPlane, farPlane);
 	ubo.proj[1][1] *= -1;
+	clipTransform = ubo.proj * ubo.view * ubo.model;
+	ubo.decode = vertexDecode;
 
 	// Copy UBO bytes to uniform buffer memory
 	memcpy(uniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
 }
 
+float Scop::framingDistance() const {
+	// The sphere about the origin the model spins in, at the starting scale, touches the sides of
+	// the narrower of the two fields of view
+	float radius = (model.bounds.center.length() + model.bounds.radius) * startScale;
+	float aspect = swapChainExtent.width / (float)std::max(swapChainExtent.height, 1u);
+	float halfAngle = std::atan(std::tan(fieldOfView * 0.5f) * std::min(aspect, 1.0f));
+	return std::max(radius, 1e-6f) / std::sin(halfAngle);
+}
+
 void Scop::createDescriptorPool() {
-	std::array<VkDescriptorPoolSize, 2> poolSizes{};
+	std::array<VkDescriptorPoolSize, 3> poolSizes{};
 	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
 	poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
 	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 	poolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+	poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[2].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
 
 	VkDescriptorPoolCreateInfo poolInfo{};
 	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
@@ -101,7 +132,12 @@ void Scop::createDescriptorSets() {
 	if (vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
 		throw std::runtime_error("failed to allocate descriptor sets!");
 	}
+	writeDescriptorSets();
+}
 
+// Points the descriptor sets at the current texture and material buffer, again every time the
+// loaded assets replace the placeholders
+void Scop::writeDescriptorSets() {
 	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
 		VkDescriptorBufferInfo bufferInfo{};
 		bufferInfo.buffer = uniformBuffers[i];
@@ -113,7 +149,12 @@ void Scop::createDescriptorSets() {
 		imageInfo.imageView = textureImageView;
 		imageInfo.sampler = textureSampler;
 
-		std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+		VkDescriptorBufferInfo materialInfo{};
+		materialInfo.buffer = materialBuffer;
+		materialInfo.offset = 0;
+		materialInfo.range = VK_WHOLE_SIZE;
+
+		std::array<VkWriteDescriptorSet, 3> descriptorWrites{};
 		descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 		descriptorWrites[0].dstSet = descriptorSets[i];
 		descriptorWrites[0].dstBinding = 0;
@@ -130,6 +171,14 @@ void Scop::createDescriptorSets() {
 		descriptorWrites[1].descriptorCount = 1;
 		descriptorWrites[1].pImageInfo = &imageInfo;
 
+		descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[2].dstSet = descriptorSets[i];
+		descriptorWrites[2].dstBinding = 2;
+		descriptorWrites[2].dstArrayElement = 0;
+		descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorWrites[2].descriptorCount = 1;
+		descriptorWrites[2].pBufferInfo = &materialInfo;
+
 		vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()),
 							   descriptorWrites.data(), 0, nullptr);
 	}
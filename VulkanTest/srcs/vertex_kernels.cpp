@@ -0,0 +1,251 @@
+#include "vertex_kernels.hpp"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCOP_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+static_assert(sizeof(Vec3) == 3 * sizeof(float), "positions are read as a flat float stream");
+
+// atan(a) on [0, 1] as a times a polynomial in a^2, within 1e-5 radians
+static const float ATAN0 = 0.99997726f;
+static const float ATAN1 = -0.33262347f;
+static const float ATAN2 = 0.19354346f;
+static const float ATAN3 = -0.11643287f;
+static const float ATAN4 = 0.05265332f;
+static const float ATAN5 = -0.01172120f;
+// acos(a) on [0, 1] as sqrt(1 - a) times a polynomial in a, within 7e-5 radians (Abramowitz and
+// Stegun 4.4.45)
+static const float ACOS0 = 1.5707288f;
+static const float ACOS1 = -0.2121144f;
+static const float ACOS2 = 0.0742610f;
+static const float ACOS3 = -0.0187293f;
+static const float PI = 3.14159265f;
+static const float HALF_PI = 1.57079633f;
+static const float INV_PI = 0.318309886f;
+static const float INV_TWO_PI = 0.159154943f;
+
+KernelIsa bestKernelIsa() {
+	static const KernelIsa best = []() {
+#ifdef SCOP_X86_KERNELS
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			return KernelIsa::Avx2;
+		if (__builtin_cpu_supports("sse4.1"))
+			return KernelIsa::Sse41;
+#endif
+		return KernelIsa::Scalar;
+	}();
+	return best;
+}
+
+const char *kernelIsaName(KernelIsa isa) {
+	switch (isa) {
+	case KernelIsa::Avx2: return "avx2";
+	case KernelIsa::Sse41: return "sse4.1";
+	default: return "scalar";
+	}
+}
+
+// The reference every vector version follows operation for operation: blends stand for the
+// ternaries, and a division whose divisor is 0 is computed and then replaced.
+static void scalarUVs(const float *x, const float *y, const float *z, size_t count, float *s,
+					  float *t) {
+	for (size_t i = 0; i < count; i++) {
+		float ax = std::fabs(x[i]);
+		float az = std::fabs(z[i]);
+		float high = std::max(ax, az);
+		float low = std::min(ax, az);
+		float a = high > 0.0f ? low / high : 0.0f;
+		float a2 = a * a;
+		float angle =
+			a * (ATAN0 + a2 * (ATAN1 + a2 * (ATAN2 + a2 * (ATAN3 + a2 * (ATAN4 + a2 * ATAN5)))));
+		angle = az > ax ? HALF_PI - angle : angle;
+		angle = x[i] < 0.0f ? PI - angle : angle;
+		angle = z[i] < 0.0f ? -angle : angle;
+		s[i] = angle * INV_TWO_PI + 0.5f;
+
+		float length = std::sqrt(x[i] * x[i] + y[i] * y[i] + z[i] * z[i]);
+		float c = length > 0.0f ? y[i] / length : 0.0f;
+		c = std::min(std::max(c, -1.0f), 1.0f);
+		float ac = std::fabs(c);
+		float polar = std::sqrt(1.0f - ac) * (ACOS0 + ac * (ACOS1 + ac * (ACOS2 + ac * ACOS3)));
+		polar = c < 0.0f ? PI - polar : polar;
+		t[i] = polar * INV_PI;
+	}
+}
+
+#ifdef SCOP_X86_KERNELS
+__attribute__((target("sse4.1"))) static void sse41UVs(const float *x, const float *y,
+														const float *z, float *s, float *t) {
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+	__m128 px = _mm_load_ps(x);
+	__m128 py = _mm_load_ps(y);
+	__m128 pz = _mm_load_ps(z);
+
+	__m128 ax = _mm_andnot_ps(signMask, px);
+	__m128 az = _mm_andnot_ps(signMask, pz);
+	__m128 high = _mm_max_ps(ax, az);
+	__m128 low = _mm_min_ps(ax, az);
+	__m128 a = _mm_blendv_ps(zero, _mm_div_ps(low, high), _mm_cmpgt_ps(high, zero));
+	__m128 a2 = _mm_mul_ps(a, a);
+	__m128 poly = _mm_add_ps(_mm_set1_ps(ATAN4), _mm_mul_ps(a2, _mm_set1_ps(ATAN5)));
+	poly = _mm_add_ps(_mm_set1_ps(ATAN3), _mm_mul_ps(a2, poly));
+	poly = _mm_add_ps(_mm_set1_ps(ATAN2), _mm_mul_ps(a2, poly));
+	poly = _mm_add_ps(_mm_set1_ps(ATAN1), _mm_mul_ps(a2, poly));
+	poly = _mm_add_ps(_mm_set1_ps(ATAN0), _mm_mul_ps(a2, poly));
+	__m128 angle = _mm_mul_ps(a, poly);
+	angle = _mm_blendv_ps(angle, _mm_sub_ps(_mm_set1_ps(HALF_PI), angle), _mm_cmpgt_ps(az, ax));
+	angle = _mm_blendv_ps(angle, _mm_sub_ps(_mm_set1_ps(PI), angle), _mm_cmplt_ps(px, zero));
+	angle = _mm_blendv_ps(angle, _mm_sub_ps(zero, angle), _mm_cmplt_ps(pz, zero));
+	_mm_store_ps(s, _mm_add_ps(_mm_mul_ps(angle, _mm_set1_ps(INV_TWO_PI)), _mm_set1_ps(0.5f)));
+
+	__m128 squared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, px), _mm_mul_ps(py, py)),
+								_mm_mul_ps(pz, pz));
+	__m128 length = _mm_sqrt_ps(squared);
+	__m128 c = _mm_blendv_ps(zero, _mm_div_ps(py, length), _mm_cmpgt_ps(length, zero));
+	c = _mm_min_ps(_mm_max_ps(c, _mm_set1_ps(-1.0f)), _mm_set1_ps(1.0f));
+	__m128 ac = _mm_andnot_ps(signMask, c);
+	poly = _mm_add_ps(_mm_set1_ps(ACOS2), _mm_mul_ps(ac, _mm_set1_ps(ACOS3)));
+	poly = _mm_add_ps(_mm_set1_ps(ACOS1), _mm_mul_ps(ac, poly));
+	poly = _mm_add_ps(_mm_set1_ps(ACOS0), _mm_mul_ps(ac, poly));
+	__m128 polar = _mm_mul_ps(_mm_sqrt_ps(_mm_sub_ps(_mm_set1_ps(1.0f), ac)), poly);
+	polar = _mm_blendv_ps(polar, _mm_sub_ps(_mm_set1_ps(PI), polar), _mm_cmplt_ps(c, zero));
+	_mm_store_ps(t, _mm_mul_ps(polar, _mm_set1_ps(INV_PI)));
+}
+
+__attribute__((target("avx2"))) static void avx2UVs(const float *x, const float *y,
+													const float *z, float *s, float *t) {
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 signMask = _mm256_set1_ps(-0.0f);
+	__m256 px = _mm256_load_ps(x);
+	__m256 py = _mm256_load_ps(y);
+	__m256 pz = _mm256_load_ps(z);
+
+	__m256 ax = _mm256_andnot_ps(signMask, px);
+	__m256 az = _mm256_andnot_ps(signMask, pz);
+	__m256 high = _mm256_max_ps(ax, az);
+	__m256 low = _mm256_min_ps(ax, az);
+	__m256 a = _mm256_blendv_ps(zero, _mm256_div_ps(low, high),
+								_mm256_cmp_ps(high, zero, _CMP_GT_OQ));
+	__m256 a2 = _mm256_mul_ps(a, a);
+	__m256 poly = _mm256_add_ps(_mm256_set1_ps(ATAN4), _mm256_mul_ps(a2, _mm256_set1_ps(ATAN5)));
+	poly = _mm256_add_ps(_mm256_set1_ps(ATAN3), _mm256_mul_ps(a2, poly));
+	poly = _mm256_add_ps(_mm256_set1_ps(ATAN2), _mm256_mul_ps(a2, poly));
+	poly = _mm256_add_ps(_mm256_set1_ps(ATAN1), _mm256_mul_ps(a2, poly));
+	poly = _mm256_add_ps(_mm256_set1_ps(ATAN0), _mm256_mul_ps(a2, poly));
+	__m256 angle = _mm256_mul_ps(a, poly);
+	angle = _mm256_blendv_ps(angle, _mm256_sub_ps(_mm256_set1_ps(HALF_PI), angle),
+							 _mm256_cmp_ps(az, ax, _CMP_GT_OQ));
+	angle = _mm256_blendv_ps(angle, _mm256_sub_ps(_mm256_set1_ps(PI), angle),
+							 _mm256_cmp_ps(px, zero, _CMP_LT_OQ));
+	angle = _mm256_blendv_ps(angle, _mm256_sub_ps(zero, angle),
+							 _mm256_cmp_ps(pz, zero, _CMP_LT_OQ));
+	_mm256_store_ps(s, _mm256_add_ps(_mm256_mul_ps(angle, _mm256_set1_ps(INV_TWO_PI)),
+									 _mm256_set1_ps(0.5f)));
+
+	__m256 squared = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px, px), _mm256_mul_ps(py, py)),
+								   _mm256_mul_ps(pz, pz));
+	__m256 length = _mm256_sqrt_ps(squared);
+	__m256 c = _mm256_blendv_ps(zero, _mm256_div_ps(py, length),
+								_mm256_cmp_ps(length, zero, _CMP_GT_OQ));
+	c = _mm256_min_ps(_mm256_max_ps(c, _mm256_set1_ps(-1.0f)), _mm256_set1_ps(1.0f));
+	__m256 ac = _mm256_andnot_ps(signMask, c);
+	poly = _mm256_add_ps(_mm256_set1_ps(ACOS2), _mm256_mul_ps(ac, _mm256_set1_ps(ACOS3)));
+	poly = _mm256_add_ps(_mm256_set1_ps(ACOS1), _mm256_mul_ps(ac, poly));
+	poly = _mm256_add_ps(_mm256_set1_ps(ACOS0), _mm256_mul_ps(ac, poly));
+	__m256 polar = _mm256_mul_ps(_mm256_sqrt_ps(_mm256_sub_ps(_mm256_set1_ps(1.0f), ac)), poly);
+	polar = _mm256_blendv_ps(polar, _mm256_sub_ps(_mm256_set1_ps(PI), polar),
+							 _mm256_cmp_ps(c, zero, _CMP_LT_OQ));
+	_mm256_store_ps(t, _mm256_mul_ps(polar, _mm256_set1_ps(INV_PI)));
+}
+
+__attribute__((target("sse4.1"))) static void sse41Translate(float *values, size_t count,
+															  const float *pattern) {
+	__m128 p0 = _mm_loadu_ps(pattern);
+	__m128 p1 = _mm_loadu_ps(pattern + 4);
+	__m128 p2 = _mm_loadu_ps(pattern + 8);
+	for (size_t i = 0; i < count; i += 12) {
+		_mm_storeu_ps(values + i, _mm_sub_ps(_mm_loadu_ps(values + i), p0));
+		_mm_storeu_ps(values + i + 4, _mm_sub_ps(_mm_loadu_ps(values + i + 4), p1));
+		_mm_storeu_ps(values + i + 8, _mm_sub_ps(_mm_loadu_ps(values + i + 8), p2));
+	}
+}
+
+__attribute__((target("avx2"))) static void avx2Translate(float *values, size_t count,
+														  const float *pattern) {
+	__m256 p0 = _mm256_loadu_ps(pattern);
+	__m256 p1 = _mm256_loadu_ps(pattern + 8);
+	__m256 p2 = _mm256_loadu_ps(pattern + 16);
+	for (size_t i = 0; i < count; i += 24) {
+		_mm256_storeu_ps(values + i, _mm256_sub_ps(_mm256_loadu_ps(values + i), p0));
+		_mm256_storeu_ps(values + i + 8, _mm256_sub_ps(_mm256_loadu_ps(values + i + 8), p1));
+		_mm256_storeu_ps(values + i + 16, _mm256_sub_ps(_mm256_loadu_ps(values + i + 16), p2));
+	}
+}
+#endif
+
+void translatePositions(Vec3 *positions, size_t count, const Vec3 &offset, KernelIsa isa) {
+	// x y z repeats every 3 floats, so 3 registers of the repeated offset cover a whole number of
+	// positions: 8 with AVX2, 4 with SSE
+	if (count == 0)
+		return;
+	float *values = &positions[0].x;
+	size_t total = count * 3;
+	float pattern[24];
+	for (int i = 0; i < 24; i++)
+		pattern[i] = offset[i % 3];
+	size_t done = 0;
+#ifdef SCOP_X86_KERNELS
+	if (isa == KernelIsa::Avx2) {
+		done = total / 24 * 24;
+		avx2Translate(values, done, pattern);
+	} else if (isa == KernelIsa::Sse41) {
+		done = total / 12 * 12;
+		sse41Translate(values, done, pattern);
+	}
+#endif
+	for (size_t i = done; i < total; i++)
+		values[i] -= pattern[i % 3];
+#ifndef SCOP_X86_KERNELS
+	(void)isa;
+#endif
+}
+
+void sphericalUVs(const Vec3 *positions, size_t count, Vec2 *texCoords, KernelIsa isa) {
+	// Blocks of 8 positions in structure of arrays, the last one padded with the origin
+	const size_t BLOCK = 8;
+	alignas(32) float x[BLOCK];
+	alignas(32) float y[BLOCK];
+	alignas(32) float z[BLOCK];
+	alignas(32) float s[BLOCK];
+	alignas(32) float t[BLOCK];
+	for (size_t first = 0; first < count; first += BLOCK) {
+		size_t n = std::min(BLOCK, count - first);
+		for (size_t i = 0; i < BLOCK; i++) {
+			const Vec3 &p = i < n ? positions[first + i] : Vec3(0.0f, 0.0f, 0.0f);
+			x[i] = p.x;
+			y[i] = p.y;
+			z[i] = p.z;
+		}
+#ifdef SCOP_X86_KERNELS
+		if (isa == KernelIsa::Avx2) {
+			avx2UVs(x, y, z, s, t);
+		} else if (isa == KernelIsa::Sse41) {
+			sse41UVs(x, y, z, s, t);
+			sse41UVs(x + 4, y + 4, z + 4, s + 4, t + 4);
+		} else
+#endif
+			scalarUVs(x, y, z, BLOCK, s, t);
+		for (size_t i = 0; i < n; i++) {
+			texCoords[first + i].s = s[i];
+			texCoords[first + i].t = t[i];
+		}
+	}
+#ifndef SCOP_X86_KERNELS
+	(void)isa;
+#endif
+}
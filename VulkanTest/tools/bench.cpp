@@ -0,0 +1,904 @@
+#include "bvh.hpp"
+#include "flat_id_map.hpp"
+#include "mesh.hpp"
+#include "mesh_cache.hpp"
+#include "mesh_clean.hpp"
+#include "mesh_optimize.hpp"
+#include "meshlet.hpp"
+#include "normals.hpp"
+#include "objloader.hpp"
+#include "simplify.hpp"
+#include "vertex_kernels.hpp"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <random>
+#include <string>
+#include <sys/stat.h>
+#include <unordered_map>
+#include <vector>
+
+// Loader benchmark. Generates deterministic synthetic OBJ files once, then runs every phase of
+// Scop::loadModel on them (parse, build, cache write, cache read) plus the streaming loader,
+// reporting time, throughput, peak RSS and heap allocations per phase. No window or GPU needed.
+// OBJ files given on the command line are run after the synthetic ones. The loaders that must
+// agree are compared along the way, and any difference fails the run, so CI catches it.
+//
+//   scop_bench [--faces=<max>] [--threads=<n>] [--weld=auto|hash|sort] [--filter=<text>]
+//              [--dir=<path>] [model.obj...]
+
+// Heap allocations, counted by the global operators new below. Every form is replaced, the
+// array, nothrow and aligned ones included, so none goes uncounted and each delete matches the
+// new that allocated with malloc or aligned_alloc; both are released by free.
+static std::atomic<size_t> allocationCount{0};
+static std::atomic<size_t> allocatedBytes{0};
+
+static void *countedAllocate(size_t size, size_t alignment) noexcept {
+	allocationCount.fetch_add(1, std::memory_order_relaxed);
+	allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+	if (size == 0)
+		size = 1;
+	if (alignment <= alignof(std::max_align_t))
+		return malloc(size);
+	// aligned_alloc wants a multiple of the alignment
+	return aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+static void *countedAllocateOrThrow(size_t size, size_t alignment) {
+	if (void *ptr = countedAllocate(size, alignment))
+		return ptr;
+	throw std::bad_alloc();
+}
+
+void *operator new(size_t size) {
+	return countedAllocateOrThrow(size, alignof(std::max_align_t));
+}
+
+void *operator new[](size_t size) {
+	return countedAllocateOrThrow(size, alignof(std::max_align_t));
+}
+
+void *operator new(size_t size, std::align_val_t alignment) {
+	return countedAllocateOrThrow(size, static_cast<size_t>(alignment));
+}
+
+void *operator new[](size_t size, std::align_val_t alignment) {
+	return countedAllocateOrThrow(size, static_cast<size_t>(alignment));
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+	return countedAllocate(size, alignof(std::max_align_t));
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+	return countedAllocate(size, alignof(std::max_align_t));
+}
+
+void *operator new(size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+	return countedAllocate(size, static_cast<size_t>(alignment));
+}
+
+void *operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+	return countedAllocate(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void *ptr) noexcept {
+	free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+	free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+	free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept {
+	free(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept {
+	free(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t) noexcept {
+	free(ptr);
+}
+
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept {
+	free(ptr);
+}
+
+void operator delete[](void *ptr, size_t, std::align_val_t) noexcept {
+	free(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept {
+	free(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept {
+	free(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t, const std::nothrow_t &) noexcept {
+	free(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t, const std::nothrow_t &) noexcept {
+	free(ptr);
+}
+
+// Peak RSS of the current phase: writing 5 to clear_refs resets VmHWM to the current RSS
+static void resetPeakRss() {
+	if (FILE *file = fopen("/proc/self/clear_refs", "w")) {
+		fputs("5", file);
+		fclose(file);
+	}
+}
+
+static size_t peakRssKiB() {
+	FILE *file = fopen("/proc/self/status", "r");
+	if (file == nullptr)
+		return 0;
+	char line[256];
+	size_t peak = 0;
+	while (fgets(line, sizeof(line), file)) {
+		if (strncmp(line, "VmHWM:", 6) == 0)
+			peak = strtoull(line + 6, nullptr, 10);
+	}
+	fclose(file);
+	return peak;
+}
+
+// Buffered OBJ text output, numbers formatted with to_chars
+class ObjWriter {
+public:
+	explicit ObjWriter(FILE *file) : file(file) { buffer.reserve(capacity); }
+	~ObjWriter() { flush(); }
+
+	void vec3(const char *record, float x, float y, float z) {
+		buffer += record;
+		number(x);
+		number(y);
+		number(z);
+		buffer += '\n';
+		flushIfFull();
+	}
+
+	void vec2(const char *record, float s, float t) {
+		buffer += record;
+		number(s);
+		number(t);
+		buffer += '\n';
+		flushIfFull();
+	}
+
+	// Face over the given OBJ indices (1-based or negative), repeated for vt / vn when they exist
+	void face(const int64_t *corners, size_t count, bool attributes) {
+		buffer += 'f';
+		for (size_t i = 0; i < count; i++) {
+			number(corners[i]);
+			if (attributes) {
+				buffer += '/';
+				integer(corners[i]);
+				buffer += '/';
+				integer(corners[i]);
+			}
+		}
+		buffer += '\n';
+		flushIfFull();
+	}
+
+private:
+	static const size_t capacity = 1 << 20;
+	FILE *file;
+	std::string buffer;
+
+	void number(float value) {
+		char text[32];
+		text[0] = ' ';
+		char *end = std::to_chars(text + 1, text + sizeof(text), value).ptr;
+		buffer.append(text, end);
+	}
+
+	void number(int64_t value) {
+		buffer += ' ';
+		integer(value);
+	}
+
+	void integer(int64_t value) {
+		char text[24];
+		char *end = std::to_chars(text, text + sizeof(text), value).ptr;
+		buffer.append(text, end);
+	}
+
+	void flushIfFull() {
+		if (buffer.size() >= capacity - 256)
+			flush();
+	}
+
+	void flush() {
+		fwrite(buffer.data(), 1, buffer.size(), file);
+		buffer.clear();
+	}
+};
+
+enum class Shape { Grid, Sphere, Polygons };
+
+struct BenchCase {
+	std::string name;
+	Shape shape;
+	bool attributes;
+	size_t faces;
+};
+
+// Height field over [-1, 1]^2 split into n * n quads
+static void writeGrid(ObjWriter &out, size_t faces, bool attributes) {
+	size_t n = std::max<size_t>(1, static_cast<size_t>(std::sqrt(static_cast<double>(faces))));
+	for (size_t j = 0; j <= n; j++) {
+		for (size_t i = 0; i <= n; i++) {
+			float x = 2.0f * i / n - 1.0f;
+			float y = 2.0f * j / n - 1.0f;
+			out.vec3("v", x, y, 0.1f * std::sin(3.0f * x) * std::cos(3.0f * y));
+			if (attributes) {
+				float dx = 0.3f * std::cos(3.0f * x) * std::cos(3.0f * y);
+				float dy = -0.3f * std::sin(3.0f * x) * std::sin(3.0f * y);
+				Vec3 normal = Vec3(-dx, -dy, 1.0f).normalize();
+				out.vec2("vt", static_cast<float>(i) / n, static_cast<float>(j) / n);
+				out.vec3("vn", normal.x, normal.y, normal.z);
+			}
+		}
+	}
+	for (size_t j = 0; j < n; j++) {
+		for (size_t i = 0; i < n; i++) {
+			int64_t base = static_cast<int64_t>(j * (n + 1) + i + 1);
+			int64_t quad[4] = {base, base + 1, base + 1 + static_cast<int64_t>(n + 1),
+							   base + static_cast<int64_t>(n + 1)};
+			out.face(quad, 4, attributes);
+		}
+	}
+}
+
+// UV sphere of triangles, with the seam column and the pole rows duplicated like exporters do
+static void writeSphere(ObjWriter &out, size_t faces, bool attributes) {
+	size_t segments =
+		std::max<size_t>(4, static_cast<size_t>(std::sqrt(static_cast<double>(faces))));
+	size_t rings = std::max<size_t>(2, segments / 2);
+	for (size_t r = 0; r <= rings; r++) {
+		float phi = static_cast<float>(M_PI) * r / rings;
+		for (size_t s = 0; s <= segments; s++) {
+			float theta = 2.0f * static_cast<float>(M_PI) * s / segments;
+			float x = std::sin(phi) * std::cos(theta);
+			float y = std::cos(phi);
+			float z = std::sin(phi) * std::sin(theta);
+			out.vec3("v", x, y, z);
+			if (attributes) {
+				out.vec2("vt", static_cast<float>(s) / segments,
+						 1.0f - static_cast<float>(r) / rings);
+				out.vec3("vn", x, y, z);
+			}
+		}
+	}
+	for (size_t r = 0; r < rings; r++) {
+		for (size_t s = 0; s < segments; s++) {
+			int64_t a = static_cast<int64_t>(r * (segments + 1) + s + 1);
+			int64_t b = a + static_cast<int64_t>(segments + 1);
+			int64_t first[3] = {a, b, a + 1};
+			int64_t second[3] = {a + 1, b, b + 1};
+			out.face(first, 3, attributes);
+			out.face(second, 3, attributes);
+		}
+	}
+}
+
+// Separate regular polygons of 3 to 8 sides laid out on a grid, each written as its vertices
+// followed by a face over negative indices, the way streaming exporters interleave them
+static void writePolygons(ObjWriter &out, size_t faces, bool attributes) {
+	static const size_t sides[] = {3, 4, 4, 5, 6, 8};
+	size_t columns =
+		std::max<size_t>(1, static_cast<size_t>(std::sqrt(static_cast<double>(faces))));
+	for (size_t f = 0; f < faces; f++) {
+		size_t count = sides[f % 6];
+		float cx = static_cast<float>(f % columns);
+		float cy = static_cast<float>(f / columns);
+		int64_t corners[8];
+		for (size_t k = 0; k < count; k++) {
+			float angle = 2.0f * static_cast<float>(M_PI) * k / count;
+			out.vec3("v", cx + 0.45f * std::cos(angle), cy + 0.45f * std::sin(angle), 0.0f);
+			if (attributes) {
+				out.vec2("vt", 0.5f + 0.5f * std::cos(angle), 0.5f + 0.5f * std::sin(angle));
+				out.vec3("vn", 0.0f, 0.0f, 1.0f);
+			}
+			corners[k] = static_cast<int64_t>(k) - static_cast<int64_t>(count);
+		}
+		out.face(corners, count, attributes);
+	}
+}
+
+static bool fileExists(const std::string &path) {
+	struct stat st;
+	return stat(path.c_str(), &st) == 0;
+}
+
+static size_t fileSize(const std::string &path) {
+	struct stat st;
+	return stat(path.c_str(), &st) == 0 ? static_cast<size_t>(st.st_size) : 0;
+}
+
+// Files are deterministic, so one already on disk is reused
+static bool generate(const BenchCase &bench, const std::string &path) {
+	if (fileExists(path))
+		return true;
+	std::string tmpPath = path + ".tmp";
+	FILE *file = fopen(tmpPath.c_str(), "wb");
+	if (file == nullptr)
+		return false;
+	{
+		ObjWriter out(file);
+		if (bench.shape == Shape::Grid)
+			writeGrid(out, bench.faces, bench.attributes);
+		else if (bench.shape == Shape::Sphere)
+			writeSphere(out, bench.faces, bench.attributes);
+		else
+			writePolygons(out, bench.faces, bench.attributes);
+	}
+	bool ok = fclose(file) == 0;
+	if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+		remove(tmpPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+static std::string sizeName(size_t faces) {
+	if (faces >= 1000000)
+		return std::to_string(faces / 1000000) + "M";
+	return std::to_string(faces / 1000) + "k";
+}
+
+// Times one phase and prints its row. Returns what the phase returned.
+static bool runPhase(const char *phase, size_t inputBytes, const std::function<bool()> &fn) {
+	resetPeakRss();
+	size_t allocationsBefore = allocationCount.load();
+	size_t bytesBefore = allocatedBytes.load();
+	auto start = std::chrono::steady_clock::now();
+
+	bool ok = fn();
+
+	double ms =
+		std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	double inputMiB = inputBytes / (1024.0 * 1024.0);
+	printf("  %-12s %10.2f ms %9.1f MiB/s %9.1f MiB %10zu allocs %9.1f MiB%s\n", phase, ms,
+		   ms > 0.0 ? inputMiB / (ms / 1000.0) : 0.0, peakRssKiB() / 1024.0,
+		   allocationCount.load() - allocationsBefore,
+		   (allocatedBytes.load() - bytesBefore) / (1024.0 * 1024.0), ok ? "" : "  FAILED");
+	return ok;
+}
+
+// The std::hash<Vertex> buildMesh used with std::unordered_map before FlatIdMap, for comparison
+struct XorVertexHash {
+	size_t operator()(const Vertex &vertex) const {
+		return (std::hash<Vec3>()(vertex.pos) >> 1) ^ (std::hash<Vec2>()(vertex.texCoord) << 1);
+	}
+};
+
+static void printDedup(const char *table, double ms, size_t keys, size_t unique, double load,
+					   double probes) {
+	printf("  %-12s %10.2f ms %9.1f Mvtx/s %9zu unique   load %.2f   probes %.2f\n", table, ms,
+		   ms > 0.0 ? keys / 1000.0 / ms : 0.0, unique, load, probes);
+}
+
+// Vertex dedup of buildMesh on its own, on the vertices it is given: FlatIdMap sized from their
+// count like buildMesh does, FlatIdMap grown from empty, and the std::unordered_map it replaced.
+// Probes is the mean number of slots (or bucket nodes) read to find a present vertex.
+static void runDedup(const ObjMesh &objMesh) {
+	std::vector<Vertex> vertices(objMesh.positions.size());
+	for (size_t i = 0; i < vertices.size(); i++) {
+		vertices[i].pos = objMesh.positions[i];
+		if (!objMesh.texCoords.empty())
+			vertices[i].texCoord = objMesh.texCoords[i];
+		else
+			computeUVs(vertices[i]);
+	}
+
+	for (bool presized : {true, false}) {
+		auto start = std::chrono::steady_clock::now();
+		FlatIdMap<Vertex, VertexHash> table(presized ? vertices.size() : 0);
+		uint32_t unique = 0;
+		for (const Vertex &vertex : vertices) {
+			bool isNew;
+			table.insert(vertex, unique, isNew);
+			unique += isNew;
+		}
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() -
+															  start)
+						.count();
+		printDedup(presized ? "dedup flat" : "dedup grown", ms, vertices.size(), table.size(),
+				   table.loadFactor(), table.averageProbeLength());
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	std::unordered_map<Vertex, uint32_t, XorVertexHash> map;
+	for (const Vertex &vertex : vertices)
+		map.emplace(vertex, static_cast<uint32_t>(map.size()));
+	double ms =
+		std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	size_t nodes = 0;
+	for (size_t bucket = 0; bucket < map.bucket_count(); bucket++) {
+		size_t length = map.bucket_size(bucket);
+		nodes += length * (length + 1) / 2;
+	}
+	printDedup("dedup std", ms, vertices.size(), map.size(), map.load_factor(),
+			   map.empty() ? 0.0 : static_cast<double>(nodes) / map.size());
+}
+
+// The centering and spherical projection kernels of buildMesh in every instruction set this CPU
+// has, on a copy of the positions. Every set must give the same texture coordinates; the error is
+// against atan2 / acos in double precision, s only off the poles where it is undefined. Returns
+// false when a set differs.
+static bool runVertexKernels(const ObjMesh &objMesh) {
+	size_t count = objMesh.positions.size();
+	Vec3 center = computeBounds(objMesh.positions.data(), count).center;
+	std::vector<Vec2> reference;
+	bool ok = true;
+	for (int i = 0; i <= static_cast<int>(bestKernelIsa()); i++) {
+		KernelIsa isa = static_cast<KernelIsa>(i);
+		std::vector<Vec3> positions(objMesh.positions);
+		std::vector<Vec2> texCoords(count);
+		auto start = std::chrono::steady_clock::now();
+		translatePositions(positions.data(), count, center, isa);
+		auto middle = std::chrono::steady_clock::now();
+		sphericalUVs(positions.data(), count, texCoords.data(), isa);
+		auto end = std::chrono::steady_clock::now();
+		double translateMs = std::chrono::duration<double, std::milli>(middle - start).count();
+		double uvMs = std::chrono::duration<double, std::milli>(end - middle).count();
+		printf("  %-12s %10.2f ms translate %8.2f ms uvs %9.1f Mvtx/s", kernelIsaName(isa),
+			   translateMs, uvMs, uvMs > 0.0 ? count / 1000.0 / uvMs : 0.0);
+
+		if (isa != KernelIsa::Scalar) {
+			size_t mismatches = 0;
+			for (size_t v = 0; v < count; v++)
+				mismatches += texCoords[v].s != reference[v].s || texCoords[v].t != reference[v].t;
+			printf("   %zu differ from scalar%s\n", mismatches, mismatches ? "  FAILED" : "");
+			ok &= mismatches == 0;
+			continue;
+		}
+		double errorS = 0.0;
+		double errorT = 0.0;
+		for (size_t v = 0; v < count; v++) {
+			double x = positions[v].x, y = positions[v].y, z = positions[v].z;
+			double length = std::sqrt(x * x + y * y + z * z);
+			if (length == 0.0)
+				continue;
+			if (x != 0.0 || z != 0.0) {
+				double s = std::fabs(texCoords[v].s - (std::atan2(z, x) / (2.0 * M_PI) + 0.5));
+				errorS = std::max(errorS, std::min(s, std::fabs(s - 1.0)));
+			}
+			errorT = std::max(errorT, std::fabs(texCoords[v].t - std::acos(y / length) / M_PI));
+		}
+		printf("   error %.1e / %.1e\n", errorS, errorT);
+		reference = std::move(texCoords);
+	}
+	return ok;
+}
+
+// Rays from 1.5 times the radius of the bounding sphere to random points of the box, like clicks
+// on the model, traced through the hierarchy and by testing every triangle. The brute force only
+// runs the first rays, about 50M triangle tests worth, and its hits must match.
+static bool runPicking(const Mesh &mesh, const Bvh &bvh) {
+	const size_t rayCount = 100000;
+	size_t triangles = std::max<size_t>(fullIndexCount(mesh) / 3, 1);
+	size_t bruteCount = std::min<size_t>(std::max<size_t>(50000000 / triangles, 1), rayCount);
+	const MeshBounds &bounds = mesh.bounds;
+	std::mt19937 random(42);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::vector<Vec3> origins(rayCount);
+	std::vector<Vec3> directions(rayCount);
+	for (size_t i = 0; i < rayCount; i++) {
+		Vec3 side(unit(random), unit(random), unit(random));
+		float length = side.length();
+		side = length > 0.0f ? side / length : Vec3(0.0f, 0.0f, 1.0f);
+		origins[i] = bounds.center + side * (1.5f * std::max(bounds.radius, 1e-6f));
+		Vec3 target;
+		for (int axis = 0; axis < 3; axis++)
+			target[axis] = bounds.center[axis] +
+						   unit(random) * (bounds.max[axis] - bounds.min[axis]) * 0.5f;
+		directions[i] = target - origins[i];
+	}
+
+	std::vector<RayHit> hits(rayCount);
+	size_t hitCount = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < rayCount; i++)
+		hitCount += intersectBvh(bvh, mesh, origins[i], directions[i], hits[i]);
+	double bvhMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() -
+															  start)
+					   .count();
+	size_t mismatches = 0;
+	start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < bruteCount; i++) {
+		RayHit hit;
+		bool found = intersectTriangles(mesh, origins[i], directions[i], hit);
+		if (found != (hits[i].triangle != UINT32_MAX) ||
+			(found && std::fabs(hit.distance - hits[i].distance) > 1e-5f * hit.distance))
+			mismatches++;
+	}
+	double bruteMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() -
+																start)
+						 .count();
+	printf("  %zu nodes (%.2f MiB), SAH cost %.1f, %.3f Mrays/s with %.1f%% hits, %.0f rays/s "
+		   "testing every triangle, %zu of %zu rays differ\n",
+		   bvh.nodes.size(), bvh.nodes.size() * sizeof(BvhNode) / (1024.0 * 1024.0), bvhCost(bvh),
+		   rayCount / std::max(bvhMs, 1e-3) / 1000.0, 100.0 * hitCount / rayCount,
+		   bruteCount / std::max(bruteMs, 1e-3) * 1000.0, mismatches, bruteCount);
+	return mismatches == 0;
+}
+
+// Byte equality of arrays of plain values: the loaders that must agree do so to the bit
+template <typename T> static bool sameArray(const std::vector<T> &a, const std::vector<T> &b) {
+	return a.size() == b.size() &&
+		   (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+}
+
+static bool sameBounds(const MeshBounds &a, const MeshBounds &b) {
+	return memcmp(&a, &b, sizeof(MeshBounds)) == 0;
+}
+
+static bool sameSubmeshes(const std::vector<Submesh> &a, const std::vector<Submesh> &b) {
+	if (a.size() != b.size())
+		return false;
+	for (size_t i = 0; i < a.size(); i++) {
+		if (a[i].name != b[i].name || a[i].material != b[i].material ||
+			a[i].indexOffset != b[i].indexOffset || a[i].indexCount != b[i].indexCount ||
+			!sameBounds(a[i].bounds, b[i].bounds))
+			return false;
+	}
+	return true;
+}
+
+static bool sameObjMesh(const ObjMesh &a, const ObjMesh &b) {
+	return sameArray(a.positions, b.positions) && sameArray(a.texCoords, b.texCoords) &&
+		   sameArray(a.normals, b.normals) && sameArray(a.indices, b.indices) &&
+		   sameSubmeshes(a.submeshes, b.submeshes) && a.materials == b.materials &&
+		   a.materialLibraries == b.materialLibraries;
+}
+
+static bool sameMesh(const Mesh &a, const Mesh &b) {
+	if (!sameArray(a.vertices, b.vertices) || !sameArray(a.indices, b.indices) ||
+		!sameSubmeshes(a.submeshes, b.submeshes) || a.materials != b.materials ||
+		a.materialLibraries != b.materialLibraries || !sameBounds(a.bounds, b.bounds) ||
+		!sameArray(a.meshlets, b.meshlets) || !sameArray(a.firstMeshlet, b.firstMeshlet) ||
+		a.lods.size() != b.lods.size())
+		return false;
+	for (size_t i = 0; i < a.lods.size(); i++) {
+		if (a.lods[i].error != b.lods[i].error || a.lods[i].firstIndex != b.lods[i].firstIndex)
+			return false;
+	}
+	return true;
+}
+
+static const char *sameName(bool same) {
+	return same ? "same" : "DIFFERS";
+}
+
+// loadObj on one thread and with each weld, and streamObj through a 4 KiB window, must all give
+// the mesh the parse phase got. Not timed, the phases above and below are.
+static bool runLoaderChecks(const std::string &path, const ObjMesh &objMesh, unsigned threads) {
+	ObjMesh other;
+	bool serial = loadObj(path.c_str(), other, 1) && sameObjMesh(other, objMesh);
+	other = ObjMesh();
+	bool hash = loadObj(path.c_str(), other, threads, ObjWeld::Hash) && sameObjMesh(other, objMesh);
+	other = ObjMesh();
+	bool sort = loadObj(path.c_str(), other, threads, ObjWeld::Sort) && sameObjMesh(other, objMesh);
+	other = ObjMesh();
+
+	ObjStreamLimits limits{4096, 1024, 4096};
+	auto begin = [&](const ObjStreamInfo &info) {
+		other.submeshes = info.submeshes;
+		other.materials = info.materials;
+		other.materialLibraries = info.materialLibraries;
+	};
+	auto emit = [&](const ObjMesh &batch) {
+		other.positions.insert(other.positions.end(), batch.positions.begin(),
+							   batch.positions.end());
+		other.texCoords.insert(other.texCoords.end(), batch.texCoords.begin(),
+							   batch.texCoords.end());
+		other.normals.insert(other.normals.end(), batch.normals.begin(), batch.normals.end());
+		other.indices.insert(other.indices.end(), batch.indices.begin(), batch.indices.end());
+	};
+	bool stream = streamObj(path.c_str(), limits, begin, emit) && sameObjMesh(other, objMesh);
+
+	printf("  loader checks: one thread %s, hash weld %s, sort weld %s, 4 KiB stream %s\n",
+		   sameName(serial), sameName(hash), sameName(sort), sameName(stream));
+	return serial && hash && sort && stream;
+}
+
+static bool runCase(const std::string &name, const std::string &path, unsigned threads,
+					ObjWeld weld) {
+	size_t bytes = fileSize(path);
+	printf("%s: %.1f MiB\n", name.c_str(), bytes / (1024.0 * 1024.0));
+
+	Mesh mesh;
+	bool ok = true;
+	bool hasTexCoords, hasNormals;
+	{
+		ObjMesh objMesh;
+		ok &= runPhase("parse", bytes, [&]() { return loadObj(path.c_str(), objMesh, threads, weld); });
+		hasTexCoords = !objMesh.texCoords.empty();
+		hasNormals = !objMesh.normals.empty();
+		if (ok) {
+			ok &= runLoaderChecks(path, objMesh, threads);
+			runDedup(objMesh);
+			ok &= runVertexKernels(objMesh);
+		}
+		ok &= runPhase("build", bytes, [&]() {
+			buildMesh(objMesh, mesh);
+			return true;
+		});
+	}
+	printf("  %zu vertices, %zu indices\n", mesh.vertices.size(), mesh.indices.size());
+	MeshSettings settings;
+	settings.hasTexCoords = hasTexCoords;
+	settings.hasNormals = hasNormals;
+	settings.threads = threads;
+
+	// Every pass of Scop as one phase, with what the bench reports between them
+	VertexCacheStats before = {};
+	double fetchBefore = 0.0, fetchMiddle = 0.0;
+	size_t vertexCount = 0, triangles = 0;
+	float radius = 1e-6f;
+	auto benchPass = [&](const char *pass, const std::function<void()> &run,
+						 const MeshProcessStats &stats) {
+		if (strcmp(pass, "vcache") == 0) {
+			vertexCount = mesh.vertices.size();
+			before = analyzeVertexCache(mesh.indices, mesh.vertices.size());
+			fetchBefore = analyzeVertexFetch(mesh.indices, mesh.vertices.size(), sizeof(Vertex));
+		} else if (strcmp(pass, "lods") == 0) {
+			fetchMiddle = analyzeVertexFetch(mesh.indices, mesh.vertices.size(), sizeof(Vertex));
+			triangles = mesh.indices.size() / 3;
+			radius = std::max((mesh.bounds.max - mesh.bounds.min).length() / 2.0f, 1e-6f);
+		}
+		ok &= runPhase(pass, bytes, [&]() {
+			run();
+			return true;
+		});
+
+		if (strcmp(pass, "clean") == 0) {
+			const MeshCleanStats &cleaned = stats.cleaned;
+			printf("  %zu vertices welded, %zu unused, %zu degenerate and %zu duplicate "
+				   "triangles removed\n",
+				   cleaned.weldedVertices, cleaned.unusedVertices, cleaned.degenerateTriangles,
+				   cleaned.duplicateTriangles);
+			MeshBounds bounds;
+			ok &= runPhase("bounds", bytes, [&]() {
+				bounds = computeBounds(mesh.vertices);
+				return true;
+			});
+			printf("  bounding sphere radius %.3f of the half diagonal of the box\n",
+				   bounds.radius / std::max((bounds.max - bounds.min).length() * 0.5f, 1e-30f));
+			// Like Scop, the normals are only generated for files without "vn"
+			if (hasNormals)
+				printf("  normals from the file\n");
+		} else if (strcmp(pass, "normals") == 0) {
+			printf("  %zu vertices split at creases of %.0f degrees\n", stats.creaseVertices,
+				   DEFAULT_CREASE_ANGLE);
+		} else if (strcmp(pass, "lods") == 0) {
+			printf("  %zu levels of detail:", mesh.lods.size());
+			for (const MeshLod &lod : mesh.lods)
+				printf(" %.1f%% (error %.2e)",
+					   100.0 * (lod.firstIndex.back() - lod.firstIndex.front()) / (triangles * 3),
+					   lod.error / (2.0f * radius));
+			printf(" of the triangles and diagonal\n");
+		}
+	};
+	processMesh(mesh, settings, benchPass);
+
+	std::vector<uint32_t> full(mesh.indices.begin(), mesh.indices.begin() + fullIndexCount(mesh));
+	VertexCacheStats after = analyzeVertexCache(full, mesh.vertices.size());
+	double fetchAfter = analyzeVertexFetch(full, mesh.vertices.size(), sizeof(Vertex));
+	printf("  ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, overfetch %.2f -> %.2f -> %.2f\n",
+		   before.acmr, after.acmr, before.atvr, after.atvr, fetchBefore, fetchMiddle, fetchAfter);
+
+	// Meshlet culling from 16 directions around the model, at 2.5 times the radius of its bounds
+	IndexLayout wide = wideIndexLayout(mesh);
+	std::vector<IndexRange> visible;
+	size_t drawn = 0;
+	auto cullStart = std::chrono::steady_clock::now();
+	for (int i = 0; i < 16; i++) {
+		float y = 1.0f - 2.0f * (i + 0.5f) / 16;
+		float angle = i * 2.39996323f;
+		Vec3 direction(std::cos(angle) * std::sqrt(1.0f - y * y), y,
+					   std::sin(angle) * std::sqrt(1.0f - y * y));
+		Mat4 proj = Mat4::perspective(radians(45.0f), 1.0f, 0.01f * radius, 10.0f * radius);
+		proj[1][1] *= -1;
+		Mat4 view = Mat4::lookAt(direction * (2.5f * radius), Vec3(0.0f, 0.0f, 0.0f),
+								 Vec3(0.0f, 1.0f, 0.0f));
+		MeshletCuller culler(proj * view);
+		for (size_t submesh = 0; submesh < mesh.submeshes.size(); submesh++) {
+			visible.clear();
+			appendVisibleRanges(mesh, wide, submesh, 0, &culler, visible);
+			for (const IndexRange &range : visible)
+				drawn += range.indexCount / 3;
+		}
+	}
+	double cullMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() -
+															   cullStart)
+						.count() /
+					16;
+	printf("  %zu meshlets, %.1f triangles each, culling keeps %.1f%% of the triangles in %.3f ms "
+		   "per view\n",
+		   mesh.meshlets.size(),
+		   mesh.meshlets.empty() ? 0.0 : static_cast<double>(triangles) / mesh.meshlets.size(),
+		   triangles ? 100.0 * drawn / (16 * triangles) : 0.0, cullMs);
+
+	// Both vertex buffer layouts, with the largest decoding error of the compact one relative to
+	// the size of the mesh
+	std::vector<CompactVertex> compact;
+	VertexDecode decode;
+	ok &= runPhase("quantize", bytes, [&]() {
+		decode = quantizeVertices(mesh.vertices, compact);
+		return true;
+	});
+	float error = 0.0f;
+	float normalCos = 1.0f;
+	for (size_t v = 0; v < compact.size(); v++) {
+		for (int i = 0; i < 3; i++) {
+			float decoded =
+				decode.positionOffset[i] + compact[v].pos[i] / 65535.0f * decode.positionScale[i];
+			error = std::max(error, std::fabs(decoded - mesh.vertices[v].pos[i]));
+		}
+		// The octahedral decoding of the vertex shader
+		const Vec3 &normal = mesh.vertices[v].normal;
+		float x = std::max(compact[v].normal[0] / 127.0f, -1.0f);
+		float y = std::max(compact[v].normal[1] / 127.0f, -1.0f);
+		float z = 1.0f - std::fabs(x) - std::fabs(y);
+		float fold = std::max(-z, 0.0f);
+		x += x >= 0.0f ? -fold : fold;
+		y += y >= 0.0f ? -fold : fold;
+		float length = std::sqrt(x * x + y * y + z * z);
+		if (normal.x != 0.0f || normal.y != 0.0f || normal.z != 0.0f)
+			normalCos = std::min(normalCos, (x * normal.x + y * normal.y + z * normal.z) / length);
+	}
+	float extent = (mesh.bounds.max - mesh.bounds.min).length();
+	printf("  vertex buffer %.2f MiB (%zu B per vertex) -> %.2f MiB (%zu B), error %.2e of the "
+		   "diagonal, normals within %.2f degrees\n",
+		   mesh.vertices.size() * sizeof(Vertex) / (1024.0 * 1024.0), sizeof(Vertex),
+		   compact.size() * sizeof(CompactVertex) / (1024.0 * 1024.0), sizeof(CompactVertex),
+		   extent > 0.0f ? error / extent : 0.0f,
+		   std::acos(std::min(normalCos, 1.0f)) * 180.0 / M_PI);
+
+	std::vector<uint16_t> narrow;
+	IndexLayout layout;
+	ok &= runPhase("narrow", bytes, [&]() {
+		layout = narrowIndices(mesh, narrow);
+		return true;
+	});
+	printf("  index buffer %.2f MiB -> %.2f MiB, %zu ranges for %zu submeshes at %zu levels, %zu "
+		   "vertices added by vfetch\n",
+		   mesh.indices.size() * sizeof(uint32_t) / (1024.0 * 1024.0),
+		   (layout.narrow ? narrow.size() * sizeof(uint16_t)
+						  : mesh.indices.size() * sizeof(uint32_t)) /
+			   (1024.0 * 1024.0),
+		   layout.ranges.size(), mesh.submeshes.size(), mesh.lods.size() + 1,
+		   mesh.vertices.size() - vertexCount);
+
+	Bvh bvh;
+	ok &= runPhase("bvh", bytes, [&]() {
+		bvh = buildBvh(mesh, threads);
+		return true;
+	});
+	ok &= runPicking(mesh, bvh);
+
+	std::string cachePath = path + ".scopmesh";
+	ok &= runPhase("cache write", bytes, [&]() {
+		return writeMeshCache(cachePath, path.c_str(), mesh);
+	});
+	Mesh cached;
+	ok &= runPhase("cache read", bytes,
+				   [&]() { return readMeshCache(cachePath, path.c_str(), cached); });
+	remove(cachePath.c_str());
+	bool roundTrip = sameMesh(cached, mesh);
+	printf("  cache round trip %s\n", sameName(roundTrip));
+	ok &= roundTrip;
+	mesh = Mesh();
+	cached = Mesh();
+
+	// Same split of a 64 MiB budget as Scop::loadStreamedModel, batches are dropped
+	const size_t budget = 64 << 20;
+	ObjStreamLimits limits{budget / 8, budget / 8 / sizeof(Vertex), budget / 8 / sizeof(uint32_t)};
+	ok &= runPhase("stream", bytes, [&]() {
+		return streamObj(path.c_str(), limits, [](const ObjStreamInfo &) {},
+						 [](const ObjMesh &) {});
+	});
+	return ok;
+}
+
+static bool parseCount(const char *text, size_t &out) {
+	char *end;
+	unsigned long long value = strtoull(text, &end, 10);
+	if (end == text)
+		return false;
+	if (*end == 'k' || *end == 'K')
+		value *= 1000, end++;
+	else if (*end == 'M')
+		value *= 1000000, end++;
+	out = static_cast<size_t>(value);
+	return *end == '\0' && value > 0;
+}
+
+int main(int argc, char **argv) {
+	size_t maxFaces = 1000000;
+	size_t threads = 0;
+	ObjWeld weld = ObjWeld::Auto;
+	std::string filter;
+	std::string dir = "bench_models";
+	std::vector<std::string> models;
+
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		bool valid = true;
+		if (strncmp(arg, "--faces=", 8) == 0)
+			valid = parseCount(arg + 8, maxFaces) && maxFaces <= 100000000;
+		else if (strncmp(arg, "--threads=", 10) == 0)
+			valid = parseCount(arg + 10, threads);
+		else if (strcmp(arg, "--weld=auto") == 0)
+			weld = ObjWeld::Auto;
+		else if (strcmp(arg, "--weld=hash") == 0)
+			weld = ObjWeld::Hash;
+		else if (strcmp(arg, "--weld=sort") == 0)
+			weld = ObjWeld::Sort;
+		else if (strncmp(arg, "--filter=", 9) == 0)
+			filter = arg + 9;
+		else if (strncmp(arg, "--dir=", 6) == 0)
+			dir = arg + 6;
+		else if (strncmp(arg, "--", 2) != 0)
+			models.push_back(arg);
+		else
+			valid = false;
+		if (!valid) {
+			fprintf(stderr,
+					"Usage: %s [--faces=<max, up to 100M>] [--threads=<n>] "
+					"[--weld=auto|hash|sort] [--filter=<text>] [--dir=<path>] [model.obj...]\n",
+					argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	mkdir(dir.c_str(), 0755);
+	std::vector<BenchCase> cases;
+	for (size_t faces = 10000; faces <= maxFaces; faces *= 10) {
+		for (Shape shape : {Shape::Grid, Shape::Sphere, Shape::Polygons}) {
+			for (bool attributes : {false, true}) {
+				std::string name = shape == Shape::Grid	  ? "grid"
+								   : shape == Shape::Sphere ? "sphere"
+															: "polygons";
+				name += "-" + sizeName(faces) + (attributes ? "-uvn" : "");
+				if (name.find(filter) != std::string::npos)
+					cases.push_back({name, shape, attributes, faces});
+			}
+		}
+	}
+
+	bool ok = true;
+	for (const BenchCase &bench : cases) {
+		std::string path = dir + "/" + bench.name + ".obj";
+		if (!generate(bench, path)) {
+			fprintf(stderr, "failed to write %s\n", path.c_str());
+			return EXIT_FAILURE;
+		}
+		ok &= runCase(bench.name, path, static_cast<unsigned>(threads), weld);
+	}
+	for (const std::string &model : models)
+		ok &= runCase(model, model, static_cast<unsigned>(threads), weld);
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
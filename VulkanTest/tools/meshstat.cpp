@@ -0,0 +1,179 @@
+#include "mesh.hpp"
+#include "mesh_optimize.hpp"
+#include "meshlet.hpp"
+#include "objloader.hpp"
+#include "simplify.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Offline mesh statistics, to triage models before they reach Scop. Builds every OBJ given on the
+// command line through processMesh, as Scop::loadObjModel does with its default options, and
+// reports what the GPU would get: vertex and index counts and how far the corners were
+// deduplicated, ACMR / ATVR for every simulated cache size, overdraw from a set of viewpoints, and
+// the bytes per triangle of every vertex and index format, in file order and in the order Scop
+// uploads. The times of the parse, of the merge by value of buildMesh and of the weld of cleanMesh
+// come first. No window or GPU needed.
+//
+//   scop_meshstat [--cache=<vertices>]... [--views=<n>] [--size=<pixels>]
+//                 [--weld=auto|hash|sort] model.obj...
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+		.count();
+}
+
+// ACMR / ATVR for every cache size and the overdraw of the full mesh, on one row
+static void printOrder(const char *order, const Mesh &mesh, const std::vector<unsigned> &cacheSizes,
+					   int viewCount, int size) {
+	std::vector<uint32_t> full(mesh.indices.begin(), mesh.indices.begin() + fullIndexCount(mesh));
+	printf("  %-12s", order);
+	for (unsigned cacheSize : cacheSizes) {
+		VertexCacheStats cache = analyzeVertexCache(full, mesh.vertices.size(), cacheSize);
+		printf("  ACMR/ATVR@%u %.3f/%.3f", cacheSize, cache.acmr, cache.atvr);
+	}
+	printf("  overdraw %.3f\n", analyzeOverdraw(mesh, viewCount, size).overdraw);
+}
+
+// Buffers of the full mesh in every layout Scop can upload, over its triangles. The levels of
+// detail are uploaded too and reported apart.
+static void printFormats(const Mesh &mesh) {
+	size_t triangles = std::max<size_t>(fullIndexCount(mesh) / 3, 1);
+	std::vector<uint16_t> narrow;
+	bool narrowed = narrowIndices(mesh, narrow).narrow;
+	const struct {
+		const char *name;
+		size_t vertexSize;
+		size_t indexSize;
+	} formats[] = {
+		{"float vertices, 32-bit indices", sizeof(Vertex), sizeof(uint32_t)},
+		{"float vertices, 16-bit indices", sizeof(Vertex), sizeof(uint16_t)},
+		{"compact vertices, 32-bit indices", sizeof(CompactVertex), sizeof(uint32_t)},
+		{"compact vertices, 16-bit indices", sizeof(CompactVertex), sizeof(uint16_t)},
+	};
+	for (const auto &format : formats) {
+		if (format.indexSize == sizeof(uint16_t) && !narrowed)
+			continue;
+		size_t vertexBytes = mesh.vertices.size() * format.vertexSize;
+		size_t indexBytes = fullIndexCount(mesh) * format.indexSize;
+		printf("  %-34s %8.2f MiB  %6.1f B per triangle (%.1f vertices + %.1f indices)\n",
+			   format.name, (vertexBytes + indexBytes) / (1024.0 * 1024.0),
+			   static_cast<double>(vertexBytes + indexBytes) / triangles,
+			   static_cast<double>(vertexBytes) / triangles,
+			   static_cast<double>(indexBytes) / triangles);
+	}
+	if (!narrowed)
+		printf("  16-bit indices do not fit, a triangle spans more than 65536 vertices\n");
+	size_t lodIndices = mesh.indices.size() - fullIndexCount(mesh);
+	printf("  %zu levels of detail add %zu indices, %.1f per triangle of the full mesh\n",
+		   mesh.lods.size(), lodIndices, static_cast<double>(lodIndices) / triangles);
+}
+
+static bool analyzeModel(const std::string &path, const std::vector<unsigned> &cacheSizes,
+						 int viewCount, int size, ObjWeld weld) {
+	Mesh mesh;
+	size_t corners, objVertices;
+	bool hasTexCoords, hasNormals;
+	{
+		ObjMesh objMesh;
+		auto start = std::chrono::steady_clock::now();
+		if (!loadObj(path.c_str(), objMesh, 0, weld))
+			return false;
+		printf("%s\n  parse and corner weld %.2f ms", path.c_str(), millisecondsSince(start));
+		corners = objMesh.indices.size();
+		objVertices = objMesh.positions.size();
+		hasTexCoords = !objMesh.texCoords.empty();
+		hasNormals = !objMesh.normals.empty();
+		start = std::chrono::steady_clock::now();
+		buildMesh(objMesh, mesh);
+		printf(", build and merge by value %.2f ms", millisecondsSince(start));
+	}
+	size_t builtVertices = mesh.vertices.size();
+	MeshSettings settings;
+	settings.hasTexCoords = hasTexCoords;
+	settings.hasNormals = hasNormals;
+
+	// The counts after the clean, and the file order just before the vertex cache order replaces it
+	auto reportPass = [&](const char *pass, const std::function<void()> &run,
+						  const MeshProcessStats &stats) {
+		if (strcmp(pass, "vcache") == 0 && !mesh.indices.empty())
+			printOrder("file order", mesh, cacheSizes, viewCount, size);
+		auto start = std::chrono::steady_clock::now();
+		run();
+		if (strcmp(pass, "clean") != 0)
+			return;
+		printf(", clean and weld within epsilon %.2f ms\n", millisecondsSince(start));
+		printf("  %zu triangles, %zu submeshes, %zu indices\n", mesh.indices.size() / 3,
+			   mesh.submeshes.size(), mesh.indices.size());
+		printf("  %zu corners -> %zu OBJ vertices -> %zu merged by value -> %zu welded, "
+			   "dedup ratio %.2f corners per vertex\n",
+			   corners, objVertices, builtVertices, mesh.vertices.size(),
+			   mesh.vertices.empty() ? 0.0 : static_cast<double>(corners) / mesh.vertices.size());
+		printf("  %zu degenerate and %zu duplicate triangles removed\n",
+			   stats.cleaned.degenerateTriangles, stats.cleaned.duplicateTriangles);
+	};
+	processMesh(mesh, settings, reportPass);
+	if (mesh.indices.empty())
+		return true;
+	printOrder("optimized", mesh, cacheSizes, viewCount, size);
+	printFormats(mesh);
+	return true;
+}
+
+int main(int argc, char **argv) {
+	std::vector<unsigned> cacheSizes;
+	int viewCount = 16;
+	int size = 512;
+	ObjWeld weld = ObjWeld::Auto;
+	std::vector<std::string> models;
+
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		char *end = nullptr;
+		bool valid = true;
+		if (strncmp(arg, "--cache=", 8) == 0) {
+			long cacheSize = strtol(arg + 8, &end, 10);
+			valid = end != arg + 8 && *end == '\0' && cacheSize >= 3 && cacheSize <= 1024;
+			cacheSizes.push_back(static_cast<unsigned>(cacheSize));
+		} else if (strncmp(arg, "--views=", 8) == 0) {
+			viewCount = static_cast<int>(strtol(arg + 8, &end, 10));
+			valid = end != arg + 8 && *end == '\0' && viewCount >= 1 && viewCount <= 1024;
+		} else if (strncmp(arg, "--size=", 7) == 0) {
+			size = static_cast<int>(strtol(arg + 7, &end, 10));
+			valid = end != arg + 7 && *end == '\0' && size >= 16 && size <= 8192;
+		} else if (strcmp(arg, "--weld=auto") == 0) {
+			weld = ObjWeld::Auto;
+		} else if (strcmp(arg, "--weld=hash") == 0) {
+			weld = ObjWeld::Hash;
+		} else if (strcmp(arg, "--weld=sort") == 0) {
+			weld = ObjWeld::Sort;
+		} else if (strncmp(arg, "--", 2) != 0) {
+			models.push_back(arg);
+		} else {
+			valid = false;
+		}
+		if (!valid) {
+			models.clear();
+			break;
+		}
+	}
+	if (models.empty()) {
+		fprintf(stderr,
+				"Usage: %s [--cache=<vertices>]... [--views=<n>] [--size=<pixels>] "
+				"[--weld=auto|hash|sort] model.obj...\n",
+				argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (cacheSizes.empty())
+		cacheSizes = {8, 16, 32};
+
+	bool ok = true;
+	for (const std::string &model : models)
+		ok &= analyzeModel(model, cacheSizes, viewCount, size, weld);
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
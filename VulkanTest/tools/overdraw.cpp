@@ -0,0 +1,102 @@
+#include "mesh.hpp"
+#include "mesh_optimize.hpp"
+#include "objloader.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Overdraw measurement. Runs every OBJ given on the command line through processMesh like
+// Scop::loadModel does and renders it with the software rasterizer of analyzeOverdraw from a fixed
+// set of viewpoints, with the depth test and culling of the graphics pipeline. The overdraw is the
+// number of fragments that passed the depth test over the number of covered pixels, 1 means every
+// pixel was shaded once. Each model is measured in file order once cleaned, after the "vcache"
+// pass, and after the "overdraw" pass for every threshold, next to the ACMR. The passes after it
+// are skipped, scop_meshstat measures the order Scop uploads.
+//
+//   scop_overdraw [--threshold=<ratio>]... [--size=<pixels>] model.obj...
+
+const int viewCount = 16;
+
+static void printRow(const char *order, const Mesh &mesh, int size) {
+	VertexCacheStats cache = analyzeVertexCache(mesh.indices, mesh.vertices.size());
+	OverdrawStats overdraw = analyzeOverdraw(mesh, viewCount, size);
+	printf("  %-16s ACMR %.3f  overdraw %.3f\n", order, cache.acmr, overdraw.overdraw);
+}
+
+int main(int argc, char **argv) {
+	std::vector<float> thresholds;
+	int size = 512;
+	std::vector<std::string> models;
+
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		char *end = nullptr;
+		bool valid = true;
+		if (strncmp(arg, "--threshold=", 12) == 0) {
+			thresholds.push_back(strtof(arg + 12, &end));
+			valid = end != arg + 12 && *end == '\0' && thresholds.back() >= 1.0f;
+		} else if (strncmp(arg, "--size=", 7) == 0) {
+			size = static_cast<int>(strtol(arg + 7, &end, 10));
+			valid = end != arg + 7 && *end == '\0' && size >= 16 && size <= 8192;
+		} else if (strncmp(arg, "--", 2) != 0) {
+			models.push_back(arg);
+		} else {
+			valid = false;
+		}
+		if (!valid) {
+			models.clear();
+			break;
+		}
+	}
+	if (models.empty()) {
+		fprintf(stderr, "Usage: %s [--threshold=<ratio >= 1>]... [--size=<pixels>] model.obj...\n",
+				argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (thresholds.empty())
+		thresholds.push_back(DEFAULT_OVERDRAW_THRESHOLD);
+
+	for (const std::string &model : models) {
+		ObjMesh objMesh;
+		Mesh built;
+		if (!loadObj(model.c_str(), objMesh))
+			return EXIT_FAILURE;
+		buildMesh(objMesh, built);
+		MeshSettings settings;
+		settings.hasTexCoords = !objMesh.texCoords.empty();
+		settings.hasNormals = !objMesh.normals.empty();
+
+		// Every threshold runs the chain again from the built mesh, the rows before the overdraw
+		// pass are the same each time and printed once
+		for (size_t t = 0; t < thresholds.size(); t++) {
+			Mesh mesh = built;
+			settings.overdrawThreshold = thresholds[t];
+			bool measured = false;
+			auto measurePass = [&](const char *pass, const std::function<void()> &run,
+								   const MeshProcessStats &) {
+				if (measured)
+					return;
+				bool vcache = strcmp(pass, "vcache") == 0;
+				if (vcache && t == 0) {
+					printf("%s: %zu triangles, %d views of %dx%d\n", model.c_str(),
+						   mesh.indices.size() / 3, viewCount, size, size);
+					printRow("file order", mesh, size);
+				}
+				run();
+				if (vcache && t == 0)
+					printRow("vertex cache", mesh, size);
+				if (strcmp(pass, "overdraw") == 0) {
+					char order[32];
+					snprintf(order, sizeof(order), "overdraw %.2f", thresholds[t]);
+					printRow(order, mesh, size);
+					measured = true;
+				}
+			};
+			processMesh(mesh, settings, measurePass);
+		}
+	}
+	return EXIT_SUCCESS;
+}